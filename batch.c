@@ -0,0 +1,169 @@
+#include "batch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Decompose addresses one at a time.
+ */
+static void cache_decompose_scalar(cache_t *cache, const uint64_t *addresses, size_t count,
+                                   uint64_t *lines, uint64_t *indices, uint64_t *tags) {
+    for (size_t i = 0; i < count; i++) {
+        if (lines != NULL) {
+            lines[i] = addresses[i] & ~cache->block_offset_mask;
+        }
+        indices[i] = (addresses[i] & cache->cache_index_mask) >> cache->cache_index_shift;
+        tags[i] = (addresses[i] & cache->tag_mask) >> cache->tag_shift;
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Decompose addresses four at a time.
+ */
+__attribute__((target("avx2")))
+static void cache_decompose_avx2(cache_t *cache, const uint64_t *addresses, size_t count,
+                                 uint64_t *lines, uint64_t *indices, uint64_t *tags) {
+
+    __m256i offset_mask = _mm256_set1_epi64x(cache->block_offset_mask);
+    __m256i index_mask = _mm256_set1_epi64x(cache->cache_index_mask);
+    __m256i tag_mask = _mm256_set1_epi64x(cache->tag_mask);
+    __m128i index_shift = _mm_cvtsi64_si128(cache->cache_index_shift);
+    __m128i tag_shift = _mm_cvtsi64_si128(cache->tag_shift);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i address = _mm256_loadu_si256((const __m256i *)(addresses + i));
+        if (lines != NULL) {
+            _mm256_storeu_si256((__m256i *)(lines + i), _mm256_andnot_si256(offset_mask, address));
+        }
+        _mm256_storeu_si256((__m256i *)(indices + i),
+                            _mm256_srl_epi64(_mm256_and_si256(address, index_mask), index_shift));
+        _mm256_storeu_si256((__m256i *)(tags + i),
+                            _mm256_srl_epi64(_mm256_and_si256(address, tag_mask), tag_shift));
+    }
+    cache_decompose_scalar(cache, addresses + i, count - i, lines != NULL ? lines + i : NULL, indices + i, tags + i);
+}
+
+/*
+ * Decompose addresses eight at a time.
+ */
+__attribute__((target("avx512f")))
+static void cache_decompose_avx512(cache_t *cache, const uint64_t *addresses, size_t count,
+                                   uint64_t *lines, uint64_t *indices, uint64_t *tags) {
+
+    __m512i offset_mask = _mm512_set1_epi64(cache->block_offset_mask);
+    __m512i index_mask = _mm512_set1_epi64(cache->cache_index_mask);
+    __m512i tag_mask = _mm512_set1_epi64(cache->tag_mask);
+    __m128i index_shift = _mm_cvtsi64_si128(cache->cache_index_shift);
+    __m128i tag_shift = _mm_cvtsi64_si128(cache->tag_shift);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m512i address = _mm512_loadu_si512((const void *)(addresses + i));
+        if (lines != NULL) {
+            _mm512_storeu_si512((void *)(lines + i), _mm512_andnot_si512(offset_mask, address));
+        }
+        _mm512_storeu_si512((void *)(indices + i), _mm512_srl_epi64(_mm512_and_si512(address, index_mask), index_shift));
+        _mm512_storeu_si512((void *)(tags + i), _mm512_srl_epi64(_mm512_and_si512(address, tag_mask), tag_shift));
+    }
+    cache_decompose_scalar(cache, addresses + i, count - i, lines != NULL ? lines + i : NULL, indices + i, tags + i);
+}
+
+#endif
+
+/*
+ * Return the fastest kernel the processor supports.
+ */
+int cache_decompose_kernel(void) {
+    static int kernel = -1;
+    if (kernel < 0) {
+        kernel = CACHE_DECOMPOSE_SCALAR;
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            kernel = CACHE_DECOMPOSE_AVX512;
+        } else if (__builtin_cpu_supports("avx2")) {
+            kernel = CACHE_DECOMPOSE_AVX2;
+        }
+#endif
+    }
+    return kernel;
+}
+
+/*
+ * Compute the line address, set index and tag of addresses, with the given kernel.
+ */
+void cache_decompose_with(cache_t *cache, int kernel, const uint64_t *addresses, size_t count,
+                          uint64_t *lines, uint64_t *indices, uint64_t *tags) {
+    switch (kernel) {
+#if defined(__x86_64__)
+        case CACHE_DECOMPOSE_AVX512:
+            cache_decompose_avx512(cache, addresses, count, lines, indices, tags);
+            break;
+        case CACHE_DECOMPOSE_AVX2:
+            cache_decompose_avx2(cache, addresses, count, lines, indices, tags);
+            break;
+#endif
+        default:
+            cache_decompose_scalar(cache, addresses, count, lines, indices, tags);
+            break;
+    }
+}
+
+/*
+ * Compute the line address, set index and tag of addresses, with the fastest kernel.
+ */
+void cache_decompose(cache_t *cache, const uint64_t *addresses, size_t count,
+                     uint64_t *lines, uint64_t *indices, uint64_t *tags) {
+    cache_decompose_with(cache, cache_decompose_kernel(), addresses, count, lines, indices, tags);
+}
+
+/*
+ * Prefetch what the lookup in a set reads: its LRU list and its lines,
+ * found through the set, which may share its lines with other caches (see
+ * sweep.h).
+ */
+static inline void cache_prefetch_set(cache_t *cache, size_t index) {
+    cache_set_t *cache_set = cache->sets + index;
+    __builtin_prefetch(cache_set->lru_list);
+    __builtin_prefetch(cache_set->lines + cache_set->first_index);
+}
+
+/*
+ * Read addresses in order, a batch at a time.
+ */
+void cache_read_batch(cache_t *cache, const uint64_t *addresses, const uint64_t *pcs, size_t count,
+                      uint64_t *values, func_t generate_random_number) {
+
+    uint64_t indices[CACHE_BATCH_SIZE], tags[CACHE_BATCH_SIZE];
+    int kernel = cache_decompose_kernel();
+
+    for (size_t start = 0; start < count; start += CACHE_BATCH_SIZE) {
+        size_t n = count - start < CACHE_BATCH_SIZE ? count - start : CACHE_BATCH_SIZE;
+        cache_decompose_with(cache, kernel, addresses + start, n, NULL, indices, tags);
+
+        for (size_t i = 0; i < n && i < CACHE_BATCH_PREFETCH_DISTANCE; i++) {
+            cache_prefetch_set(cache, indices[i]);
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (i + CACHE_BATCH_PREFETCH_DISTANCE < n) {
+                cache_prefetch_set(cache, indices[i + CACHE_BATCH_PREFETCH_DISTANCE]);
+            }
+            if (pcs != NULL) {
+                cache->access_pc = pcs[start + i];
+            }
+            uint64_t value = cache_read_decomposed(cache, addresses[start + i], indices[i], tags[i],
+                                                   generate_random_number);
+            cache->access_pc = 0;
+            if (values != NULL) {
+                values[start + i] = value;
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * batch.h
+ *
+ * Batched reads. A block of addresses is first split into line addresses,
+ * set indices and tags in a single pass, with AVX-512 or AVX2 when the
+ * processor has them and scalar code otherwise. The reads then go through
+ * the cache in order, with the metadata of the sets a few reads ahead
+ * prefetched, so that lookups rarely wait for memory.
+ *
+ * Reads are not reordered or grouped by set: every policy and statistic
+ * depends on their order, and a batch must leave the cache exactly as the
+ * same reads through cache_read would.
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "cache.h"
+
+/*
+ * Number of addresses decomposed at once by cache_read_batch.
+ */
+#define CACHE_BATCH_SIZE 256
+
+/*
+ * Number of reads ahead whose set metadata is prefetched.
+ */
+#define CACHE_BATCH_PREFETCH_DISTANCE 8
+
+/*
+ * Kernels used to decompose addresses.
+ */
+#define CACHE_DECOMPOSE_SCALAR 0
+#define CACHE_DECOMPOSE_AVX2   1
+#define CACHE_DECOMPOSE_AVX512 2
+
+/*
+ * Return the fastest kernel the processor supports.
+ */
+int cache_decompose_kernel(void);
+
+/*
+ * Compute the line address, set index and tag of count addresses, with
+ * the given kernel, which must be supported.
+ */
+void cache_decompose_with(cache_t *cache, int kernel, const uint64_t *addresses, size_t count,
+                          uint64_t *lines, uint64_t *indices, uint64_t *tags);
+
+/*
+ * Compute the line address, set index and tag of count addresses, with the
+ * fastest kernel.
+ */
+void cache_decompose(cache_t *cache, const uint64_t *addresses, size_t count,
+                     uint64_t *lines, uint64_t *indices, uint64_t *tags);
+
+/*
+ * Read count addresses in order. The values read are stored in values
+ * unless it is NULL, and program counters are taken from pcs unless it is NULL.
+ */
+void cache_read_batch(cache_t *cache, const uint64_t *addresses, const uint64_t *pcs, size_t count,
+                      uint64_t *values, func_t generate_random_number);
+
+#endif
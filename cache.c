@@ -1,14 +1,25 @@
 #include "cache.h"
+#include "partition.h"
+#include "compress.h"
+#include "dram.h"
+#include "mshr.h"
+#include "pctable.h"
+#include "events.h"
+#include "mrc.h"
+#include "timeseries.h"
+#include "replacement.h"
+#include "fullassoc.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <sys/mman.h>
 
 void print_cache_set(cache_set_t* set, size_t num_lines) {
     printf("first_index: %zu, num_lines: %zu, num_marked: %zu\n", set->first_index, num_lines, set->num_marked);
     for (size_t i = 0; i < num_lines; i++) {
         printf("\t Line %zu: ", i);
-        printf("valid: %d, dirty: %d, marked: %d, tag: %lx, memory: %p\n", set->lines[i].is_valid, set->lines[i].is_dirty, set->lines[i].is_marked, set->lines[i].tag, set->lines[i].block);
+        printf("valid: %d, dirty: %d, marked: %d, tag: %lx\n", set->lines[i].is_valid, set->lines[i].is_dirty, set->lines[i].is_marked, (unsigned long) set->lines[i].tag);
     }
 }
 
@@ -18,7 +29,7 @@ void print_cache_set(cache_set_t* set, size_t num_lines) {
 static void print_cache(cache_t* cache) {
   printf("num_sets: %zx, num_lines: %zx, line_size: %zx, associativity: %zx\n", cache->num_sets, cache->num_lines, cache->line_size, cache->associativity);
   printf("block_offset_mask: %lx, cache_index_mask: %lx, cache_index_shift: %u, tag_mask: %lx, tag_shift: %u\n", cache->block_offset_mask, cache->cache_index_mask, cache->cache_index_shift, cache->tag_mask, cache->tag_shift);
-  printf("policies: %u, memory: %p, lines: %p, sets: %p, access_count: %u, miss_count: %u\n", cache->policies, cache->memory, cache->lines, cache->sets, cache->access_count, cache->miss_count);
+  printf("policies: %u, memory: %p, lines: %p, sets: %p, access_count: %" PRIu64 ", miss_count: %" PRIu64 "\n", cache->policies, cache->memory, cache->lines, cache->sets, cache->access_count, cache->miss_count);
 }
 
 /*
@@ -29,6 +40,9 @@ static void cache_set_init(cache_set_t *cache_set, size_t associativity, cache_l
     cache_set->first_index = first_index;
     cache_set->lru_list = malloc(associativity * sizeof(size_t));
     cache_set->num_marked = 0;
+    cache_set->access_count = 0;
+    cache_set->miss_count = 0;
+    cache_set->eviction_count = 0;
     
     for (int i = 0; i < associativity; i++) {
         cache_set->lines[first_index + i].is_valid = false;
@@ -63,11 +77,38 @@ static uint64_t maskbits(int nbits) {
  */
 cache_t *cache_new(size_t num_bytes, size_t block_size, size_t associativity, uint8_t policies) {
 
+    // Tags only hold 61 bits (see cache_line_t).
+    if (block_size < 8) {
+        return NULL;
+    }
+
     // Create the cache and initialize constant fields.
     cache_t *cache = (cache_t *)malloc(sizeof(cache_t));
     cache->access_count = 0;
     cache->miss_count = 0;
+    cache->cycle_count = 0;
+    cache->writeback_count = 0;
+    cache->writebacks = (uintptr_t *)malloc((associativity + 1) * sizeof(uintptr_t));
+    cache->num_writebacks = 0;
+    cache->access_type = CACHE_ACCESS_LOAD;
+    for (int i = 0; i < CACHE_ACCESS_TYPES; i++) {
+        cache->type_access_count[i] = 0;
+        cache->type_miss_count[i] = 0;
+    }
+    cache->dram = NULL;
+    cache->mshr = NULL;
+    cache->pc_table = NULL;
+    cache->access_pc = 0;
+    cache->regions = NULL;
+    cache->num_regions = 0;
+    cache->events = NULL;
+    cache->mrc = NULL;
+    cache->timeseries = NULL;
+    cache->last_line = NULL;
+    cache->last_line_address = 0;
     cache->policies = policies;
+    cache->checkpoint_mapping = NULL;
+    cache->checkpoint_length = 0;
 
     // Initialize size fields.
     cache->line_size = block_size;
@@ -93,19 +134,38 @@ cache_t *cache_new(size_t num_bytes, size_t block_size, size_t associativity, ui
     // We shift by the number of offset bits and index bits
     // to get the tag bits.
     cache->tag_shift = offset_bits + index_bits;
-    cache->tag_mask = maskbits(sizeof(uintptr_t) - cache->tag_shift) << cache->tag_shift;
+    cache->tag_mask = maskbits(8 * sizeof(uintptr_t) - cache->tag_shift) << cache->tag_shift;
 
-    // Allocate the cache memory
-    cache->memory = malloc(num_bytes);
-    uint8_t *memory = cache->memory;
+    // Allocate the cache memory, unless we only simulate tags.
+    if ((policies & CACHE_NODATA_MASK) == CACHE_NODATAPOLICY) {
+        cache->memory = NULL;
+    } else {
+        cache->memory = malloc(num_bytes);
+    }
 
-    // Initialize cache lines.
+    // Initialize cache lines. Line i holds the block at i * line_size in memory.
     cache->lines = (cache_line_t *)calloc(cache->num_lines, sizeof(cache_line_t));
-    for (size_t i = 0; i < cache->num_lines; i++) {
-        cache->lines[i].block = memory;
-        memory += cache->line_size;
+
+    // OPT needs to know when each line will be used next.
+    cache->next_use = NULL;
+    cache->access_next_use = 0;
+    cache->partition = NULL;
+    cache->compression = NULL;
+    cache->fully_associative = NULL;
+    if ((policies & CACHE_REPLACEMENTPOLICY_MASK) == CACHE_REPLACEMENTPOLICY_OPT) {
+        cache->next_use = (uint64_t *)calloc(cache->num_lines, sizeof(uint64_t));
     }
     
+    // DIP duels LRU against BIP unless told otherwise.
+    cache_duel_init(cache, CACHE_REPLACEMENTPOLICY_LRU, CACHE_REPLACEMENTPOLICY_BIP);
+
+    // Resolve the replacement policy once, rather than on every access.
+    cache->replacement = NULL;
+    cache->replacement_state = NULL;
+    if (cache_replacement_builtin(policies) != NULL) {
+        cache_replacement_install(cache, cache_replacement_builtin(policies));
+    }
+
     // Initialize cache sets.
     cache->sets = (cache_set_t *)calloc(cache->num_sets, sizeof(cache_set_t));
     size_t first_index = 0;
@@ -114,17 +174,66 @@ cache_t *cache_new(size_t num_bytes, size_t block_size, size_t associativity, ui
         first_index += associativity;
     }
 
+    // Large fully associative LRU caches find lines by tag instead of
+    // scanning every way.
+    if (cache->num_sets == 1 && associativity >= CACHE_FULLY_ASSOCIATIVE_MIN_WAYS) {
+        cache_fully_associative_init(cache);
+    }
+
+    // Tracing needs a ring to record events in.
+    if ((policies & CACHE_TRACE_MASK) == CACHE_TRACEPOLICY) {
+        cache_events_init(cache, CACHE_EVENTS_DEFAULT_CAPACITY);
+    }
+
     return cache;
 }
 
 
+/*
+ * Set up set dueling between two replacement policies.
+ */
+void cache_duel_init(cache_t *cache, uint8_t policy_0, uint8_t policy_1) {
+    cache->duel.policies[0] = policy_0 & CACHE_REPLACEMENTPOLICY_MASK;
+    cache->duel.policies[1] = policy_1 & CACHE_REPLACEMENTPOLICY_MASK;
+    cache_duel_init_replacements(cache, cache_replacement_builtin(policy_0), cache_replacement_builtin(policy_1));
+}
+
 /**
  * Frees all memory allocated for a cache.
  */
 void cache_free(cache_t *cache) {
-  free(cache->memory);
+  if (cache->checkpoint_mapping != NULL) {
+    munmap(cache->checkpoint_mapping, cache->checkpoint_length);
+  } else {
+    free(cache->memory);
+  }
 
   free(cache->lines);
+  free(cache->writebacks);
+  free(cache->next_use);
+  free(cache->replacement_state);
+  if (cache->fully_associative != NULL) {
+    cache_fully_associative_free(cache);
+  }
+  if (cache->partition != NULL) {
+    cache_partition_free(cache);
+  }
+  if (cache->compression != NULL) {
+    cache_compression_free(cache);
+  }
+  if (cache->mshr != NULL) {
+    cache_mshr_free(cache);
+  }
+  if (cache->pc_table != NULL) {
+    cache_pc_table_free(cache);
+  }
+  free(cache->regions);
+  if (cache->events != NULL) {
+    cache_events_free(cache);
+  }
+  if (cache->timeseries != NULL) {
+    cache_timeseries_free(cache);
+  }
 
   for (size_t i = 0; i < cache->num_sets; i++) {
     free(cache->sets[i].lru_list);
@@ -148,54 +257,45 @@ bool cache_line_check_validity_and_tag(cache_line_t *cache_line, uintptr_t tag)
   }
 }
 
+_Static_assert(sizeof(cache_line_t) == 8, "line metadata should fit in a 64-bit word");
+
+/*
+ * Return the block of a cache line, or NULL if the cache only simulates tags.
+ */
+uint8_t *cache_line_block(cache_t *cache, cache_line_t *cache_line) {
+  if (cache->memory == NULL) {
+    return NULL;
+  }
+  return cache->memory + (cache_line - cache->lines) * cache->line_size;
+}
+
 /*
- * Return uint64_t integer data from a cache line.
+ * Return uint64_t integer data from a cache block.
  */
-uint64_t cache_line_retrieve_data(cache_line_t *cache_line, size_t offset) {
+uint64_t cache_line_retrieve_data(const uint8_t *block, size_t offset) {
 
   //ALARM across the border
 
   uint64_t data = 0;
   for (int i = 0; i < 8; i++) {
-    data += cache_line->block[offset+i] << (i*8);
+    data += (uint64_t)block[offset+i] << (i*8);
   }
   
   return data;
 }
 
 /*
- * Move the cache lines inside a cache set so the cache line with the
- * given index is tagged as the most recently used one. The least
- * recently used cache line will be the 0'th one in the set, the
- * second least recently used cache line will be next, etc.  Cache
- * lines whose valid bit is 0 will occur before all cache lines whose
- * valid bit is 1.
+ * Retrieve a matching cache line from a set, if one exists, and tell the
+ * replacement policy of the hit.
  */
-static void cache_line_make_mru(cache_t *cache, cache_set_t *cache_set, size_t line_index) {
-    size_t index_of_line_index = -1;
-    for (size_t i = 0; i < cache->associativity; i++) {
-        if (cache_set->lru_list[i] == line_index) {
-            index_of_line_index = i;
-            break;
-        }
-    }
-
-    for (size_t i = index_of_line_index + 1; i < cache->associativity; i++) {
-        cache_set->lru_list[i - 1] = cache_set->lru_list[i];
-    }
-    cache_set->lru_list[cache->associativity - 1] = line_index;
-}
-
-/*
- * Retrieve a matching cache line from a set, if one exists.
- */
-cache_line_t *cache_set_find_matching_line(cache_t *cache, cache_set_t *cache_set, uintptr_t tag) {
+static inline cache_line_t *cache_set_lookup(cache_t *cache, const cache_replacement_t *replacement,
+                                             cache_set_t *cache_set, uintptr_t tag) {
 
   cache_line_t* lines = cache_set->lines + cache_set->first_index;
   for (int i = 0; i < cache->associativity; i++) {
     if (cache_line_check_validity_and_tag(lines + i, tag)){
-      if (cache->policies == CACHE_REPLACEMENTPOLICY_LRU) {
-        cache_line_make_mru(cache, cache_set, i);
+      if (replacement != NULL && replacement->on_hit != NULL) {
+        replacement->on_hit(cache, cache_set, i);
       }
       return lines + i;
     }
@@ -204,75 +304,101 @@ cache_line_t *cache_set_find_matching_line(cache_t *cache, cache_set_t *cache_se
 }
 
 /*
- * Function to choose a random unmarked line from the cache. If all lines are
- * marked, then it unmarks them all first.
+ * Retrieve a matching cache line from a set, if one exists, with the
+ * policy of the cache, or its fully-associative index if it has one.
  */
-size_t choose_unmarked_cache_line(cache_t *cache, cache_set_t *cache_set, func_t generate_random_number) {
-
-  cache_line_t* lines = cache_set->lines + cache_set->first_index;
-
-  //unmark all if all were marked
-  if (cache_set->num_marked == cache->associativity) {
-    for(int i = 0; i < cache->associativity; i++) {
-      lines[i].is_marked = false;
-    }
-    cache_set->num_marked = 0;
-  } 
-
-  //if there is invalid cache, replace it
-  for (int i = 0; i < cache->associativity; i++) {
-    if (lines[i].is_valid == false) {
-      return i;
-    }
+cache_line_t *cache_set_find_matching_line(cache_t *cache, cache_set_t *cache_set, uintptr_t tag) {
+  if (cache->fully_associative != NULL) {
+    return cache_fully_associative_lookup(cache, tag);
   }
+  return cache_set_lookup(cache, cache->replacement, cache_set, tag);
+}
 
-  int select = generate_random_number() % (cache->associativity - cache_set->num_marked);
-  for (int i = 0; i < cache->associativity; i++) {
-    if (select == 0 && lines[i].is_marked == false) {
-      return i;
-    }
-    if (lines[i].is_marked == false) {
-      select --;
-    } 
+/*
+ * Remember the line just read, if reading it again would leave the
+ * replacement state of its set unchanged, as the policy tells.
+ */
+static void cache_remember_line(cache_t *cache, cache_set_t *cache_set, cache_line_t *line, uintptr_t line_address) {
+  const cache_replacement_t *replacement = cache->replacement;
+  bool unchanged;
+  if (cache->fully_associative != NULL) {
+    unchanged = cache_fully_associative_is_mru(cache, line);
+  } else {
+    unchanged = replacement != NULL && replacement->hit_is_stable != NULL
+                && replacement->hit_is_stable(cache, cache_set, line - cache_set->lines - cache_set->first_index);
   }
+  cache->last_line = unchanged ? line : NULL;
+  cache->last_line_address = line_address;
+}
 
-  printf("here");
-
-  //ALARM
-  return 0;
+/*
+ * Find a cache line to use for new data, as the replacement policy chooses,
+ * and tell the policy it is being filled.
+ */
+static inline cache_line_t *cache_set_victim(cache_t *cache, const cache_replacement_t *replacement,
+                                             cache_set_t *cache_set, func_t generate_random_number) {
+  if (replacement == NULL) {
+    return NULL;
+  }
+  size_t index = replacement->choose_victim(cache, cache_set, generate_random_number);
+  if (replacement->on_fill != NULL) {
+    replacement->on_fill(cache, cache_set, index, generate_random_number);
+  }
+  return cache_set->lines + cache_set->first_index + index;
 }
-   
+
 /*
  * Function to find a cache line to use for new data. Uses either a
  * line not being used, or a suitable line to be replaced, based on
  * the cache's replacement policy.
  */
 cache_line_t *find_available_cache_line(cache_t *cache, cache_set_t *cache_set, func_t generate_random_number) {
+  if (cache->fully_associative != NULL) {
+    return cache_fully_associative_victim(cache);
+  }
+  return cache_set_victim(cache, cache->replacement, cache_set, generate_random_number);
+}
 
-  cache_line_t* lines = cache_set->lines + cache_set->first_index;
+/*
+ * Invalidate a line without replacing it.
+ */
+void cache_line_invalidate(cache_t *cache, cache_set_t *cache_set, size_t way) {
+  // The index only handles invalid lines that were never filled.
+  if (cache->fully_associative != NULL) {
+    cache_fully_associative_disable(cache);
+  }
+  cache_set->lines[cache_set->first_index + way].is_valid = false;
+  if (cache->replacement != NULL && cache->replacement->on_invalidate != NULL) {
+    cache->replacement->on_invalidate(cache, cache_set, way);
+  }
+  if (cache->last_line == cache_set->lines + cache_set->first_index + way) {
+    cache->last_line = NULL;
+  }
+}
 
-  switch (cache->policies) {
-    case CACHE_REPLACEMENTPOLICY_LRU : {
-      size_t index = 0;
-      for (int i = (cache -> associativity); i > 0; i--) {
-        index = cache_set->lru_list[i-1];
-        if (!lines[index].is_valid) {
-          cache_line_make_mru(cache, cache_set, index);
-          return lines + index;
-        }
-      }
-      
-      index = cache_set->lru_list[0];
-      cache_line_make_mru(cache, cache_set, index);
-      return lines + index;
+/*
+ * Account for the eviction of a valid line, and write it back if it is
+ * dirty. The line is then filled or invalidated by the caller.
+ */
+void cache_line_evict(cache_t *cache, cache_set_t *cache_set, size_t way) {
+  cache_line_t *line = cache_set->lines + cache_set->first_index + way;
+  size_t set = cache_set - cache->sets;
+  bool tracing = (cache->policies & CACHE_TRACE_MASK) == CACHE_TRACEPOLICY;
+  uintptr_t victim = (uintptr_t) line->tag << cache->tag_shift | set << cache->cache_index_shift;
+
+  cache_set->eviction_count++;
+  if (tracing) {
+    cache_events_record(cache, CACHE_EVENT_EVICT, set, way, victim);
+  }
+  if (line->is_dirty) {
+    cache->writeback_count++;
+    cache->writebacks[cache->num_writebacks++] = victim;
+    if (tracing) {
+      cache_events_record(cache, CACHE_EVENT_WRITEBACK, set, way, victim);
     }
-    case CACHE_REPLACEMENTPOLICY_RANDOMIZED_MARKING: {
-      size_t index = choose_unmarked_cache_line(cache, cache_set, generate_random_number);
-      lines[index].is_marked = true;
-      cache_set->num_marked ++;
-      return lines + index;
+    if (cache->dram != NULL) {
+      dram_access(cache->dram, victim, cache->line_size, true, cache->cycle_count);
     }
-    default: return NULL; // Added to remove warning; remove once function is implemented.
   }
 }
 
@@ -282,12 +408,34 @@ cache_line_t *find_available_cache_line(cache_t *cache, cache_set_t *cache_set,
 static cache_line_t *cache_set_add(cache_t *cache, cache_set_t *cache_set, uintptr_t address, uintptr_t tag, func_t generate_random_number) {
 
     // First locate the cache line to use.
-    cache_line_t *line = find_available_cache_line(cache, cache_set, generate_random_number);
+    cache_line_t *line = cache->fully_associative != NULL
+                         ? cache_fully_associative_victim(cache)
+                         : cache_set_victim(cache, cache->replacement, cache_set, generate_random_number);
+
+    // Write back the line it replaces, if needed.
+    size_t set = cache_set - cache->sets;
+    bool tracing = (cache->policies & CACHE_TRACE_MASK) == CACHE_TRACEPOLICY;
+    if (line->is_valid) {
+        cache_line_evict(cache, cache_set, line - cache_set->lines - cache_set->first_index);
+    }
 
     // Now set it up.
     line->tag = tag;
     line->is_valid = true;
-    memcpy(line->block, (void *)(address & ~cache->block_offset_mask), cache->line_size);
+    line->is_dirty = false;
+    if (cache->fully_associative != NULL) {
+        cache_fully_associative_fill(cache, line);
+    }
+    uint8_t *block = cache_line_block(cache, line);
+    if (block != NULL) {
+        memcpy(block, (void *)(address & ~cache->block_offset_mask), cache->line_size);
+    }
+    if (tracing) {
+        cache_events_record(cache, CACHE_EVENT_FILL, set, line - cache_set->lines - cache_set->first_index, address);
+    }
+    if (cache->compression != NULL) {
+        cache_compression_fill(cache, cache_set, line);
+    }
 
     // And return it.
     return line;
@@ -298,19 +446,116 @@ static cache_line_t *cache_set_add(cache_t *cache, cache_set_t *cache_set, uintp
  */
 uint64_t cache_read(cache_t *cache, uintptr_t address, func_t generate_random_number) {
   
-  size_t offset = cache->block_offset_mask & address;
-  int index     = (cache->cache_index_mask & address) >> cache->cache_index_shift;
+  size_t index  = (cache->cache_index_mask & address) >> cache->cache_index_shift;
   uintptr_t tag = (cache->tag_mask & address) >> cache->tag_shift;
 
+  return cache_read_decomposed(cache, address, index, tag, generate_random_number);
+}
+
+/*
+ * Read a single uint64_t integer from the cache, given the set index and
+ * tag of its address.
+ */
+uint64_t cache_read_decomposed(cache_t *cache, uintptr_t address, size_t index, uintptr_t tag,
+                               func_t generate_random_number) {
+
+  size_t offset = cache->block_offset_mask & address;
+
+  if (cache->timeseries != NULL && cache->access_count == cache->timeseries->next_snapshot) {
+    cache_timeseries_snapshot(cache);
+  }
+  cache->num_writebacks = 0;
   cache->access_count ++;
-  cache_line_t* line = cache_set_find_matching_line(cache, cache->sets + index, tag);
+  cache->type_access_count[cache->access_type] ++;
+  cache->cycle_count ++;
+  if (cache->mrc != NULL) {
+    mrc_access(cache->mrc, address);
+  }
+  if (cache->mshr != NULL) {
+    cache_mshr_advance(cache, cache->cycle_count);
+  }
+  bool partitioned = (cache->policies & CACHE_PARTITION_MASK) == CACHE_PARTITIONPOLICY;
+  if (partitioned) {
+    cache_partition_access(cache, index, tag);
+  }
+  if (cache->pc_table != NULL) {
+    cache_pc_table_access(cache);
+  }
+
+  // Reads of the last line skip the search when they would not change the
+  // replacement state, as when walking through a block.
+  uintptr_t line_address = address & ~cache->block_offset_mask;
+  cache->sets[index].access_count ++;
+  cache_line_t* line;
+  if (line_address == cache->last_line_address && cache->last_line != NULL) {
+    line = cache->last_line;
+  } else {
+    line = cache->fully_associative != NULL
+           ? cache_fully_associative_lookup(cache, tag)
+           : cache_set_lookup(cache, cache->replacement, cache->sets + index, tag);
+    if (line != NULL) {
+      cache_remember_line(cache, cache->sets + index, line, line_address);
+    }
+  }
   if (line != NULL) {
-    return cache_line_retrieve_data(line, offset);
+    if ((cache->policies & CACHE_TRACE_MASK) == CACHE_TRACEPOLICY) {
+      cache_events_record(cache, CACHE_EVENT_HIT, index, line - cache->sets[index].lines - cache->sets[index].first_index, address);
+    }
+    if (cache->mshr != NULL) {
+      cache_mshr_hit(cache, line_address);
+    }
+    if (cache->access_type >= CACHE_ACCESS_STORE && (cache->policies & CACHE_WRITEPOLICY_WRITEBACK)) {
+      line->is_dirty = true;
+    }
+    return cache->memory != NULL ? cache_line_retrieve_data(cache_line_block(cache, line), offset) : 0;
   } else {
     cache->miss_count ++;
-    cache_set_add(cache, cache->sets + index, address, tag, generate_random_number);
-    return *(uint64_t*)address;
+    cache->type_miss_count[cache->access_type] ++;
+    cache->sets[index].miss_count ++;
+    if ((cache->policies & CACHE_TRACE_MASK) == CACHE_TRACEPOLICY) {
+      cache_events_record(cache, CACHE_EVENT_MISS, index, CACHE_EVENT_NO_WAY, address);
+    }
+    if (partitioned) {
+      cache_partition_miss(cache);
+    }
+    if (cache->pc_table != NULL) {
+      cache_pc_table_miss(cache);
+    }
+    // Writes that miss a no-allocate cache go to the level below, without a fill.
+    if (cache->access_type >= CACHE_ACCESS_STORE && (cache->policies & CACHE_WRITEPOLICY_WRITENOALLOCATE)) {
+      if (cache->dram != NULL) {
+        dram_access(cache->dram, line_address, cache->line_size, true, cache->cycle_count);
+      }
+      return cache->memory != NULL ? *(uint64_t*)address : 0;
+    }
+    // Writebacks bring the whole line, so there is nothing to fetch.
+    if (cache->access_type == CACHE_ACCESS_WRITEBACK) {
+    } else if (cache->mshr != NULL) {
+      cache_mshr_miss(cache, line_address);
+    } else if (cache->dram != NULL) {
+      cache->cycle_count = dram_access(cache->dram, line_address, cache->line_size,
+                                       false, cache->cycle_count);
+    }
+    line = cache_set_add(cache, cache->sets + index, address, tag, generate_random_number);
+    cache_remember_line(cache, cache->sets + index, line, line_address);
+    if (cache->access_type >= CACHE_ACCESS_STORE && (cache->policies & CACHE_WRITEPOLICY_WRITEBACK)) {
+      line->is_dirty = true;
+    }
+    return cache->memory != NULL ? *(uint64_t*)address : 0;
+  }
+}
+
+/*
+ * Access a single integer of the cache, with the given type of access.
+ */
+uint64_t cache_access(cache_t *cache, uintptr_t address, int type, func_t generate_random_number) {
+  if (type < 0 || type >= CACHE_ACCESS_TYPES) {
+    return 0;
   }
+  cache->access_type = type;
+  uint64_t value = cache_read(cache, address, generate_random_number);
+  cache->access_type = CACHE_ACCESS_LOAD;
+  return value;
 }
 
 /*
@@ -323,7 +568,7 @@ void cache_write(cache_t *cache, uintptr_t address, uint64_t value, func_t gener
 /*
  * Return the number of cache misses since the cache was created.
  */
-uint32_t cache_miss_count(cache_t *cache) {
+uint64_t cache_miss_count(cache_t *cache) {
 
     return cache->miss_count;
 }
@@ -331,8 +576,16 @@ uint32_t cache_miss_count(cache_t *cache) {
 /*
  * Return the number of cache accesses since the cache was created.
  */
-uint32_t cache_access_count(cache_t *cache) {
+uint64_t cache_access_count(cache_t *cache) {
 
     return cache->access_count;
 }
 
+/*
+ * Return the number of cycles spent on accesses since the cache was created.
+ */
+uint64_t cache_cycle_count(cache_t *cache) {
+
+    return cache->cycle_count;
+}
+
@@ -25,7 +25,22 @@
 #define CACHE_REPLACEMENTPOLICY_RANDOM             0b00000000
 #define CACHE_REPLACEMENTPOLICY_LRU                0b00000100
 #define CACHE_REPLACEMENTPOLICY_MRU                0b00001000
+#define CACHE_REPLACEMENTPOLICY_OPT                0b00001100
 #define CACHE_REPLACEMENTPOLICY_RANDOMIZED_MARKING 0b00010000
+#define CACHE_REPLACEMENTPOLICY_LIP                0b00010100
+#define CACHE_REPLACEMENTPOLICY_BIP                0b00011000
+#define CACHE_REPLACEMENTPOLICY_DIP                0b00011100
+
+/*
+ * LIP inserts new lines in the LRU position instead of the MRU one. BIP does
+ * the same, except that one insertion in CACHE_BIP_EPSILON goes to the MRU
+ * position. DIP chooses between two policies (LRU and BIP by default) using
+ * set dueling: a few leader sets always use one of the two policies, and the
+ * other sets follow whichever leaders miss less.
+ */
+#define CACHE_BIP_EPSILON      32
+#define CACHE_DUEL_LEADER_SETS 32
+#define CACHE_DUEL_PSEL_BITS   10
 
 /*
  * Write policies: We use two bits to indicate the write policy.
@@ -41,30 +56,57 @@
 #define CACHE_WRITEPOLICY_WRITENOALLOCATE    0b00000010
 
 /*
- * Other policies: Do we want to use cache tracing.
+ * Other policies: Do we want to use cache tracing. Events are recorded in
+ * a ring buffer (see events.h).
  */
 #define CACHE_TRACE_MASK  0b00100000
 #define CACHE_TRACEPOLICY 0b00100000
 
 /*
- * Structure used to store a single cache line.
+ * Do we only simulate tags, without copying blocks from memory. This is
+ * needed to replay traces whose addresses are not valid in this process.
+ */
+#define CACHE_NODATA_MASK  0b01000000
+#define CACHE_NODATAPOLICY 0b01000000
+
+/*
+ * Is the cache way-partitioned between tenants. This is set by
+ * cache_partition_init (see partition.h).
+ */
+#define CACHE_PARTITION_MASK  0b10000000
+#define CACHE_PARTITIONPOLICY 0b10000000
+
+/*
+ * Types of accesses. cache_read performs loads; cache_access performs any
+ * type. Stores, and writebacks of dirty lines from the level above, are
+ * writes: they dirty the line they access in write-back caches, and do not
+ * fill a line when they miss in write-no-allocate caches.
+ */
+#define CACHE_ACCESS_IFETCH    0
+#define CACHE_ACCESS_LOAD      1
+#define CACHE_ACCESS_STORE     2
+#define CACHE_ACCESS_WRITEBACK 3
+#define CACHE_ACCESS_TYPES     4
+
+/*
+ * Structure used to store a single cache line. The flags and the tag are
+ * packed into a single 64-bit word, so tags hold at most 61 bits, which is
+ * enough for lines of 8 bytes or more. The block of a line is not stored:
+ * it is at the same index in cache->memory (see cache_line_block).
  */
 typedef struct cache_line_s {
 
     /* The valid bit. */
-    bool is_valid;
+    bool is_valid : 1;
 
     /* The dirty bit. */
-    bool is_dirty;
+    bool is_dirty : 1;
 
     /* The marked bit (for randomized marking) */
-    bool is_marked;
+    bool is_marked : 1;
     
     /* The tag. */
-    uintptr_t tag;
-  
-    /* The cache block as bytes */
-    uint8_t *block;
+    uintptr_t tag : 61;
   
 } cache_line_t;
 
@@ -77,8 +119,24 @@ typedef struct cache_set_s {
     size_t first_index;
     size_t *lru_list;
     size_t num_marked;
+
+    /* Statistics about set usage. */
+    uint64_t access_count, miss_count, eviction_count;
 } cache_set_t;
 
+/*
+ * Structure used for set dueling between two replacement policies. Misses in
+ * leader sets of policy 0 increment psel, misses in leader sets of policy 1
+ * decrement it; follower sets use policy 1 when psel is in its upper half.
+ */
+typedef struct cache_duel_s {
+    uint8_t policies[2];
+    const struct cache_replacement_s *members[2];
+    size_t leader_stride;
+    unsigned int psel;
+    unsigned int psel_max;
+} cache_duel_t;
+
 /*
  * Structure used to store a cache.
  */
@@ -121,9 +179,79 @@ typedef struct cache_s {
   
     /* Array of sets, each of which refers to its lines */
     cache_set_t *sets;
+
+    /* For OPT: time of the next use of each line, and of the current access. */
+    uint64_t *next_use;
+    uint64_t access_next_use;
+
+    /* For DIP: the two dueling policies and their selector. */
+    cache_duel_t duel;
+
+    /* Replacement policy, and its state for every set (see replacement.h). */
+    const struct cache_replacement_s *replacement;
+    uint8_t *replacement_state;
+
+    /* Tenants and their ways, when the cache is partitioned. */
+    struct cache_partition_s *partition;
+
+    /* Compressed sizes of the lines, for compressed caches (see compress.h). */
+    struct cache_compression_s *compression;
+
+    /* Index of the lines by tag, for large fully associative LRU caches
+     * (see fullassoc.h). */
+    struct cache_fully_associative_s *fully_associative;
   
     /* Statistics about cache usage. */
-    uint32_t access_count, miss_count;
+    uint64_t access_count, miss_count;
+
+    /* Dirty lines evicted, and the addresses of those the current access
+     * evicted, of which there can be several in a compressed cache. */
+    uint64_t writeback_count;
+    uintptr_t *writebacks;
+    size_t num_writebacks;
+
+    /* Type of the current access, and statistics per type. */
+    uint8_t access_type;
+    uint64_t type_access_count[CACHE_ACCESS_TYPES];
+    uint64_t type_miss_count[CACHE_ACCESS_TYPES];
+
+    /* Cycles spent on accesses: one per access, plus the time to fill misses. */
+    uint64_t cycle_count;
+
+    /* Memory behind the cache, or NULL if misses are free (see dram.h). */
+    struct dram_s *dram;
+
+    /* Outstanding misses, for non-blocking caches (see mshr.h). */
+    struct cache_mshr_s *mshr;
+
+    /* Program counter of the current access, 0 outside of accesses made on
+     * behalf of an instruction, and per-PC statistics (see pctable.h). */
+    uintptr_t access_pc;
+    struct cache_pc_table_s *pc_table;
+
+    /* Array regions registered for padding advice (see heatmap.h). */
+    struct cache_region_s *regions;
+    size_t num_regions;
+
+    /* Ring buffer of traced events, with CACHE_TRACEPOLICY (see events.h). */
+    struct cache_events_s *events;
+
+    /* Miss ratio curve estimator fed with every access, or NULL (see mrc.h). */
+    struct mrc_s *mrc;
+
+    /* Snapshots of the statistics every few accesses, or NULL (see timeseries.h). */
+    struct cache_timeseries_s *timeseries;
+
+    /* Last line read, if reading it again would not change the replacement
+     * state, and the address of its block. Reads of that block skip the
+     * search of the set; setting last_line to NULL forces the next read
+     * through the full lookup. */
+    cache_line_t *last_line;
+    uintptr_t last_line_address;
+
+    /* Checkpoint file mapped by cache_restore, or NULL. */
+    void *checkpoint_mapping;
+    size_t checkpoint_length;
 } cache_t;
 
 typedef int (*func_t)(void);
@@ -132,7 +260,8 @@ typedef int (*func_t)(void);
 
 /*
  * Create a new cache that contains a total of num_bytes line, each of which is block_size
- * bytes long, with the given associativity and policies.
+ * bytes long, with the given associativity and policies. Lines must hold 8 bytes or
+ * more, for their tags to fit in 61 bits; returns NULL otherwise.
  */
 cache_t *cache_new(size_t num_bytes, size_t block_size, size_t associativity, uint8_t policies);
 
@@ -146,28 +275,51 @@ void cache_free(cache_t *cache);
  */
 uint64_t cache_read(cache_t *cache, uintptr_t address, func_t generate_random_number);
 
+/*
+ * Access a single long integer of the cache, with the given type of
+ * access. Returns the value read, or 0 for tag-only caches. Accesses of an
+ * unknown type are ignored, and read 0.
+ */
+uint64_t cache_access(cache_t *cache, uintptr_t address, int type, func_t generate_random_number);
+
 /*
  * Write a single long integer to memory and/or the cache.
  */
 void cache_write(cache_t *cache, uintptr_t address, uint64_t value, func_t generate_random_number);
 
+/*
+ * Make a cache created with CACHE_REPLACEMENTPOLICY_DIP duel between the two
+ * given replacement policies instead of LRU and BIP.
+ */
+void cache_duel_init(cache_t *cache, uint8_t policy_0, uint8_t policy_1);
+
 /*
  * Return the number of cache misses since the cache was created.
  */
-uint32_t cache_miss_count(cache_t *cache);
+uint64_t cache_miss_count(cache_t *cache);
 
 /*
  * Return the number of cache accesses since the cache was created.
  */
-uint32_t cache_access_count(cache_t *cache);
+uint64_t cache_access_count(cache_t *cache);
+
+/*
+ * Return the number of cycles spent on accesses since the cache was created.
+ */
+uint64_t cache_cycle_count(cache_t *cache);
 
 /*
  *  Helpers
  */
 bool cache_line_check_validity_and_tag(cache_line_t *cache_line, uintptr_t tag);
-uint64_t cache_line_retrieve_data(cache_line_t *cache_line, size_t offset);
+uint8_t *cache_line_block(cache_t *cache, cache_line_t *cache_line);
+uint64_t cache_line_retrieve_data(const uint8_t *block, size_t offset);
 cache_line_t *cache_set_find_matching_line(cache_t *cache, cache_set_t *cache_set, uintptr_t tag);
 size_t choose_unmarked_cache_line(cache_t *cache, cache_set_t *cache_set, func_t generate_random_number);
 cache_line_t *find_available_cache_line(cache_t *cache, cache_set_t *cache_set, func_t generate_random_number);
+void cache_line_invalidate(cache_t *cache, cache_set_t *cache_set, size_t way);
+void cache_line_evict(cache_t *cache, cache_set_t *cache_set, size_t way);
+uint64_t cache_read_decomposed(cache_t *cache, uintptr_t address, size_t index, uintptr_t tag,
+                               func_t generate_random_number);
 
 #endif
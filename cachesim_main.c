@@ -0,0 +1,43 @@
+#include "cache.h"
+#include "hierarchy.h"
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Run the simulation a configuration file describes (see config.h), and
+ * write its statistics where the file says, or print them.
+ *
+ * Usage: cachesim CONFIG
+ */
+
+int main(int argc, char **argv) {
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s CONFIG\n", argv[0]);
+        return 1;
+    }
+
+    cache_config_t config;
+    if (cache_config_load(&config, argv[1]) != 0) {
+        fprintf(stderr, "%s\n", config.error);
+        return 1;
+    }
+    cache_hierarchy_t *hierarchy = cache_config_build(&config);
+    if (hierarchy == NULL) {
+        fprintf(stderr, "%s\n", config.error);
+        return 1;
+    }
+
+    if (cache_config_run(&config, hierarchy) != 0 || cache_config_write_outputs(&config, hierarchy) != 0) {
+        fprintf(stderr, "%s\n", config.error);
+        cache_hierarchy_free(hierarchy);
+        return 1;
+    }
+    if (config.json[0] == '\0' && config.csv[0] == '\0') {
+        cache_hierarchy_print_stats(stdout, hierarchy);
+    }
+
+    cache_hierarchy_free(hierarchy);
+    return 0;
+}
@@ -0,0 +1,322 @@
+#include "checkpoint.h"
+#include "fullassoc.h"
+#include "replacement.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Round value up to the next multiple of the page size.
+ */
+static size_t page_align(size_t value) {
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    return (value + page_size - 1) / page_size * page_size;
+}
+
+/*
+ * Offsets of the different regions of a checkpoint file.
+ */
+typedef struct checkpoint_layout_s {
+    size_t tags_offset;
+    size_t set_stats_offset;
+    size_t next_use_offset;
+    size_t lru_offset;
+    size_t marked_offset;
+    size_t flags_offset;
+    size_t state_offset;
+    size_t memory_offset;
+    size_t length;
+} checkpoint_layout_t;
+
+static checkpoint_layout_t checkpoint_layout(size_t num_lines, size_t num_sets, size_t line_size, bool has_memory,
+                                             bool has_next_use, size_t state_size) {
+    checkpoint_layout_t layout;
+    layout.tags_offset      = sizeof(cache_checkpoint_header_t);
+    layout.set_stats_offset = layout.tags_offset + num_lines * sizeof(uint64_t);
+    layout.next_use_offset  = layout.set_stats_offset + num_sets * 3 * sizeof(uint64_t);
+    layout.lru_offset       = layout.next_use_offset + (has_next_use ? num_lines * sizeof(uint64_t) : 0);
+    layout.marked_offset    = layout.lru_offset + num_lines * sizeof(uint32_t);
+    layout.flags_offset     = layout.marked_offset + num_sets * sizeof(uint32_t);
+    layout.state_offset     = layout.flags_offset + num_lines;
+    if (has_memory) {
+        layout.memory_offset = page_align(layout.state_offset + num_sets * state_size);
+        layout.length        = layout.memory_offset + num_lines * line_size;
+    } else {
+        layout.memory_offset = 0;
+        layout.length        = layout.state_offset + num_sets * state_size;
+    }
+    return layout;
+}
+
+/*
+ * Copy the name of a replacement policy into a header field, and return
+ * whether it fit. No policy is saved as an empty name.
+ */
+static bool checkpoint_name(char *dest, const cache_replacement_t *replacement) {
+    const char *name = replacement != NULL ? replacement->name : "";
+    return snprintf(dest, CACHE_CHECKPOINT_NAME_SIZE, "%s", name) < CACHE_CHECKPOINT_NAME_SIZE;
+}
+
+/*
+ * Find a replacement policy saved by checkpoint_name. Returns false if the
+ * name is unknown.
+ */
+static bool checkpoint_find(const char *name, const cache_replacement_t **replacement) {
+    *replacement = name[0] != '\0' ? cache_replacement_find(name) : NULL;
+    return name[0] == '\0' || *replacement != NULL;
+}
+
+/*
+ * Write the full state of a cache to the file at path.
+ */
+int cache_checkpoint(cache_t *cache, const char *path) {
+
+    size_t state_size = cache->replacement != NULL ? cache->replacement->state_size : 0;
+    checkpoint_layout_t layout = checkpoint_layout(cache->num_lines, cache->num_sets, cache->line_size,
+                                                   cache->memory != NULL, cache->next_use != NULL, state_size);
+    char names[3][CACHE_CHECKPOINT_NAME_SIZE];
+    if (!checkpoint_name(names[0], cache->replacement) || !checkpoint_name(names[1], cache->duel.members[0])
+        || !checkpoint_name(names[2], cache->duel.members[1])) {
+        return -1;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, layout.length) != 0) {
+        close(fd);
+        return -1;
+    }
+    uint8_t *file = mmap(NULL, layout.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        return -1;
+    }
+
+    cache_checkpoint_header_t *header = (cache_checkpoint_header_t *)file;
+    header->magic         = CACHE_CHECKPOINT_MAGIC;
+    header->version       = CACHE_CHECKPOINT_VERSION;
+    header->policies      = cache->policies & ~CACHE_PARTITION_MASK;
+    header->num_lines     = cache->num_lines;
+    header->line_size     = cache->line_size;
+    header->associativity = cache->associativity;
+    header->access_count  = cache->access_count;
+    header->miss_count    = cache->miss_count;
+    header->cycle_count   = cache->cycle_count;
+    header->writeback_count = cache->writeback_count;
+    memcpy(header->type_access_count, cache->type_access_count, sizeof(header->type_access_count));
+    memcpy(header->type_miss_count, cache->type_miss_count, sizeof(header->type_miss_count));
+    header->duel_psel     = cache->duel.psel;
+    header->duel_policies[0] = cache->duel.policies[0];
+    header->duel_policies[1] = cache->duel.policies[1];
+    memcpy(header->replacement, names[0], CACHE_CHECKPOINT_NAME_SIZE);
+    memcpy(header->duel_members[0], names[1], CACHE_CHECKPOINT_NAME_SIZE);
+    memcpy(header->duel_members[1], names[2], CACHE_CHECKPOINT_NAME_SIZE);
+    header->replacement_state_size = state_size;
+    header->has_next_use  = cache->next_use != NULL;
+    header->memory_offset = layout.memory_offset;
+
+    uint64_t *tags   = (uint64_t *)(file + layout.tags_offset);
+    uint8_t  *flags  = file + layout.flags_offset;
+    for (size_t i = 0; i < cache->num_lines; i++) {
+        cache_line_t *line = cache->lines + i;
+        tags[i]  = line->tag;
+        flags[i] = (line->is_valid  ? CACHE_CHECKPOINT_LINE_VALID  : 0)
+                 | (line->is_dirty  ? CACHE_CHECKPOINT_LINE_DIRTY  : 0)
+                 | (line->is_marked ? CACHE_CHECKPOINT_LINE_MARKED : 0);
+    }
+
+    uint32_t *lru    = (uint32_t *)(file + layout.lru_offset);
+    uint32_t *marked = (uint32_t *)(file + layout.marked_offset);
+    uint64_t *set_stats = (uint64_t *)(file + layout.set_stats_offset);
+    if (cache->fully_associative != NULL) {
+        cache_fully_associative_sync(cache);
+    }
+    for (size_t i = 0; i < cache->num_sets; i++) {
+        cache_set_t *set = cache->sets + i;
+        for (size_t j = 0; j < cache->associativity; j++) {
+            lru[i * cache->associativity + j] = set->lru_list[j];
+        }
+        marked[i] = set->num_marked;
+        set_stats[i * 3]     = set->access_count;
+        set_stats[i * 3 + 1] = set->miss_count;
+        set_stats[i * 3 + 2] = set->eviction_count;
+    }
+    if (cache->next_use != NULL) {
+        memcpy(file + layout.next_use_offset, cache->next_use, cache->num_lines * sizeof(uint64_t));
+    }
+    if (state_size > 0) {
+        memcpy(file + layout.state_offset, cache->replacement_state, cache->num_sets * state_size);
+    }
+
+    if (cache->memory != NULL) {
+        memcpy(file + layout.memory_offset, cache->memory, cache->num_lines * cache->line_size);
+    }
+
+    int result = msync(file, layout.length, MS_SYNC);
+    munmap(file, layout.length);
+    return result == 0 ? 0 : -1;
+}
+
+static bool checkpoint_power_of_two(uint64_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+/*
+ * Check that a header describes a cache that cache_new can build, before
+ * trusting any of its sizes. A line takes more than one byte of the file,
+ * which bounds the number of lines.
+ */
+static bool checkpoint_check_header(const cache_checkpoint_header_t *header, size_t length) {
+    if (header->magic != CACHE_CHECKPOINT_MAGIC || header->version != CACHE_CHECKPOINT_VERSION
+        || header->policies > UINT8_MAX) {
+        return false;
+    }
+    if (!checkpoint_power_of_two(header->line_size) || header->line_size < 8
+        || !checkpoint_power_of_two(header->associativity) || header->num_lines > length
+        || header->num_lines % header->associativity != 0
+        || !checkpoint_power_of_two(header->num_lines / header->associativity)
+        || header->line_size > SIZE_MAX / header->num_lines || header->replacement_state_size > length) {
+        return false;
+    }
+    return memchr(header->replacement, '\0', CACHE_CHECKPOINT_NAME_SIZE) != NULL
+        && memchr(header->duel_members[0], '\0', CACHE_CHECKPOINT_NAME_SIZE) != NULL
+        && memchr(header->duel_members[1], '\0', CACHE_CHECKPOINT_NAME_SIZE) != NULL;
+}
+
+/*
+ * Check that every lru_list entry is a way, and that no set has more
+ * marked lines than ways.
+ */
+static bool checkpoint_check_sets(const uint8_t *file, const checkpoint_layout_t *layout, size_t num_sets,
+                                  size_t associativity) {
+    const uint32_t *lru    = (const uint32_t *)(file + layout->lru_offset);
+    const uint32_t *marked = (const uint32_t *)(file + layout->marked_offset);
+    for (size_t i = 0; i < num_sets * associativity; i++) {
+        if (lru[i] >= associativity) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < num_sets; i++) {
+        if (marked[i] > associativity) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Create a new cache from a checkpoint written by cache_checkpoint.
+ */
+cache_t *cache_restore(const char *path) {
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(cache_checkpoint_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    size_t length = st.st_size;
+    uint8_t *file = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        return NULL;
+    }
+
+    cache_checkpoint_header_t *header = (cache_checkpoint_header_t *)file;
+    if (!checkpoint_check_header(header, length)) {
+        munmap(file, length);
+        return NULL;
+    }
+    size_t num_sets = header->num_lines / header->associativity;
+    checkpoint_layout_t layout = checkpoint_layout(header->num_lines, num_sets, header->line_size,
+                                                   header->memory_offset != 0, header->has_next_use,
+                                                   header->replacement_state_size);
+    const cache_replacement_t *replacement, *members[2];
+    if (header->memory_offset != layout.memory_offset || length < layout.length
+        || !checkpoint_check_sets(file, &layout, num_sets, header->associativity)
+        || !checkpoint_find(header->replacement, &replacement)
+        || !checkpoint_find(header->duel_members[0], &members[0])
+        || !checkpoint_find(header->duel_members[1], &members[1])
+        || header->replacement_state_size != (replacement != NULL ? replacement->state_size : 0)) {
+        munmap(file, length);
+        return NULL;
+    }
+
+    cache_t *cache = cache_new(header->num_lines * header->line_size, header->line_size,
+                               header->associativity, header->policies);
+    if (replacement != cache->replacement && cache_replacement_install(cache, replacement) != 0) {
+        cache_free(cache);
+        munmap(file, length);
+        return NULL;
+    }
+    cache->access_count = header->access_count;
+    cache->miss_count   = header->miss_count;
+    cache->cycle_count  = header->cycle_count;
+    cache->writeback_count = header->writeback_count;
+    memcpy(cache->type_access_count, header->type_access_count, sizeof(cache->type_access_count));
+    memcpy(cache->type_miss_count, header->type_miss_count, sizeof(cache->type_miss_count));
+    cache_duel_init(cache, header->duel_policies[0], header->duel_policies[1]);
+    cache_duel_init_replacements(cache, members[0], members[1]);
+    cache->duel.psel    = header->duel_psel;
+    if (header->replacement_state_size > 0) {
+        memcpy(cache->replacement_state, file + layout.state_offset, num_sets * header->replacement_state_size);
+    }
+    if (header->has_next_use) {
+        if (cache->next_use == NULL) {
+            cache->next_use = (uint64_t *)malloc(cache->num_lines * sizeof(uint64_t));
+        }
+        memcpy(cache->next_use, file + layout.next_use_offset, cache->num_lines * sizeof(uint64_t));
+    }
+
+    // The cache memory is used in place: pages are only copied once the
+    // restored cache writes to them.
+    if (cache->memory != NULL && layout.memory_offset != 0) {
+        free(cache->memory);
+        cache->memory = file + layout.memory_offset;
+        cache->checkpoint_mapping = file;
+        cache->checkpoint_length = length;
+    }
+
+    uint64_t *tags  = (uint64_t *)(file + layout.tags_offset);
+    uint8_t  *flags = file + layout.flags_offset;
+    for (size_t i = 0; i < cache->num_lines; i++) {
+        cache_line_t *line = cache->lines + i;
+        line->tag       = tags[i];
+        line->is_valid  = (flags[i] & CACHE_CHECKPOINT_LINE_VALID) != 0;
+        line->is_dirty  = (flags[i] & CACHE_CHECKPOINT_LINE_DIRTY) != 0;
+        line->is_marked = (flags[i] & CACHE_CHECKPOINT_LINE_MARKED) != 0;
+    }
+
+    uint32_t *lru    = (uint32_t *)(file + layout.lru_offset);
+    uint32_t *marked = (uint32_t *)(file + layout.marked_offset);
+    uint64_t *set_stats = (uint64_t *)(file + layout.set_stats_offset);
+    for (size_t i = 0; i < cache->num_sets; i++) {
+        cache_set_t *set = cache->sets + i;
+        for (size_t j = 0; j < cache->associativity; j++) {
+            set->lru_list[j] = lru[i * cache->associativity + j];
+        }
+        set->num_marked = marked[i];
+        set->access_count   = set_stats[i * 3];
+        set->miss_count     = set_stats[i * 3 + 1];
+        set->eviction_count = set_stats[i * 3 + 2];
+    }
+    if (cache->fully_associative != NULL) {
+        cache_fully_associative_free(cache);
+        cache_fully_associative_init(cache);
+    }
+
+    if (cache->checkpoint_mapping == NULL) {
+        munmap(file, length);
+    }
+    return cache;
+}
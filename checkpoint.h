@@ -0,0 +1,87 @@
+/*
+ * checkpoint.h
+ *
+ * Saving the full state of a cache to a file, and restoring it later.
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "cache.h"
+
+/*
+ * Every checkpoint file starts with this magic number and version.
+ */
+#define CACHE_CHECKPOINT_MAGIC   0x504b434548434143ULL /* "CACHECKP" */
+#define CACHE_CHECKPOINT_VERSION 5
+
+/*
+ * Bits used in the per-line flags byte of a checkpoint.
+ */
+#define CACHE_CHECKPOINT_LINE_VALID  0b00000001
+#define CACHE_CHECKPOINT_LINE_DIRTY  0b00000010
+#define CACHE_CHECKPOINT_LINE_MARKED 0b00000100
+
+/*
+ * Room for the name of a replacement policy, terminator included.
+ */
+#define CACHE_CHECKPOINT_NAME_SIZE 32
+
+/*
+ * Header at the start of a checkpoint file. It is followed by:
+ *   - the tag of every line (uint64_t[num_lines])
+ *   - the access, miss and eviction counts of every set (uint64_t[num_sets * 3])
+ *   - for OPT, the next use of every line (uint64_t[num_lines])
+ *   - the lru_list of every set (uint32_t[num_sets * associativity])
+ *   - the number of marked lines of every set (uint32_t[num_sets])
+ *   - the flags of every line (uint8_t[num_lines])
+ *   - the state of the replacement policy (uint8_t[num_sets * replacement_state_size])
+ *   - the cache memory, starting on a page boundary so it can be mapped directly.
+ */
+typedef struct cache_checkpoint_header_s {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t policies;
+
+    uint64_t num_lines;
+    uint64_t line_size;
+    uint64_t associativity;
+
+    uint64_t access_count;
+    uint64_t miss_count;
+    uint64_t cycle_count;
+    uint64_t writeback_count;
+    uint64_t type_access_count[CACHE_ACCESS_TYPES];
+    uint64_t type_miss_count[CACHE_ACCESS_TYPES];
+
+    /* Replacement policy, found again by name (see replacement.h), and the
+     * bytes of state it keeps per set. */
+    char replacement[CACHE_CHECKPOINT_NAME_SIZE];
+    uint64_t replacement_state_size;
+    uint64_t has_next_use;
+
+    /* Set dueling state. */
+    uint32_t duel_psel;
+    uint8_t duel_policies[2];
+    char duel_members[2][CACHE_CHECKPOINT_NAME_SIZE];
+
+    /* Offset of the cache memory in the file, 0 if no memory was saved. */
+    uint64_t memory_offset;
+} cache_checkpoint_header_t;
+
+/*
+ * Write the full state of a cache to the file at path. Returns 0 on
+ * success and -1 on failure. Partitioning and compression state are not
+ * saved: call cache_partition_init again on the restored cache. Registered
+ * replacement policies are saved by name, so they must be registered again
+ * before restoring.
+ */
+int cache_checkpoint(cache_t *cache, const char *path);
+
+/*
+ * Create a new cache from a checkpoint written by cache_checkpoint. The
+ * cache memory is mapped copy-on-write from the file, so many caches can
+ * be restored from the same checkpoint cheaply. Returns NULL on failure.
+ */
+cache_t *cache_restore(const char *path);
+
+#endif
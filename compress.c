@@ -0,0 +1,268 @@
+#include "compress.h"
+#include "fullassoc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * Read a little-endian signed integer of size bytes.
+ */
+static int64_t read_signed(const uint8_t *bytes, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= (uint64_t)bytes[i] << (8 * i);
+    }
+    int shift = 64 - 8 * size;
+    return (int64_t)(value << shift) >> shift;
+}
+
+/*
+ * Determine whether value fits in a signed integer of size bytes.
+ */
+static bool fits_in(int64_t value, size_t size) {
+    if (size >= 8) {
+        return true;
+    }
+    int64_t limit = 1LL << (8 * size - 1);
+    return value >= -limit && value < limit;
+}
+
+/*
+ * Return the size of a block compressed with Base-Delta-Immediate: values
+ * of base_size bytes are stored as deltas of delta_size bytes from either
+ * zero or a single explicit base.
+ */
+size_t compress_bdi_size(const uint8_t *block, size_t size) {
+
+    bool all_zero = true, repeated = true;
+    for (size_t i = 0; i < size; i++) {
+        if (block[i] != 0) {
+            all_zero = false;
+        }
+        if (i >= 8 && block[i] != block[i - 8]) {
+            repeated = false;
+        }
+    }
+    if (all_zero) {
+        return 1;
+    }
+    if (repeated && size >= 8) {
+        return 8;
+    }
+
+    static const size_t base_sizes[] = {8, 4, 2};
+    static const size_t delta_sizes[] = {1, 2, 4};
+    size_t best = size;
+
+    for (size_t b = 0; b < 3; b++) {
+        size_t base_size = base_sizes[b];
+        size_t count = size / base_size;
+        for (size_t d = 0; d < 3 && delta_sizes[d] < base_size; d++) {
+            size_t delta_size = delta_sizes[d];
+            bool has_base = false, compressible = true;
+            int64_t base = 0;
+
+            for (size_t i = 0; i < count && compressible; i++) {
+                int64_t value = read_signed(block + i * base_size, base_size);
+                if (fits_in(value, delta_size)) {
+                    continue;
+                }
+                if (!has_base) {
+                    base = value;
+                    has_base = true;
+                }
+                compressible = fits_in((int64_t)((uint64_t)value - (uint64_t)base), delta_size);
+            }
+
+            // The base, the deltas, and one bit per value to select the base.
+            size_t compressed = base_size + count * delta_size + (count + 7) / 8;
+            if (compressible && compressed < best) {
+                best = compressed;
+            }
+        }
+    }
+    return best;
+}
+
+/*
+ * Return the size of a block compressed with Frequent Pattern Compression:
+ * each 32-bit word gets a 3-bit prefix describing which pattern it matches.
+ */
+size_t compress_fpc_size(const uint8_t *block, size_t size) {
+
+    size_t bits = 0, zero_run = 0;
+    for (size_t i = 0; i + 4 <= size; i += 4) {
+        uint32_t word = block[i] | block[i + 1] << 8 | block[i + 2] << 16 | (uint32_t)block[i + 3] << 24;
+        int32_t value = (int32_t)word;
+        int16_t low = (int16_t)(word & 0xffff), high = (int16_t)(word >> 16);
+
+        // Runs of up to eight zero words share a single 3-bit length.
+        if (word == 0) {
+            if (zero_run % 8 == 0) {
+                bits += 3 + 3;
+            }
+            zero_run++;
+            continue;
+        }
+        zero_run = 0;
+
+        if (value >= -8 && value < 8) {
+            bits += 3 + 4;
+        } else if (value >= -128 && value < 128) {
+            bits += 3 + 8;
+        } else if (value >= -32768 && value < 32768) {
+            bits += 3 + 16;
+        } else if ((word & 0xffff) == 0) {
+            bits += 3 + 16;
+        } else if (low >= -128 && low < 128 && high >= -128 && high < 128) {
+            bits += 3 + 16;
+        } else if (block[i] == block[i + 1] && block[i] == block[i + 2] && block[i] == block[i + 3]) {
+            bits += 3 + 8;
+        } else {
+            bits += 3 + 32;
+        }
+    }
+    return (bits + 7) / 8;
+}
+
+/*
+ * Return the size a block takes in the data store of a compressed cache.
+ */
+static size_t cache_compression_line_size(cache_t *cache, const uint8_t *block) {
+
+    if (block == NULL) {
+        return cache->line_size;
+    }
+
+    size_t size = cache->line_size;
+    if (cache->compression->algorithm & CACHE_COMPRESSION_BDI) {
+        size_t bdi = compress_bdi_size(block, cache->line_size);
+        size = bdi < size ? bdi : size;
+    }
+    if (cache->compression->algorithm & CACHE_COMPRESSION_FPC) {
+        size_t fpc = compress_fpc_size(block, cache->line_size);
+        size = fpc < size ? fpc : size;
+    }
+
+    size = (size + CACHE_COMPRESSION_SEGMENT - 1) / CACHE_COMPRESSION_SEGMENT * CACHE_COMPRESSION_SEGMENT;
+    return size < cache->line_size ? size : cache->line_size;
+}
+
+/*
+ * Create a compressed cache.
+ */
+cache_t *cache_new_compressed(size_t num_bytes, size_t block_size, size_t associativity,
+                              uint8_t policies, int algorithm) {
+
+    // Lines are evicted in lru_list order, which only the LRU family keeps.
+    switch (policies & CACHE_REPLACEMENTPOLICY_MASK) {
+        case CACHE_REPLACEMENTPOLICY_LRU:
+        case CACHE_REPLACEMENTPOLICY_LIP:
+        case CACHE_REPLACEMENTPOLICY_BIP:
+        case CACHE_REPLACEMENTPOLICY_DIP:
+            break;
+        default:
+            return NULL;
+    }
+
+    // The tags of a compressed cache are those of a cache with
+    // CACHE_COMPRESSION_TAG_FACTOR times more ways.
+    cache_t *cache = cache_new(num_bytes * CACHE_COMPRESSION_TAG_FACTOR, block_size,
+                               associativity * CACHE_COMPRESSION_TAG_FACTOR, policies & ~CACHE_NODATA_MASK);
+
+    cache_compression_t *compression = (cache_compression_t *)calloc(1, sizeof(cache_compression_t));
+    compression->algorithm = algorithm;
+    compression->set_capacity = associativity * block_size;
+    compression->compressed_size = (uint16_t *)calloc(cache->num_lines, sizeof(uint16_t));
+    compression->set_used = (size_t *)calloc(cache->num_sets, sizeof(size_t));
+
+    // Compression invalidates lines behind the policy, so it scans the sets.
+    if (cache->fully_associative != NULL) {
+        cache_fully_associative_disable(cache);
+    }
+    cache->compression = compression;
+    return cache;
+}
+
+/*
+ * Frees the compression state of a cache.
+ */
+void cache_compression_free(cache_t *cache) {
+    free(cache->compression->compressed_size);
+    free(cache->compression->set_used);
+    free(cache->compression);
+    cache->compression = NULL;
+}
+
+/*
+ * Account for a line that was just filled, and make room for it.
+ */
+void cache_compression_fill(cache_t *cache, cache_set_t *cache_set, cache_line_t *line) {
+
+    cache_compression_t *compression = cache->compression;
+    size_t set_index = cache_set - cache->sets;
+    size_t line_index = line - cache->lines;
+
+    // The line may replace one that was resident.
+    compression->set_used[set_index] -= compression->compressed_size[line_index];
+
+    size_t size = cache_compression_line_size(cache, cache_line_block(cache, line));
+    compression->compressed_size[line_index] = size;
+    compression->set_used[set_index] += size;
+
+    compression->fill_count++;
+    compression->uncompressed_bytes += cache->line_size;
+    compression->compressed_bytes += size;
+
+    cache_line_t *lines = cache_set->lines + cache_set->first_index;
+    for (size_t i = 0; i < cache->associativity && compression->set_used[set_index] > compression->set_capacity; i++) {
+        size_t way = cache_set->lru_list[i];
+        cache_line_t *victim = lines + way;
+        if (victim == line || !victim->is_valid) {
+            continue;
+        }
+
+        cache_line_evict(cache, cache_set, way);
+        cache_line_invalidate(cache, cache_set, way);
+        compression->set_used[set_index] -= compression->compressed_size[cache_set->first_index + way];
+        compression->compressed_size[cache_set->first_index + way] = 0;
+        compression->compression_evictions++;
+    }
+}
+
+/*
+ * Return the number of bytes of uncompressed data held by the cache.
+ */
+size_t cache_compression_effective_capacity(cache_t *cache) {
+    size_t resident = 0;
+    for (size_t i = 0; i < cache->num_lines; i++) {
+        if (cache->lines[i].is_valid) {
+            resident += cache->line_size;
+        }
+    }
+    return resident;
+}
+
+/*
+ * Print the compression ratio and effective capacity of the cache.
+ */
+void cache_compression_print_stats(FILE *out, cache_t *cache) {
+
+    cache_compression_t *compression = cache->compression;
+    if (compression->fill_count == 0) {
+        fprintf(out, "The cache wasn't used.\n");
+        return;
+    }
+
+    size_t used = 0;
+    for (size_t i = 0; i < cache->num_sets; i++) {
+        used += compression->set_used[i];
+    }
+    size_t capacity = cache->num_sets * compression->set_capacity;
+    size_t effective = cache_compression_effective_capacity(cache);
+
+    fprintf(out, "Compression ratio  = %8.4f\n", (double) compression->uncompressed_bytes / compression->compressed_bytes);
+    fprintf(out, "Resident ratio     = %8.4f\n", used == 0 ? 0.0 : (double) effective / used);
+    fprintf(out, "Effective capacity = %zu bytes (%.2fx of %zu)\n", effective, (double) effective / capacity, capacity);
+    fprintf(out, "Compression evictions = %" PRIu64 "\n", compression->compression_evictions);
+}
@@ -0,0 +1,89 @@
+/*
+ * compress.h
+ *
+ * Model of a compressed cache. Each set has twice as many tags as the
+ * uncompressed cache has ways, but only as many bytes of data: lines are
+ * stored in compressed form, so a set holds a variable number of lines
+ * depending on how well the actual block contents compress.
+ *
+ * Compressed sizes come from Base-Delta-Immediate (BDI) and/or Frequent
+ * Pattern Compression (FPC), and are rounded up to segments of
+ * CACHE_COMPRESSION_SEGMENT bytes. When a new line does not fit, lines are
+ * evicted in lru_list order until it does.
+ */
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "cache.h"
+
+/*
+ * Compression algorithms.
+ */
+#define CACHE_COMPRESSION_BDI  1
+#define CACHE_COMPRESSION_FPC  2
+#define CACHE_COMPRESSION_BEST (CACHE_COMPRESSION_BDI | CACHE_COMPRESSION_FPC)
+
+/*
+ * Number of tags per way of data, and granularity of the data store.
+ */
+#define CACHE_COMPRESSION_TAG_FACTOR 2
+#define CACHE_COMPRESSION_SEGMENT    8
+
+/*
+ * Structure used to store the compression state of a cache.
+ */
+typedef struct cache_compression_s {
+    int algorithm;
+
+    /* Bytes of data each set can hold. */
+    size_t set_capacity;
+
+    /* Compressed size of each line, 0 if the line is not resident. */
+    uint16_t *compressed_size;
+
+    /* Bytes of data used in each set. */
+    size_t *set_used;
+
+    /* Statistics about filled lines. */
+    uint64_t fill_count;
+    uint64_t uncompressed_bytes, compressed_bytes;
+    uint64_t compression_evictions;
+} cache_compression_t;
+
+/*
+ * Return the size of a block compressed with BDI or FPC.
+ */
+size_t compress_bdi_size(const uint8_t *block, size_t size);
+size_t compress_fpc_size(const uint8_t *block, size_t size);
+
+/*
+ * Create a compressed cache holding num_bytes bytes of compressed data, in
+ * sets of associativity * line_size bytes. The cache must hold data, so
+ * CACHE_NODATAPOLICY is ignored. Returns NULL unless the replacement policy
+ * is LRU, LIP, BIP or DIP, which keep the lru_list evictions follow.
+ */
+cache_t *cache_new_compressed(size_t num_bytes, size_t block_size, size_t associativity,
+                              uint8_t policies, int algorithm);
+
+/*
+ * Frees the compression state of a cache.
+ */
+void cache_compression_free(cache_t *cache);
+
+/*
+ * Account for a line that was just filled in a set, evicting other lines
+ * of the set until the compressed data fits.
+ */
+void cache_compression_fill(cache_t *cache, cache_set_t *cache_set, cache_line_t *line);
+
+/*
+ * Return the number of bytes of uncompressed data held by the cache.
+ */
+size_t cache_compression_effective_capacity(cache_t *cache);
+
+/*
+ * Print the compression ratio and effective capacity of the cache.
+ */
+void cache_compression_print_stats(FILE *out, cache_t *cache);
+
+#endif
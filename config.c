@@ -0,0 +1,563 @@
+#include "config.h"
+#include "replacement.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <limits.h>
+
+/*
+ * Built-in policies a level can name, and their replacement bits.
+ */
+static const struct {
+    const char *name;
+    uint8_t policy;
+} cache_config_policies[] = {
+    {"lru", CACHE_REPLACEMENTPOLICY_LRU},
+    {"lip", CACHE_REPLACEMENTPOLICY_LIP},
+    {"bip", CACHE_REPLACEMENTPOLICY_BIP},
+    {"dip", CACHE_REPLACEMENTPOLICY_DIP},
+    {"rm", CACHE_REPLACEMENTPOLICY_RANDOMIZED_MARKING},
+};
+
+static const char *cache_config_kernels[] = {"sumA", "sumB", "sumC", "sumD"};
+
+/*
+ * Record why something failed, and return -1.
+ */
+static int cache_config_error(cache_config_t *config, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(config->error, sizeof(config->error), format, args);
+    va_end(args);
+    return -1;
+}
+
+/*
+ * Remove the blanks around a string, in place.
+ */
+static char *cache_config_trim(char *s) {
+    while (isspace((unsigned char) *s)) {
+        s++;
+    }
+    size_t length = strlen(s);
+    while (length > 0 && isspace((unsigned char) s[length - 1])) {
+        s[--length] = '\0';
+    }
+    return s;
+}
+
+/*
+ * Parse an unsigned integer, and return whether the whole value was one.
+ * strtoull negates values with a '-', so those are refused here.
+ */
+static bool cache_config_number(const char *value, size_t *number) {
+    char *end;
+    *number = strtoull(value, &end, 0);
+    return *value != '\0' && *value != '-' && *end == '\0';
+}
+
+/*
+ * Copy a string value, and return whether it fit.
+ */
+static bool cache_config_string(char *dest, size_t size, const char *value) {
+    return snprintf(dest, size, "%s", value) < (int) size;
+}
+
+/*
+ * Set a key of a level.
+ */
+static int cache_config_level_key(cache_config_t *config, cache_level_config_t *level, const char *key,
+                                  const char *value) {
+    size_t number;
+    if (strcmp(key, "size") == 0 && cache_config_number(value, &number)) {
+        level->size = number;
+    } else if (strcmp(key, "line") == 0 && cache_config_number(value, &number)) {
+        level->line_size = number;
+    } else if (strcmp(key, "associativity") == 0 && cache_config_number(value, &number)) {
+        level->associativity = number;
+    } else if (strcmp(key, "latency") == 0 && cache_config_number(value, &number) && number <= UINT_MAX) {
+        level->latency = number;
+    } else if (strcmp(key, "policy") == 0 && cache_config_string(level->policy, sizeof(level->policy), value)) {
+    } else if (strcmp(key, "write") == 0 && strcmp(value, "writeback") == 0) {
+        level->writeback = true;
+    } else if (strcmp(key, "write") == 0 && strcmp(value, "writethrough") == 0) {
+        level->writeback = false;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Set a key of the [simulation] section.
+ */
+static int cache_config_simulation_key(cache_config_t *config, const char *key, const char *value) {
+    size_t number;
+    if (strcmp(key, "trace") == 0) {
+        return cache_config_string(config->trace, sizeof(config->trace), value) ? 0 : -1;
+    } else if (strcmp(key, "kernel") == 0) {
+        return cache_config_string(config->kernel, sizeof(config->kernel), value) ? 0 : -1;
+    } else if (strcmp(key, "json") == 0) {
+        return cache_config_string(config->json, sizeof(config->json), value) ? 0 : -1;
+    } else if (strcmp(key, "csv") == 0) {
+        return cache_config_string(config->csv, sizeof(config->csv), value) ? 0 : -1;
+    } else if (strcmp(key, "pipelined") == 0 && (strcmp(value, "true") == 0 || strcmp(value, "false") == 0)) {
+        config->pipelined = strcmp(value, "true") == 0;
+    } else if (strcmp(key, "rows") == 0 && cache_config_number(value, &number)) {
+        config->rows = number;
+    } else if (strcmp(key, "cols") == 0 && cache_config_number(value, &number)) {
+        config->cols = number;
+    } else if (strcmp(key, "count") == 0 && cache_config_number(value, &number)) {
+        config->count = number;
+    } else if (strcmp(key, "memory_latency") == 0 && cache_config_number(value, &number) && number <= UINT_MAX) {
+        config->memory_latency = number;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static bool cache_config_power_of_two(size_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+/*
+ * Check the geometry of a level.
+ */
+static int cache_config_check_level(cache_config_t *config, const char *name, const cache_level_config_t *level) {
+    if (!cache_config_power_of_two(level->size) || !cache_config_power_of_two(level->line_size)
+        || !cache_config_power_of_two(level->associativity)) {
+        return cache_config_error(config, "[%s]: size, line and associativity must be powers of two", name);
+    }
+    if (level->line_size < 8 || level->size < level->line_size * level->associativity) {
+        return cache_config_error(config, "[%s]: lines must hold 8 bytes, and the cache one set", name);
+    }
+    return 0;
+}
+
+/*
+ * Check that a level is no faster than the first one, which stall cycles
+ * are counted from.
+ */
+static int cache_config_check_latency(cache_config_t *config, const char *path, const char *name,
+                                      const cache_level_config_t *level) {
+    const cache_level_config_t *first = config->levels;
+    if (level->latency < first->latency) {
+        int line = level->latency_line != 0 ? level->latency_line : first->latency_line;
+        return cache_config_error(config, "%s:%d: [%s] latency %u is below the %u of the first level", path,
+                                  line, name, level->latency, first->latency);
+    }
+    return 0;
+}
+
+/*
+ * Check that a configuration describes a simulation that can run.
+ */
+static int cache_config_check(cache_config_t *config, const char *path, uint32_t seen) {
+
+    // Levels are l1 (bit 0), l1d (bit 1), l1i (bit 2), and l2 and below
+    // (bits 3 and up).
+    if ((seen & 1) && (seen & 6)) {
+        return cache_config_error(config, "[l1] cannot be given with [l1i] or [l1d]");
+    }
+    if ((seen & 7) != 1 && (seen & 7) != 6) {
+        return cache_config_error(config, "the first level must be [l1], or [l1i] and [l1d]");
+    }
+    config->num_levels = 1;
+    while (seen >> (config->num_levels + 2) & 1) {
+        config->num_levels++;
+    }
+    if (seen >> (config->num_levels + 2) != 0) {
+        return cache_config_error(config, "levels must follow each other from [l2]");
+    }
+
+    for (size_t i = 0; i < config->num_levels; i++) {
+        char name[24];
+        snprintf(name, sizeof(name), "l%zu", i + 1);
+        if (cache_config_check_level(config, name, config->levels + i) != 0
+            || cache_config_check_latency(config, path, name, config->levels + i) != 0) {
+            return -1;
+        }
+    }
+    if (config->split && (cache_config_check_level(config, "l1i", &config->instruction) != 0
+                          || cache_config_check_latency(config, path, "l1i", &config->instruction) != 0)) {
+        return -1;
+    }
+    if (config->memory_latency < config->levels[0].latency) {
+        int line = config->memory_latency_line != 0 ? config->memory_latency_line : config->levels[0].latency_line;
+        return cache_config_error(config, "%s:%d: memory_latency %u is below the %u of the first level", path, line,
+                                  config->memory_latency, config->levels[0].latency);
+    }
+
+    if ((config->trace[0] != '\0') == (config->kernel[0] != '\0')) {
+        return cache_config_error(config, "[simulation] needs either a trace or a kernel");
+    }
+    if (config->kernel[0] != '\0') {
+        bool known = false;
+        for (size_t i = 0; i < sizeof(cache_config_kernels) / sizeof(cache_config_kernels[0]); i++) {
+            known = known || strcmp(config->kernel, cache_config_kernels[i]) == 0;
+        }
+        if (!known) {
+            return cache_config_error(config, "unknown kernel '%s'", config->kernel);
+        }
+        if (config->rows == 0 || config->cols == 0) {
+            return cache_config_error(config, "kernel '%s' needs rows and cols", config->kernel);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Read a configuration file.
+ */
+int cache_config_load(cache_config_t *config, const char *path) {
+
+    memset(config, 0, sizeof(cache_config_t));
+    config->memory_latency = CACHE_HIERARCHY_DEFAULT_MEMORY_LATENCY;
+    config->count = 1;
+    unsigned int latencies[CACHE_HIERARCHY_MAX_LEVELS] = CACHE_HIERARCHY_DEFAULT_LATENCIES;
+    for (size_t i = 0; i < CACHE_HIERARCHY_MAX_LEVELS; i++) {
+        strcpy(config->levels[i].policy, "lru");
+        config->levels[i].latency = latencies[i];
+    }
+    config->instruction = config->levels[0];
+
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        return cache_config_error(config, "%s: cannot open", path);
+    }
+
+    // Keys before any section belong to [simulation].
+    char buffer[512];
+    int number = 0;
+    bool simulation = true;
+    cache_level_config_t *level = NULL;
+    uint32_t seen = 0;
+    while (fgets(buffer, sizeof(buffer), in) != NULL) {
+        number++;
+        char *comment = strchr(buffer, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        char *line = cache_config_trim(buffer);
+        if (*line == '\0') {
+            continue;
+        }
+
+        size_t length = strlen(line);
+        if (line[0] == '[' && line[length - 1] == ']') {
+            line[length - 1] = '\0';
+            char *section = cache_config_trim(line + 1);
+            size_t index;
+            simulation = false;
+            level = NULL;
+            if (strcmp(section, "simulation") == 0) {
+                simulation = true;
+            } else if (strcmp(section, "l1") == 0) {
+                level = config->levels;
+                seen |= 1;
+            } else if (strcmp(section, "l1d") == 0) {
+                level = config->levels;
+                seen |= 2;
+            } else if (strcmp(section, "l1i") == 0) {
+                level = &config->instruction;
+                config->split = true;
+                seen |= 4;
+            } else if (section[0] == 'l' && cache_config_number(section + 1, &index)
+                       && index >= 2 && index <= CACHE_HIERARCHY_MAX_LEVELS) {
+                level = config->levels + index - 1;
+                seen |= 1u << (index + 1);
+            } else {
+                fclose(in);
+                return cache_config_error(config, "%s:%d: unknown section [%s]", path, number, section);
+            }
+            continue;
+        }
+
+        char *equals = strchr(line, '=');
+        if (equals == NULL) {
+            fclose(in);
+            return cache_config_error(config, "%s:%d: expected key = value", path, number);
+        }
+        *equals = '\0';
+        char *key = cache_config_trim(line);
+        char *value = cache_config_trim(equals + 1);
+        int result = simulation ? cache_config_simulation_key(config, key, value)
+                                : cache_config_level_key(config, level, key, value);
+        if (result != 0) {
+            fclose(in);
+            return cache_config_error(config, "%s:%d: invalid %s = %s", path, number, key, value);
+        }
+        if (strcmp(key, "latency") == 0) {
+            level->latency_line = number;
+        } else if (strcmp(key, "memory_latency") == 0) {
+            config->memory_latency_line = number;
+        }
+    }
+    fclose(in);
+
+    return cache_config_check(config, path, seen);
+}
+
+/*
+ * Find the replacement bits of a built-in policy.
+ */
+int cache_config_policy(const char *name, uint8_t *policies) {
+    for (size_t i = 0; i < sizeof(cache_config_policies) / sizeof(cache_config_policies[0]); i++) {
+        if (strcmp(name, cache_config_policies[i].name) == 0) {
+            *policies = cache_config_policies[i].policy;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Create the cache of a level.
+ */
+static cache_t *cache_config_new_cache(cache_config_t *config, const cache_level_config_t *level) {
+
+    uint8_t policies = CACHE_NODATAPOLICY | (level->writeback ? CACHE_WRITEPOLICY_WRITEBACK : 0);
+    uint8_t replacement_policy;
+    if (cache_config_policy(level->policy, &replacement_policy) == 0) {
+        return cache_new(level->size, level->line_size, level->associativity, policies | replacement_policy);
+    }
+
+    // Other policies must have been registered (see replacement.h).
+    const cache_replacement_t *replacement = cache_replacement_find(level->policy);
+    if (replacement == NULL || strcmp(level->policy, "opt") == 0) {
+        cache_config_error(config, "unknown policy '%s'", level->policy);
+        return NULL;
+    }
+    cache_t *cache = cache_new(level->size, level->line_size, level->associativity,
+                               policies | CACHE_REPLACEMENTPOLICY_LRU);
+    if (cache_replacement_install(cache, replacement) != 0) {
+        cache_config_error(config, "cannot install policy '%s'", level->policy);
+        cache_free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+/*
+ * Create the hierarchy a configuration describes.
+ */
+cache_hierarchy_t *cache_config_build(cache_config_t *config) {
+
+    cache_t *levels[CACHE_HIERARCHY_MAX_LEVELS];
+    unsigned int latencies[CACHE_HIERARCHY_MAX_LEVELS];
+    cache_t *instruction_cache = NULL;
+    size_t built = 0;
+    for (; built < config->num_levels; built++) {
+        levels[built] = cache_config_new_cache(config, config->levels + built);
+        if (levels[built] == NULL) {
+            break;
+        }
+        latencies[built] = config->levels[built].latency;
+    }
+    if (built == config->num_levels && config->split) {
+        instruction_cache = cache_config_new_cache(config, &config->instruction);
+    }
+    if (built < config->num_levels || (config->split && instruction_cache == NULL)) {
+        for (size_t i = 0; i < built; i++) {
+            cache_free(levels[i]);
+        }
+        return NULL;
+    }
+
+    cache_hierarchy_t *hierarchy = cache_hierarchy_new(config->num_levels, levels);
+    if (instruction_cache != NULL) {
+        cache_hierarchy_split(hierarchy, instruction_cache);
+    }
+    cache_hierarchy_set_latencies(hierarchy, latencies, config->memory_latency);
+    return hierarchy;
+}
+
+static inline void cache_config_access(cache_config_t *config, cache_hierarchy_t *hierarchy, size_t index) {
+    uintptr_t address = index * sizeof(int64_t);
+    if (config->pipelined) {
+        cache_hierarchy_read_pipelined(hierarchy, address, rand);
+    } else {
+        cache_hierarchy_read(hierarchy, address, rand);
+    }
+}
+
+/*
+ * Read the addresses the kernels of main.c read, from an array at address 0.
+ */
+static void cache_config_run_kernel(cache_config_t *config, cache_hierarchy_t *hierarchy) {
+
+    size_t rows = config->rows, cols = config->cols;
+    if (strcmp(config->kernel, "sumA") == 0) {
+        for (size_t i = 0; i < rows; i++)
+            for (size_t j = 0; j < cols; j++)
+                cache_config_access(config, hierarchy, i * cols + j);
+    } else if (strcmp(config->kernel, "sumB") == 0) {
+        for (size_t j = 0; j < cols; j++)
+            for (size_t i = 0; i < rows; i++)
+                cache_config_access(config, hierarchy, i * cols + j);
+    } else if (strcmp(config->kernel, "sumC") == 0) {
+        for (size_t j = 0; j < cols; j += 2)
+            for (size_t i = 0; i < rows; i += 2) {
+                cache_config_access(config, hierarchy, i * cols + j);
+                cache_config_access(config, hierarchy, (i + 1) * cols + j);
+                cache_config_access(config, hierarchy, i * cols + j + 1);
+                cache_config_access(config, hierarchy, (i + 1) * cols + j + 1);
+            }
+    } else {
+        for (size_t k = 0; k < config->count; k++)
+            for (size_t i = 0; i < rows; i++)
+                for (size_t j = 0; j < cols; j += 8)
+                    cache_config_access(config, hierarchy, i * cols + j + k);
+    }
+}
+
+/*
+ * Run the accesses of the configured source through the hierarchy.
+ */
+int cache_config_run(cache_config_t *config, cache_hierarchy_t *hierarchy) {
+
+    if (config->trace[0] != '\0') {
+        if (cache_hierarchy_replay(hierarchy, config->trace, config->pipelined) != 0) {
+            return cache_config_error(config, "%s: cannot replay trace", config->trace);
+        }
+        return 0;
+    }
+
+    if (config->pipelined && cache_hierarchy_start_pipeline(hierarchy, CACHE_QUEUE_DEFAULT_CAPACITY) != 0) {
+        return cache_config_error(config, "cannot start the pipeline");
+    }
+    cache_config_run_kernel(config, hierarchy);
+    if (config->pipelined) {
+        cache_hierarchy_stop_pipeline(hierarchy);
+    }
+    return 0;
+}
+
+/*
+ * Return the number of caches in the hierarchy, instruction cache included.
+ */
+static size_t cache_config_num_caches(const cache_config_t *config) {
+    return config->num_levels + (config->split ? 1 : 0);
+}
+
+/*
+ * Return the name, cache and configuration of the i-th cache of the
+ * hierarchy, counting the instruction cache first when there is one.
+ */
+static cache_t *cache_config_cache(const cache_config_t *config, cache_hierarchy_t *hierarchy, size_t i,
+                                   const cache_level_config_t **level, char *name, size_t size) {
+    if (config->split && i == 0) {
+        *level = &config->instruction;
+        snprintf(name, size, "L1I");
+        return hierarchy->instruction_cache;
+    }
+    size_t index = config->split ? i - 1 : i;
+    *level = config->levels + index;
+    if (index == 0) {
+        snprintf(name, size, config->split ? "L1D" : "L1");
+    } else {
+        snprintf(name, size, "L%zu", index + 1);
+    }
+    return hierarchy->levels[index];
+}
+
+static double cache_config_rate(uint64_t misses, uint64_t accesses) {
+    return accesses == 0 ? 0.0 : (double) misses / accesses;
+}
+
+/*
+ * Print the statistics as JSON.
+ */
+void cache_config_print_json(FILE *out, const cache_config_t *config, cache_hierarchy_t *hierarchy) {
+
+    fprintf(out, "{\n  \"levels\": [\n");
+    for (size_t i = 0; i < cache_config_num_caches(config); i++) {
+        const cache_level_config_t *level;
+        char name[24];
+        cache_t *cache = cache_config_cache(config, hierarchy, i, &level, name, sizeof(name));
+        fprintf(out, "    {\"name\": \"%s\", \"size\": %zu, \"line\": %zu, \"associativity\": %zu, "
+                "\"policy\": \"%s\", \"latency\": %u,\n", name, level->size, level->line_size,
+                level->associativity, level->policy, level->latency);
+        fprintf(out, "     \"accesses\": %" PRIu64 ", \"misses\": %" PRIu64 ", \"miss_rate\": %.6f,\n",
+                cache->access_count, cache->miss_count,
+                cache_config_rate(cache->miss_count, cache->access_count));
+        fprintf(out, "     \"types\": {");
+        for (int type = 0; type < CACHE_ACCESS_TYPES; type++) {
+            fprintf(out, "%s\"%s\": {\"accesses\": %" PRIu64 ", \"misses\": %" PRIu64 ", \"miss_rate\": %.6f}",
+                    type == 0 ? "" : ", ", cache_access_type_name(type), cache->type_access_count[type],
+                    cache->type_miss_count[type],
+                    cache_config_rate(cache->type_miss_count[type], cache->type_access_count[type]));
+        }
+        fprintf(out, "}}%s\n", i + 1 < cache_config_num_caches(config) ? "," : "");
+    }
+    fprintf(out, "  ],\n  \"stall_cycles\": {");
+    for (int type = 0; type < CACHE_ACCESS_STORE; type++) {
+        fprintf(out, "%s\"%s\": %" PRIu64, type == 0 ? "" : ", ", cache_access_type_name(type),
+                cache_hierarchy_stall_cycles(hierarchy, type));
+    }
+    fprintf(out, "}\n}\n");
+}
+
+/*
+ * Print the statistics as CSV.
+ */
+void cache_config_print_csv(FILE *out, const cache_config_t *config, cache_hierarchy_t *hierarchy) {
+
+    fprintf(out, "level,size,line,associativity,policy,type,accesses,misses,miss_rate,stall_cycles\n");
+    for (size_t i = 0; i < cache_config_num_caches(config); i++) {
+        const cache_level_config_t *level;
+        char name[24];
+        cache_t *cache = cache_config_cache(config, hierarchy, i, &level, name, sizeof(name));
+        fprintf(out, "%s,%zu,%zu,%zu,%s,all,%" PRIu64 ",%" PRIu64 ",%.6f,\n", name, level->size,
+                level->line_size, level->associativity, level->policy, cache->access_count, cache->miss_count,
+                cache_config_rate(cache->miss_count, cache->access_count));
+        for (int type = 0; type < CACHE_ACCESS_TYPES; type++) {
+            fprintf(out, "%s,%zu,%zu,%zu,%s,%s,%" PRIu64 ",%" PRIu64 ",%.6f,\n", name, level->size,
+                    level->line_size, level->associativity, level->policy, cache_access_type_name(type),
+                    cache->type_access_count[type], cache->type_miss_count[type],
+                    cache_config_rate(cache->type_miss_count[type], cache->type_access_count[type]));
+        }
+    }
+    for (int type = 0; type < CACHE_ACCESS_STORE; type++) {
+        fprintf(out, "hierarchy,,,,,%s,,,,%" PRIu64 "\n", cache_access_type_name(type),
+                cache_hierarchy_stall_cycles(hierarchy, type));
+    }
+}
+
+/*
+ * Write one output to path, or to the standard output for "-".
+ */
+static int cache_config_write(cache_config_t *config, cache_hierarchy_t *hierarchy, const char *path,
+                              void (*print)(FILE *, const cache_config_t *, cache_hierarchy_t *)) {
+    if (strcmp(path, "-") == 0) {
+        print(stdout, config, hierarchy);
+        return 0;
+    }
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        return cache_config_error(config, "%s: cannot open", path);
+    }
+    print(out, config, hierarchy);
+    if (fclose(out) != 0) {
+        return cache_config_error(config, "%s: cannot write", path);
+    }
+    return 0;
+}
+
+/*
+ * Write the configured outputs.
+ */
+int cache_config_write_outputs(cache_config_t *config, cache_hierarchy_t *hierarchy) {
+    if (config->json[0] != '\0'
+        && cache_config_write(config, hierarchy, config->json, cache_config_print_json) != 0) {
+        return -1;
+    }
+    if (config->csv[0] != '\0'
+        && cache_config_write(config, hierarchy, config->csv, cache_config_print_csv) != 0) {
+        return -1;
+    }
+    return 0;
+}
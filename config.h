@@ -0,0 +1,127 @@
+/*
+ * config.h
+ *
+ * Simulations described by a configuration file instead of code: the
+ * hierarchy, the geometry and policies of each level, where the accesses
+ * come from, and where the statistics go.
+ *
+ * The file is made of sections of "key = value" lines; "#" starts a
+ * comment. The [simulation] section names the source of the accesses,
+ * either a trace (see trace.h) or one of the kernels of main.c over an
+ * array of 8-byte integers, and the outputs:
+ *
+ *     [simulation]
+ *     trace = app.trace            # or: kernel = sumB, rows = 64, cols = 64
+ *     pipelined = false
+ *     memory_latency = 200
+ *     json = stats.json            # "-" for the standard output
+ *     csv = stats.csv
+ *
+ * Each level has its own section: [l1] for a unified first level, or [l1i]
+ * and [l1d] for a split one, then [l2], [l3] and so on:
+ *
+ *     [l1d]
+ *     size = 32768
+ *     line = 64
+ *     associativity = 8
+ *     policy = lru                 # lru, lip, bip, dip, rm or a registered name
+ *     write = writeback            # or writethrough
+ *     latency = 4
+ *
+ * Stall cycles are counted from the first level, so no level, and not
+ * memory either, can be faster than it.
+ */
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "cache.h"
+#include "hierarchy.h"
+
+#define CACHE_CONFIG_NAME_SIZE 32
+#define CACHE_CONFIG_PATH_SIZE 256
+#define CACHE_CONFIG_ERROR_SIZE 256
+
+/*
+ * Structure used to store the configuration of a level.
+ */
+typedef struct cache_level_config_s {
+    size_t size, line_size, associativity;
+    char policy[CACHE_CONFIG_NAME_SIZE];
+    bool writeback;
+    unsigned int latency;
+
+    /* Line the latency was given on, 0 for the default. */
+    int latency_line;
+} cache_level_config_t;
+
+/*
+ * Structure used to store the configuration of a simulation.
+ */
+typedef struct cache_config_s {
+    size_t num_levels;
+    cache_level_config_t levels[CACHE_HIERARCHY_MAX_LEVELS];
+
+    /* Whether [l1i] was given, and its configuration. */
+    bool split;
+    cache_level_config_t instruction;
+
+    unsigned int memory_latency;
+    int memory_latency_line;
+    bool pipelined;
+
+    /* Source of the accesses: a trace, or a kernel of main.c. */
+    char trace[CACHE_CONFIG_PATH_SIZE];
+    char kernel[CACHE_CONFIG_NAME_SIZE];
+    size_t rows, cols, count;
+
+    /* Outputs, empty when not wanted. */
+    char json[CACHE_CONFIG_PATH_SIZE];
+    char csv[CACHE_CONFIG_PATH_SIZE];
+
+    /* Why loading or running failed. */
+    char error[CACHE_CONFIG_ERROR_SIZE];
+} cache_config_t;
+
+/*
+ * Read the configuration file at path. Returns 0 on success and -1 on
+ * failure, with the reason in config->error.
+ */
+int cache_config_load(cache_config_t *config, const char *path);
+
+/*
+ * Store in policies the replacement bits of the built-in policy with the
+ * given name. Returns 0 on success and -1 if there is no such policy.
+ */
+int cache_config_policy(const char *name, uint8_t *policies);
+
+/*
+ * Create the hierarchy a configuration describes. Returns NULL on failure,
+ * with the reason in config->error.
+ */
+cache_hierarchy_t *cache_config_build(cache_config_t *config);
+
+/*
+ * Run the accesses of the configured source through the hierarchy. Returns
+ * 0 on success and -1 on failure, with the reason in config->error.
+ */
+int cache_config_run(cache_config_t *config, cache_hierarchy_t *hierarchy);
+
+/*
+ * Print the geometry and statistics of every level, per type of access,
+ * and the stall cycles of each type, as JSON.
+ */
+void cache_config_print_json(FILE *out, const cache_config_t *config, cache_hierarchy_t *hierarchy);
+
+/*
+ * Print the geometry and statistics of every level as CSV, one line per
+ * level and type of access.
+ */
+void cache_config_print_csv(FILE *out, const cache_config_t *config, cache_hierarchy_t *hierarchy);
+
+/*
+ * Write the configured outputs. Returns 0 on success and -1 on failure,
+ * with the reason in config->error.
+ */
+int cache_config_write_outputs(cache_config_t *config, cache_hierarchy_t *hierarchy);
+
+#endif
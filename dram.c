@@ -0,0 +1,157 @@
+#include "dram.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * Fill config with a DDR4-like organisation and timings.
+ */
+void dram_config_default(dram_config_t *config) {
+    config->channels = 2;
+    config->ranks = 1;
+    config->banks = 16;
+    config->row_size = 8192;
+    config->burst_size = 64;
+    config->page_policy = DRAM_PAGEPOLICY_OPEN;
+    config->t_cas = 16;
+    config->t_rcd = 16;
+    config->t_rp = 16;
+    config->t_ras = 39;
+    config->t_burst = 4;
+}
+
+static bool dram_power_of_two(size_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+/*
+ * Create a new DRAM with the given configuration.
+ */
+dram_t *dram_new(const dram_config_t *config) {
+
+    // Addresses are split by each of these sizes.
+    if (!dram_power_of_two(config->channels) || !dram_power_of_two(config->ranks)
+        || !dram_power_of_two(config->banks) || !dram_power_of_two(config->row_size)
+        || !dram_power_of_two(config->burst_size)) {
+        return NULL;
+    }
+
+    dram_t *dram = (dram_t *)calloc(1, sizeof(dram_t));
+    dram->config = *config;
+
+    size_t num_banks = config->channels * config->ranks * config->banks;
+    dram->banks = (dram_bank_t *)calloc(num_banks, sizeof(dram_bank_t));
+    dram->bus_free_at = (uint64_t *)calloc(config->channels, sizeof(uint64_t));
+
+    return dram;
+}
+
+/*
+ * Frees all memory allocated for the given DRAM.
+ */
+void dram_free(dram_t *dram) {
+    free(dram->banks);
+    free(dram->bus_free_at);
+    free(dram);
+}
+
+/*
+ * Transfer a line to or from the DRAM. Addresses are mapped as
+ * row:rank:bank:channel:column, so consecutive rows go to different
+ * channels and banks.
+ */
+uint64_t dram_access(dram_t *dram, uintptr_t address, size_t line_size, bool is_write, uint64_t now) {
+
+    dram_config_t *config = &dram->config;
+
+    uint64_t row = address / config->row_size;
+    size_t channel = row % config->channels;
+    row /= config->channels;
+    size_t bank_index = row % config->banks;
+    row /= config->banks;
+    size_t rank = row % config->ranks;
+    row /= config->ranks;
+
+    dram_bank_t *bank = dram->banks + (channel * config->ranks + rank) * config->banks + bank_index;
+
+    // Issue the commands needed to reach the column.
+    uint64_t start = now > bank->ready_at ? now : bank->ready_at;
+    uint64_t column_at;
+    if (bank->row_open && bank->open_row == row) {
+        dram->row_hits++;
+        column_at = start;
+    } else if (bank->row_open) {
+        dram->row_conflicts++;
+        if (start < bank->activated_at + config->t_ras) {
+            start = bank->activated_at + config->t_ras;
+        }
+        bank->activated_at = start + config->t_rp;
+        column_at = bank->activated_at + config->t_rcd;
+    } else {
+        dram->row_empty++;
+        bank->activated_at = start;
+        column_at = start + config->t_rcd;
+    }
+
+    // Then transfer the data over the channel bus.
+    size_t bursts = (line_size + config->burst_size - 1) / config->burst_size;
+    uint64_t data_at = column_at + config->t_cas;
+    if (data_at < dram->bus_free_at[channel]) {
+        data_at = dram->bus_free_at[channel];
+    }
+    uint64_t done = data_at + bursts * config->t_burst;
+    dram->bus_free_at[channel] = done;
+
+    if (config->page_policy == DRAM_PAGEPOLICY_OPEN) {
+        bank->row_open = true;
+        bank->open_row = row;
+        bank->ready_at = column_at + bursts * config->t_burst;
+    } else {
+        // Auto-precharge once the row has been open long enough.
+        uint64_t precharge_at = done > bank->activated_at + config->t_ras ? done : bank->activated_at + config->t_ras;
+        bank->row_open = false;
+        bank->ready_at = precharge_at + config->t_rp;
+    }
+
+    if (is_write) {
+        dram->write_count++;
+    } else {
+        dram->read_count++;
+    }
+    dram->byte_count += line_size;
+    if (dram->read_count + dram->write_count == 1) {
+        dram->first_request_at = now;
+    }
+    if (done > dram->last_done_at) {
+        dram->last_done_at = done;
+    }
+    dram->total_latency += done - now;
+
+    return done;
+}
+
+/*
+ * Make misses and writebacks of the cache go to the DRAM.
+ */
+void cache_attach_dram(cache_t *cache, dram_t *dram) {
+    cache->dram = dram;
+}
+
+/*
+ * Print the row buffer hit rate, average latency and bandwidth of the DRAM.
+ */
+void dram_print_stats(FILE *out, dram_t *dram) {
+
+    uint64_t requests = dram->read_count + dram->write_count;
+    if (requests == 0) {
+        fprintf(out, "The DRAM wasn't used.\n");
+        return;
+    }
+
+    uint64_t cycles = dram->last_done_at - dram->first_request_at;
+    fprintf(out, "DRAM reads = %" PRIu64 ", writes = %" PRIu64 "\n", dram->read_count, dram->write_count);
+    fprintf(out, "Row hit rate      = %8.4f (%" PRIu64 " empty, %" PRIu64 " conflicts)\n",
+            (double) dram->row_hits / requests, dram->row_empty, dram->row_conflicts);
+    fprintf(out, "Average latency   = %8.2f cycles\n", (double) dram->total_latency / requests);
+    fprintf(out, "Bandwidth         = %8.4f bytes/cycle\n", cycles == 0 ? 0.0 : (double) dram->byte_count / cycles);
+}
@@ -0,0 +1,108 @@
+/*
+ * dram.h
+ *
+ * Timing model of the DRAM behind the last level cache. Memory is split
+ * into channels, ranks and banks; each bank has a row buffer holding the
+ * last row it activated. With the open page policy, rows stay open after
+ * an access, so later accesses to the same row only pay the column access;
+ * with the closed page policy, every access activates its row and the bank
+ * precharges right after. Each channel has a data bus that transfers one
+ * burst at a time, which bounds bandwidth.
+ *
+ * All times are in cycles.
+ */
+#ifndef DRAM_H
+#define DRAM_H
+
+#include "cache.h"
+
+/*
+ * Page policies.
+ */
+#define DRAM_PAGEPOLICY_OPEN   0
+#define DRAM_PAGEPOLICY_CLOSED 1
+
+/*
+ * Structure used to describe the organisation and timings of the DRAM.
+ */
+typedef struct dram_config_s {
+    size_t channels;
+    size_t ranks;
+    size_t banks;
+
+    /* Number of bytes in a row of a bank. */
+    size_t row_size;
+
+    /* Number of bytes transferred by one burst. */
+    size_t burst_size;
+
+    int page_policy;
+
+    /* Column access, activation, precharge, minimum row open time, and burst transfer. */
+    unsigned int t_cas, t_rcd, t_rp, t_ras, t_burst;
+} dram_config_t;
+
+/*
+ * Structure used to store the state of a bank.
+ */
+typedef struct dram_bank_s {
+    bool row_open;
+    uint64_t open_row;
+
+    /* Cycle at which the row was activated, and at which the bank is free. */
+    uint64_t activated_at;
+    uint64_t ready_at;
+} dram_bank_t;
+
+/*
+ * Structure used to store the DRAM.
+ */
+typedef struct dram_s {
+    dram_config_t config;
+
+    /* channels * ranks * banks banks, and the cycle each channel bus is free. */
+    dram_bank_t *banks;
+    uint64_t *bus_free_at;
+
+    /* Statistics about DRAM usage. */
+    uint64_t read_count, write_count, byte_count;
+    uint64_t row_hits, row_empty, row_conflicts;
+    uint64_t total_latency;
+    uint64_t first_request_at, last_done_at;
+} dram_t;
+
+/*
+ * Fill config with a DDR4-like organisation and timings.
+ */
+void dram_config_default(dram_config_t *config);
+
+/*
+ * Create a new DRAM with the given configuration. Returns NULL unless the
+ * numbers of channels, ranks and banks, and the row and burst sizes, are
+ * powers of two.
+ */
+dram_t *dram_new(const dram_config_t *config);
+
+/*
+ * Frees all memory allocated for the given DRAM.
+ */
+void dram_free(dram_t *dram);
+
+/*
+ * Transfer the line_size bytes at address, for a request arriving at cycle
+ * now. Returns the cycle at which the transfer completes.
+ */
+uint64_t dram_access(dram_t *dram, uintptr_t address, size_t line_size, bool is_write, uint64_t now);
+
+/*
+ * Make misses and writebacks of the cache go to the DRAM. The cache does
+ * not own the DRAM, which must be freed after the cache.
+ */
+void cache_attach_dram(cache_t *cache, dram_t *dram);
+
+/*
+ * Print the row buffer hit rate, average latency and bandwidth of the DRAM.
+ */
+void dram_print_stats(FILE *out, dram_t *dram);
+
+#endif
@@ -0,0 +1,185 @@
+#include "events.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sched.h>
+
+/*
+ * Start tracing the events of the cache.
+ */
+int cache_events_init(cache_t *cache, size_t capacity) {
+
+    if (cache->events != NULL) {
+        cache_events_free(cache);
+    }
+
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+
+    cache_events_t *events = (cache_events_t *)calloc(1, sizeof(cache_events_t));
+    if (events == NULL) {
+        return -1;
+    }
+    events->events = (cache_event_t *)malloc(rounded * sizeof(cache_event_t));
+    if (events->events == NULL) {
+        free(events);
+        return -1;
+    }
+    events->capacity = rounded;
+
+    cache->events = events;
+    cache->policies |= CACHE_TRACEPOLICY;
+    return 0;
+}
+
+/*
+ * Stop tracing, and free the ring of a cache.
+ */
+void cache_events_free(cache_t *cache) {
+    if (cache->events->draining) {
+        cache_events_stop_drain(cache);
+    }
+    free(cache->events->events);
+    free(cache->events);
+    cache->events = NULL;
+    cache->policies &= ~CACHE_TRACE_MASK;
+}
+
+/*
+ * Append an event to the ring. When the ring is full, wait for the drain
+ * thread if there is one, and drop the event otherwise.
+ */
+void cache_events_record(cache_t *cache, uint8_t type, size_t set, size_t way, uintptr_t address) {
+
+    cache_events_t *events = cache->events;
+    uint64_t head = events->head;
+    while (head - __atomic_load_n(&events->tail, __ATOMIC_ACQUIRE) == events->capacity) {
+        if (!__atomic_load_n(&events->draining, __ATOMIC_RELAXED)) {
+            events->dropped_count++;
+            return;
+        }
+        sched_yield();
+    }
+
+    cache_event_t *event = events->events + (head & (events->capacity - 1));
+    event->access = cache->access_count;
+    event->address = address & ~cache->block_offset_mask;
+    event->set = set;
+    event->way = way;
+    event->type = type;
+    event->reserved = 0;
+
+    // The event must be complete before the consumer can see it.
+    __atomic_store_n(&events->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Move up to count events out of the ring.
+ */
+size_t cache_events_read(cache_t *cache, cache_event_t *out, size_t count) {
+
+    cache_events_t *events = cache->events;
+    uint64_t tail = events->tail;
+    uint64_t head = __atomic_load_n(&events->head, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    while (tail + n != head && n < count) {
+        out[n] = events->events[(tail + n) & (events->capacity - 1)];
+        n++;
+    }
+    __atomic_store_n(&events->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+/*
+ * Body of the drain thread: write events until asked to stop and the ring
+ * is empty.
+ */
+static void *cache_events_drain(void *arg) {
+
+    cache_events_t *events = (cache_events_t *)arg;
+    struct timespec pause = {0, CACHE_EVENTS_DRAIN_SLEEP * 1000};
+
+    for (;;) {
+        // Read stopping before head: every event recorded before the stop
+        // request is then visible.
+        bool stopping = __atomic_load_n(&events->stopping, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&events->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = events->tail;
+
+        if (head == tail) {
+            if (stopping) {
+                break;
+            }
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        // Write the events up to head, or up to the end of the ring.
+        size_t start = tail & (events->capacity - 1);
+        size_t n = head - tail;
+        if (n > events->capacity - start) {
+            n = events->capacity - start;
+        }
+        if (fwrite(events->events + start, sizeof(cache_event_t), n, events->drain_file) != n) {
+            events->drain_failed = true;
+        }
+        __atomic_store_n(&events->tail, tail + n, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/*
+ * Start a thread appending the events of the ring to a file.
+ */
+int cache_events_start_drain(cache_t *cache, const char *path) {
+
+    cache_events_t *events = cache->events;
+    if (events->draining) {
+        return -1;
+    }
+
+    events->drain_file = fopen(path, "wb");
+    if (events->drain_file == NULL) {
+        return -1;
+    }
+    cache_events_header_t header = {CACHE_EVENTS_MAGIC, CACHE_EVENTS_VERSION, sizeof(cache_event_t)};
+    if (fwrite(&header, sizeof(header), 1, events->drain_file) != 1) {
+        fclose(events->drain_file);
+        return -1;
+    }
+
+    events->stopping = false;
+    events->drain_failed = false;
+    events->draining = true;
+    if (pthread_create(&events->drain_thread, NULL, cache_events_drain, events) != 0) {
+        events->draining = false;
+        fclose(events->drain_file);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Wait for the drain thread to write all events, then stop it.
+ */
+int cache_events_stop_drain(cache_t *cache) {
+
+    cache_events_t *events = cache->events;
+    if (!events->draining) {
+        return -1;
+    }
+
+    __atomic_store_n(&events->stopping, true, __ATOMIC_RELEASE);
+    pthread_join(events->drain_thread, NULL);
+    __atomic_store_n(&events->draining, false, __ATOMIC_RELAXED);
+
+    bool failed = events->drain_failed;
+    if (fclose(events->drain_file) != 0) {
+        failed = true;
+    }
+    events->drain_file = NULL;
+    return failed ? -1 : 0;
+}
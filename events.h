@@ -0,0 +1,133 @@
+/*
+ * events.h
+ *
+ * Per-event tracing of a cache, enabled by CACHE_TRACEPOLICY.
+ *
+ * Events are fixed-size records stored in a preallocated ring buffer. The
+ * thread simulating the cache is the only producer, and a single consumer
+ * empties the ring: either the caller through cache_events_read, or a
+ * background thread started by cache_events_start_drain that appends the
+ * events to a file. Producer and consumer only share the head and tail
+ * counters, so no lock is needed.
+ *
+ * Without CACHE_TRACEPOLICY, the cost of tracing is a test of a policy bit
+ * per access.
+ */
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include "cache.h"
+#include <pthread.h>
+
+#define CACHE_EVENTS_MAGIC   0x54564543 /* "CEVT" */
+#define CACHE_EVENTS_VERSION 1
+
+/*
+ * Number of events in the ring of a cache created with CACHE_TRACEPOLICY.
+ */
+#define CACHE_EVENTS_DEFAULT_CAPACITY 65536
+
+/*
+ * Microseconds the drain thread sleeps when the ring is empty.
+ */
+#define CACHE_EVENTS_DRAIN_SLEEP 100
+
+/*
+ * Types of events. Every access gives a hit or a miss; a miss is followed
+ * by the eviction and write back of its victim, if any, and by its fill.
+ */
+#define CACHE_EVENT_HIT       1
+#define CACHE_EVENT_MISS      2
+#define CACHE_EVENT_FILL      3
+#define CACHE_EVENT_EVICT     4
+#define CACHE_EVENT_WRITEBACK 5
+
+/*
+ * Way of events that do not concern a single line.
+ */
+#define CACHE_EVENT_NO_WAY UINT16_MAX
+
+/*
+ * Structure used to store an event. access is the number of the access
+ * that caused it, starting at 1, and address is the address of the line.
+ */
+typedef struct cache_event_s {
+    uint64_t access;
+    uint64_t address;
+    uint32_t set;
+    uint16_t way;
+    uint8_t type;
+    uint8_t reserved;
+} cache_event_t;
+
+/*
+ * Header at the start of a file written by the drain thread, followed by
+ * the events.
+ */
+typedef struct cache_events_header_s {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t event_size;
+} cache_events_header_t;
+
+/*
+ * Structure used to store the ring of events of a cache. head and tail
+ * count the events written and consumed since the start, and live on
+ * different cache lines so that the producer and consumer do not share one.
+ */
+typedef struct cache_events_s {
+    cache_event_t *events;
+    size_t capacity;
+
+    uint64_t head;
+    uint8_t head_padding[64 - sizeof(uint64_t)];
+    uint64_t tail;
+    uint8_t tail_padding[64 - sizeof(uint64_t)];
+
+    /* Events lost because the ring was full and nothing drained it. */
+    uint64_t dropped_count;
+
+    /* Drain thread, the file it writes to, and whether it should stop. */
+    pthread_t drain_thread;
+    FILE *drain_file;
+    bool draining;
+    bool stopping;
+    bool drain_failed;
+} cache_events_t;
+
+/*
+ * Start tracing the events of the cache in a ring of at least capacity
+ * events, rounded up to a power of two. Returns 0 on success and -1 on failure.
+ */
+int cache_events_init(cache_t *cache, size_t capacity);
+
+/*
+ * Stop tracing, and free the ring of a cache. The drain thread is stopped
+ * first, if there is one.
+ */
+void cache_events_free(cache_t *cache);
+
+/*
+ * Start a thread appending the events of the ring to a file at path.
+ * Returns 0 on success and -1 on failure.
+ */
+int cache_events_start_drain(cache_t *cache, const char *path);
+
+/*
+ * Wait for the drain thread to write all the events traced so far, then
+ * stop it and close its file. Returns 0 on success and -1 if any write failed.
+ */
+int cache_events_stop_drain(cache_t *cache);
+
+/*
+ * Move up to count events out of the ring, and return how many were moved.
+ * This must not be used while a drain thread runs.
+ */
+size_t cache_events_read(cache_t *cache, cache_event_t *events, size_t count);
+
+/*
+ *  Helpers used by cache_read
+ */
+void cache_events_record(cache_t *cache, uint8_t type, size_t set, size_t way, uintptr_t address);
+
+#endif
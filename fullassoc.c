@@ -0,0 +1,208 @@
+#include "fullassoc.h"
+#include "replacement.h"
+#include <stdlib.h>
+
+/*
+ * Return the lines of the single set of a cache, by way.
+ */
+static inline cache_line_t *cache_fully_associative_lines(cache_t *cache) {
+    return cache->sets[0].lines + cache->sets[0].first_index;
+}
+
+/*
+ * Return the slot of the table where the search for a tag starts.
+ */
+static inline size_t cache_fully_associative_slot(cache_fully_associative_t *index, uintptr_t tag) {
+    return (size_t)(((uint64_t) tag * 0x9E3779B97F4A7C15ULL) >> index->table_shift);
+}
+
+static void cache_fully_associative_insert(cache_fully_associative_t *index, cache_line_t *lines, uint32_t way) {
+    size_t i = cache_fully_associative_slot(index, lines[way].tag);
+    while (index->table[i] != 0) {
+        i = (i + 1) & index->table_mask;
+    }
+    index->table[i] = way + 1;
+}
+
+/*
+ * Remove a way from the table. The ways after it in its run of full slots
+ * move back into the hole when their search starts at or before it, so
+ * that searches still find them without tombstones.
+ */
+static void cache_fully_associative_remove(cache_fully_associative_t *index, cache_line_t *lines, uint32_t way) {
+    size_t hole = cache_fully_associative_slot(index, lines[way].tag);
+    while (index->table[hole] != way + 1) {
+        hole = (hole + 1) & index->table_mask;
+    }
+    for (size_t i = (hole + 1) & index->table_mask; index->table[i] != 0; i = (i + 1) & index->table_mask) {
+        size_t start = cache_fully_associative_slot(index, lines[index->table[i] - 1].tag);
+        if (((i - start) & index->table_mask) >= ((i - hole) & index->table_mask)) {
+            index->table[hole] = index->table[i];
+            hole = i;
+        }
+    }
+    index->table[hole] = 0;
+}
+
+/*
+ * Move a way to the MRU end of the list.
+ */
+static void cache_fully_associative_make_mru(cache_fully_associative_t *index, uint32_t way) {
+    if (way == index->mru) {
+        return;
+    }
+    if (way == index->lru) {
+        index->lru = index->next[way];
+    } else {
+        index->next[index->prev[way]] = index->next[way];
+    }
+    index->prev[index->next[way]] = index->prev[way];
+
+    index->prev[way] = index->mru;
+    index->next[way] = CACHE_FULLY_ASSOCIATIVE_NO_WAY;
+    index->next[index->mru] = way;
+    index->mru = way;
+}
+
+/*
+ * Index a fully associative LRU cache.
+ */
+int cache_fully_associative_init(cache_t *cache) {
+
+    if (cache->num_sets != 1 || cache->associativity >= CACHE_FULLY_ASSOCIATIVE_NO_WAY
+        || cache->replacement != cache_replacement_builtin(CACHE_REPLACEMENTPOLICY_LRU)
+        || cache->partition != NULL || cache->compression != NULL) {
+        return -1;
+    }
+
+    // The victim is the invalid line closest to mru, found in constant time
+    // only if the invalid lines come first.
+    cache_set_t *cache_set = cache->sets;
+    cache_line_t *lines = cache_fully_associative_lines(cache);
+    size_t num_invalid = 0;
+    while (num_invalid < cache->associativity && !lines[cache_set->lru_list[num_invalid]].is_valid) {
+        num_invalid++;
+    }
+    for (size_t i = num_invalid; i < cache->associativity; i++) {
+        if (!lines[cache_set->lru_list[i]].is_valid) {
+            return -1;
+        }
+    }
+
+    if (cache->fully_associative != NULL) {
+        cache_fully_associative_free(cache);
+    }
+
+    // Keep the table at most half full.
+    size_t table_size = 2;
+    unsigned int table_shift = 63;
+    while (table_size < 2 * cache->associativity) {
+        table_size *= 2;
+        table_shift--;
+    }
+
+    cache_fully_associative_t *index = (cache_fully_associative_t *)malloc(sizeof(cache_fully_associative_t));
+    index->table = (uint32_t *)calloc(table_size, sizeof(uint32_t));
+    index->table_mask = table_size - 1;
+    index->table_shift = table_shift;
+    index->prev = (uint32_t *)malloc(cache->associativity * sizeof(uint32_t));
+    index->next = (uint32_t *)malloc(cache->associativity * sizeof(uint32_t));
+
+    for (size_t i = 0; i < cache->associativity; i++) {
+        uint32_t way = cache_set->lru_list[i];
+        index->prev[way] = i > 0 ? cache_set->lru_list[i - 1] : CACHE_FULLY_ASSOCIATIVE_NO_WAY;
+        index->next[way] = i + 1 < cache->associativity ? cache_set->lru_list[i + 1] : CACHE_FULLY_ASSOCIATIVE_NO_WAY;
+        if (lines[way].is_valid) {
+            cache_fully_associative_insert(index, lines, way);
+        }
+    }
+    index->lru = cache_set->lru_list[0];
+    index->mru = cache_set->lru_list[cache->associativity - 1];
+    index->num_invalid = num_invalid;
+    index->last_invalid = num_invalid > 0 ? cache_set->lru_list[num_invalid - 1] : CACHE_FULLY_ASSOCIATIVE_NO_WAY;
+
+    cache->fully_associative = index;
+    return 0;
+}
+
+/*
+ * Write the LRU order back to the lru_list, and drop the index.
+ */
+void cache_fully_associative_disable(cache_t *cache) {
+    cache_fully_associative_sync(cache);
+    cache_fully_associative_free(cache);
+}
+
+/*
+ * Frees the index of a cache.
+ */
+void cache_fully_associative_free(cache_t *cache) {
+    cache_fully_associative_t *index = cache->fully_associative;
+    free(index->table);
+    free(index->prev);
+    free(index->next);
+    free(index);
+    cache->fully_associative = NULL;
+}
+
+/*
+ * Write the LRU order back to the lru_list.
+ */
+void cache_fully_associative_sync(cache_t *cache) {
+    cache_fully_associative_t *index = cache->fully_associative;
+    size_t i = 0;
+    for (uint32_t way = index->lru; way != CACHE_FULLY_ASSOCIATIVE_NO_WAY; way = index->next[way]) {
+        cache->sets[0].lru_list[i++] = way;
+    }
+}
+
+/*
+ * Return the valid line with the given tag, made most recently used.
+ */
+cache_line_t *cache_fully_associative_lookup(cache_t *cache, uintptr_t tag) {
+    cache_fully_associative_t *index = cache->fully_associative;
+    cache_line_t *lines = cache_fully_associative_lines(cache);
+    for (size_t i = cache_fully_associative_slot(index, tag); index->table[i] != 0; i = (i + 1) & index->table_mask) {
+        uint32_t way = index->table[i] - 1;
+        if (lines[way].tag == tag) {
+            cache_fully_associative_make_mru(index, way);
+            return lines + way;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Return the line to fill next: the invalid line closest to mru if there
+ * is one, as for cache_set_lru_victim, otherwise the least recently used.
+ */
+cache_line_t *cache_fully_associative_victim(cache_t *cache) {
+    cache_fully_associative_t *index = cache->fully_associative;
+    cache_line_t *lines = cache_fully_associative_lines(cache);
+    uint32_t way;
+    if (index->num_invalid > 0) {
+        way = index->last_invalid;
+        index->last_invalid = index->prev[way];
+        index->num_invalid--;
+    } else {
+        way = index->lru;
+        cache_fully_associative_remove(index, lines, way);
+    }
+    cache_fully_associative_make_mru(index, way);
+    return lines + way;
+}
+
+/*
+ * Add a line just filled to the table.
+ */
+void cache_fully_associative_fill(cache_t *cache, cache_line_t *line) {
+    cache_line_t *lines = cache_fully_associative_lines(cache);
+    cache_fully_associative_insert(cache->fully_associative, lines, line - lines);
+}
+
+/*
+ * Return whether a line is the most recently used one.
+ */
+bool cache_fully_associative_is_mru(cache_t *cache, cache_line_t *line) {
+    return line - cache_fully_associative_lines(cache) == cache->fully_associative->mru;
+}
@@ -0,0 +1,103 @@
+/*
+ * fullassoc.h
+ *
+ * Fully associative LRU caches indexed by tag.
+ *
+ * In a cache with a single set, finding a line scans every way, and LRU
+ * moves a line to the MRU end of the lru_list by shifting every line after
+ * it: both take time proportional to the number of lines, which makes TLBs
+ * and the fully associative caches of 3C analysis, with tens of thousands
+ * of lines, slow to simulate. Instead, an open-addressing hash table maps
+ * the tag of each valid line to its way, and the LRU order is a doubly
+ * linked list threaded through the ways, so that hits and fills take
+ * constant time.
+ *
+ * cache_new indexes LRU caches with a single set of at least
+ * CACHE_FULLY_ASSOCIATIVE_MIN_WAYS ways. The list keeps the order of the
+ * lru_list, invalid lines included, so the cache chooses the same victims
+ * as without the index. The lru_list itself is only brought up to date
+ * when it is read, by checkpoints, and the index is dropped when the cache
+ * stops being a plain LRU cache: when another policy is installed, when
+ * its lines are compressed, or when a line is invalidated.
+ */
+#ifndef FULLASSOC_H
+#define FULLASSOC_H
+
+#include "cache.h"
+
+/*
+ * Smallest number of ways worth indexing. Smaller sets are scanned faster
+ * than they are hashed.
+ */
+#define CACHE_FULLY_ASSOCIATIVE_MIN_WAYS 128
+
+/*
+ * Way used for "no way" in the list.
+ */
+#define CACHE_FULLY_ASSOCIATIVE_NO_WAY UINT32_MAX
+
+/*
+ * Structure used to store the index of a fully associative cache.
+ */
+typedef struct cache_fully_associative_s {
+    /* Open-addressing table of way + 1 by tag, 0 for an empty slot, probed
+     * linearly from the slot the hash of a tag selects. */
+    uint32_t *table;
+    size_t table_mask;
+    unsigned int table_shift;
+
+    /* Ways in LRU order, from lru to mru. */
+    uint32_t *prev, *next;
+    uint32_t lru, mru;
+
+    /* Invalid ways, which are the first ones of the list from lru, and the
+     * last of them, which is filled first. */
+    size_t num_invalid;
+    uint32_t last_invalid;
+} cache_fully_associative_t;
+
+/*
+ * Index a fully associative LRU cache, whose lru_list and lines give the
+ * current state. Returns 0 on success and -1 if the cache cannot be
+ * indexed.
+ */
+int cache_fully_associative_init(cache_t *cache);
+
+/*
+ * Write the LRU order back to the lru_list, and drop the index.
+ */
+void cache_fully_associative_disable(cache_t *cache);
+
+/*
+ * Frees the index of a cache, leaving its lru_list as it is.
+ */
+void cache_fully_associative_free(cache_t *cache);
+
+/*
+ * Write the LRU order back to the lru_list.
+ */
+void cache_fully_associative_sync(cache_t *cache);
+
+/*
+ * Return the valid line with the given tag, made most recently used, or
+ * NULL if there is none.
+ */
+cache_line_t *cache_fully_associative_lookup(cache_t *cache, uintptr_t tag);
+
+/*
+ * Return the line to fill next, made most recently used and removed from
+ * the table.
+ */
+cache_line_t *cache_fully_associative_victim(cache_t *cache);
+
+/*
+ * Add a line just filled to the table.
+ */
+void cache_fully_associative_fill(cache_t *cache, cache_line_t *line);
+
+/*
+ * Return whether a line is the most recently used one.
+ */
+bool cache_fully_associative_is_mru(cache_t *cache, cache_line_t *line);
+
+#endif
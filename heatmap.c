@@ -0,0 +1,131 @@
+#include "heatmap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * Number of hottest sets listed after the heatmap.
+ */
+#define CACHE_HEATMAP_TOP_SETS 8
+
+/*
+ * Register an array with the cache.
+ */
+void cache_region_register(cache_t *cache, const char *name, uintptr_t base, size_t row_size, size_t num_rows) {
+    cache->regions = (cache_region_t *)realloc(cache->regions, (cache->num_regions + 1) * sizeof(cache_region_t));
+    cache_region_t *region = cache->regions + cache->num_regions++;
+    region->name = name;
+    region->base = base;
+    region->row_size = row_size;
+    region->num_rows = num_rows;
+}
+
+/*
+ * Return the number of different sets a column walk of the array touches.
+ */
+size_t cache_region_sets_touched(cache_t *cache, const cache_region_t *region, size_t row_size) {
+
+    bool *touched = (bool *)calloc(cache->num_sets, sizeof(bool));
+    size_t count = 0;
+    for (size_t i = 0; i < region->num_rows; i++) {
+        uintptr_t address = region->base + i * row_size;
+        size_t index = (cache->cache_index_mask & address) >> cache->cache_index_shift;
+        if (!touched[index]) {
+            touched[index] = true;
+            count++;
+        }
+    }
+    free(touched);
+    return count;
+}
+
+/*
+ * Return the smallest padding, in lines, that spreads a column walk best.
+ */
+size_t cache_region_padding(cache_t *cache, const cache_region_t *region) {
+
+    size_t best_padding = 0;
+    size_t best = cache_region_sets_touched(cache, region, region->row_size);
+    size_t most = region->num_rows < cache->num_sets ? region->num_rows : cache->num_sets;
+
+    for (size_t lines = 1; lines < cache->num_sets && best < most; lines++) {
+        size_t padding = lines * cache->line_size;
+        size_t touched = cache_region_sets_touched(cache, region, region->row_size + padding);
+        if (touched > best) {
+            best = touched;
+            best_padding = padding;
+        }
+    }
+    return best_padding;
+}
+
+static int compare_sets(const void *a, const void *b) {
+    const cache_set_t *x = *(const cache_set_t **)a, *y = *(const cache_set_t **)b;
+    if (x->miss_count != y->miss_count) {
+        return x->miss_count < y->miss_count ? 1 : -1;
+    }
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Print a heatmap of the misses of every set, the hottest sets, and
+ * padding advice for registered arrays.
+ */
+void cache_heatmap_print(FILE *out, cache_t *cache, size_t width) {
+
+    uint64_t max_misses = 0, total_misses = 0;
+    size_t cold_sets = 0;
+    for (size_t i = 0; i < cache->num_sets; i++) {
+        uint64_t misses = cache->sets[i].miss_count;
+        total_misses += misses;
+        if (misses > max_misses) {
+            max_misses = misses;
+        }
+        if (misses == 0) {
+            cold_sets++;
+        }
+    }
+
+    // One character per set, scaled to the hottest set.
+    size_t num_levels = strlen(CACHE_HEATMAP_LEVELS);
+    for (size_t i = 0; i < cache->num_sets; i++) {
+        if (i % width == 0) {
+            fprintf(out, "%6zu |", i);
+        }
+        uint64_t misses = cache->sets[i].miss_count;
+        size_t level = max_misses == 0 ? 0 : (misses * (num_levels - 1) + max_misses - 1) / max_misses;
+        fputc(CACHE_HEATMAP_LEVELS[level], out);
+        if (i % width == width - 1 || i == cache->num_sets - 1) {
+            fprintf(out, "|\n");
+        }
+    }
+
+    double mean = (double) total_misses / cache->num_sets;
+    fprintf(out, "Sets without misses = %zu of %zu, hottest/mean misses = %.2f\n", cold_sets, cache->num_sets,
+            mean == 0 ? 0.0 : max_misses / mean);
+
+    cache_set_t **ranked = (cache_set_t **)malloc(cache->num_sets * sizeof(cache_set_t *));
+    for (size_t i = 0; i < cache->num_sets; i++) {
+        ranked[i] = cache->sets + i;
+    }
+    qsort(ranked, cache->num_sets, sizeof(cache_set_t *), compare_sets);
+    for (size_t i = 0; i < cache->num_sets && i < CACHE_HEATMAP_TOP_SETS && ranked[i]->miss_count > 0; i++) {
+        fprintf(out, "Set %6zu: accesses = %10" PRIu64 ", misses = %10" PRIu64 ", evictions = %10" PRIu64 "\n",
+                (size_t)(ranked[i] - cache->sets), ranked[i]->access_count, ranked[i]->miss_count,
+                ranked[i]->eviction_count);
+    }
+    free(ranked);
+
+    for (size_t i = 0; i < cache->num_regions; i++) {
+        cache_region_t *region = cache->regions + i;
+        size_t touched = cache_region_sets_touched(cache, region, region->row_size);
+        size_t padding = cache_region_padding(cache, region);
+        fprintf(out, "Array %s: a column walk touches %zu sets", region->name, touched);
+        if (padding == 0) {
+            fprintf(out, ", no padding needed\n");
+        } else {
+            fprintf(out, "; pad each row by %zu bytes to touch %zu sets\n", padding,
+                    cache_region_sets_touched(cache, region, region->row_size + padding));
+        }
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * heatmap.h
+ *
+ * Per-set heatmap of a cache, and padding advice for arrays whose rows map
+ * to too few sets.
+ *
+ * Walking a column of a 2D array touches one line per row, row_size bytes
+ * apart. When row_size is a multiple of a large power of two, those lines
+ * all fall into a handful of sets and conflict with each other, however
+ * large the cache is. Padding each row by a few lines spreads them back
+ * over all the sets.
+ */
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "cache.h"
+
+/*
+ * Characters used for the heatmap, from coldest to hottest.
+ */
+#define CACHE_HEATMAP_LEVELS " .:-=+*#%@"
+
+/*
+ * Structure used to describe a 2D array: num_rows rows of row_size bytes
+ * starting at base.
+ */
+typedef struct cache_region_s {
+    const char *name;
+    uintptr_t base;
+    size_t row_size;
+    size_t num_rows;
+} cache_region_t;
+
+/*
+ * Register an array with the cache, so that cache_heatmap_print gives
+ * padding advice for it.
+ */
+void cache_region_register(cache_t *cache, const char *name, uintptr_t base, size_t row_size, size_t num_rows);
+
+/*
+ * Return the number of different sets a column walk of the array touches
+ * if its rows are row_size bytes apart.
+ */
+size_t cache_region_sets_touched(cache_t *cache, const cache_region_t *region, size_t row_size);
+
+/*
+ * Return the smallest number of bytes to add to each row of the array so
+ * that a column walk touches as many sets as possible.
+ */
+size_t cache_region_padding(cache_t *cache, const cache_region_t *region);
+
+/*
+ * Print a heatmap of the misses of every set, width sets per line,
+ * followed by the hottest sets and padding advice for registered arrays.
+ */
+void cache_heatmap_print(FILE *out, cache_t *cache, size_t width);
+
+#endif
@@ -0,0 +1,76 @@
+#include "cache.h"
+#include "heatmap.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Replay a trace through a cache and print the misses of every set, with
+ * padding advice for the arrays given on the command line.
+ *
+ * Usage: heatmap TRACE BYTES BLOCK ASSOCIATIVITY [NAME:BASE:ROW_SIZE:ROWS]...
+ */
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s TRACE BYTES BLOCK ASSOCIATIVITY [NAME:BASE:ROW_SIZE:ROWS]...\n", program);
+}
+
+/*
+ * Parse and register an array given as NAME:BASE:ROW_SIZE:ROWS. Returns 0
+ * on success and -1 on failure.
+ */
+static int register_region(cache_t *cache, char *arg) {
+
+    char *name = strtok(arg, ":");
+    char *base = strtok(NULL, ":");
+    char *row_size = strtok(NULL, ":");
+    char *rows = strtok(NULL, ":");
+    if (name == NULL || base == NULL || row_size == NULL || rows == NULL) {
+        return -1;
+    }
+
+    cache_region_register(cache, name, (uintptr_t) strtoull(base, NULL, 0),
+                          strtoull(row_size, NULL, 0), strtoull(rows, NULL, 0));
+    return 0;
+}
+
+int main(int argc, char **argv) {
+
+    if (argc < 5) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t num_bytes = strtoull(argv[2], NULL, 0);
+    size_t block_size = strtoull(argv[3], NULL, 0);
+    size_t associativity = strtoull(argv[4], NULL, 0);
+    cache_t *cache = cache_new(num_bytes, block_size, associativity,
+                               CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    if (cache == NULL) {
+        fprintf(stderr, "Lines must hold 8 bytes or more\n");
+        return 1;
+    }
+
+    for (int i = 5; i < argc; i++) {
+        if (register_region(cache, argv[i]) != 0) {
+            usage(argv[0]);
+            cache_free(cache);
+            return 1;
+        }
+    }
+
+    if (trace_replay(cache, argv[1]) != 0) {
+        fprintf(stderr, "Could not read trace %s\n", argv[1]);
+        cache_free(cache);
+        return 1;
+    }
+
+    size_t ac = cache_access_count(cache);
+    size_t mc = cache_miss_count(cache);
+    printf("Miss rate = %8.4f\n", ac == 0 ? 0.0 : (double) mc / ac);
+    cache_heatmap_print(stdout, cache, 64);
+
+    cache_free(cache);
+    return 0;
+}
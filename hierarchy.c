@@ -0,0 +1,491 @@
+#include "hierarchy.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sched.h>
+
+/*
+ * Create a hierarchy of the given caches.
+ */
+cache_hierarchy_t *cache_hierarchy_new(size_t num_levels, cache_t **levels) {
+
+    if (num_levels == 0 || num_levels > CACHE_HIERARCHY_MAX_LEVELS) {
+        return NULL;
+    }
+
+    cache_hierarchy_t *hierarchy = (cache_hierarchy_t *)calloc(1, sizeof(cache_hierarchy_t));
+    hierarchy->num_levels = num_levels;
+    for (size_t i = 0; i < num_levels; i++) {
+        hierarchy->levels[i] = levels[i];
+    }
+
+    unsigned int latencies[CACHE_HIERARCHY_MAX_LEVELS] = CACHE_HIERARCHY_DEFAULT_LATENCIES;
+    cache_hierarchy_set_latencies(hierarchy, latencies, CACHE_HIERARCHY_DEFAULT_MEMORY_LATENCY);
+    return hierarchy;
+}
+
+/*
+ * Give the hierarchy a separate instruction cache.
+ */
+int cache_hierarchy_split(cache_hierarchy_t *hierarchy, cache_t *instruction_cache) {
+    if (hierarchy->instruction_cache != NULL || hierarchy->pipelined) {
+        return -1;
+    }
+    hierarchy->instruction_cache = instruction_cache;
+    return 0;
+}
+
+/*
+ * Set the latency of each level and of memory.
+ */
+void cache_hierarchy_set_latencies(cache_hierarchy_t *hierarchy, const unsigned int *latencies,
+                                   unsigned int memory_latency) {
+    for (size_t i = 0; i < hierarchy->num_levels; i++) {
+        hierarchy->latencies[i] = latencies[i];
+    }
+    hierarchy->memory_latency = memory_latency;
+}
+
+/*
+ * Frees the hierarchy and its caches.
+ */
+void cache_hierarchy_free(cache_hierarchy_t *hierarchy) {
+    for (size_t i = 0; i < hierarchy->num_levels; i++) {
+        cache_free(hierarchy->levels[i]);
+    }
+    if (hierarchy->instruction_cache != NULL) {
+        cache_free(hierarchy->instruction_cache);
+    }
+    free(hierarchy);
+}
+
+/*
+ * Access an address in a cache, and return whether it missed.
+ */
+static bool cache_access_missed(cache_t *cache, uintptr_t address, int type, func_t generate_random_number,
+                                uint64_t *value) {
+    uint64_t miss_count = cache->miss_count;
+    *value = cache_access(cache, address, type, generate_random_number);
+    return cache->miss_count != miss_count;
+}
+
+/*
+ * Return whether an access goes on from a cache to the level below: a
+ * miss, unless it is a writeback that filled its line without reading it,
+ * or a write to a write-through cache.
+ */
+static inline bool cache_access_passes(cache_t *cache, int type, bool missed) {
+    bool write = type >= CACHE_ACCESS_STORE;
+    if (write && !(cache->policies & CACHE_WRITEPOLICY_WRITEBACK)) {
+        return true;
+    }
+    return missed && (type != CACHE_ACCESS_WRITEBACK || (cache->policies & CACHE_WRITEPOLICY_WRITENOALLOCATE));
+}
+
+/*
+ * Return the cache of the first level that serves accesses of a type.
+ */
+static inline cache_t *cache_hierarchy_first(cache_hierarchy_t *hierarchy, int type) {
+    if (type == CACHE_ACCESS_IFETCH && hierarchy->instruction_cache != NULL) {
+        return hierarchy->instruction_cache;
+    }
+    return hierarchy->levels[0];
+}
+
+/*
+ * Write an access leaving the last level to the filter trace, if any.
+ */
+static inline void cache_hierarchy_filter(cache_hierarchy_t *hierarchy, uintptr_t address, int type) {
+    if (hierarchy->filter != NULL) {
+        uint64_t line_size = hierarchy->levels[hierarchy->num_levels - 1]->line_size;
+        trace_write(hierarchy->filter, (address & ~(line_size - 1)) | (uint64_t)type);
+    }
+}
+
+static void cache_hierarchy_pass(cache_hierarchy_t *hierarchy, size_t level, uintptr_t address, int type,
+                                 func_t generate_random_number);
+
+/*
+ * Access a cache of the given level, then pass its miss, and the dirty
+ * lines it evicted, to the level below.
+ */
+static uint64_t cache_hierarchy_visit(cache_hierarchy_t *hierarchy, size_t level, cache_t *cache,
+                                      uintptr_t address, int type, func_t generate_random_number) {
+    uint64_t value;
+    bool missed = cache_access_missed(cache, address, type, generate_random_number, &value);
+    if (cache_access_passes(cache, type, missed)) {
+        cache_hierarchy_pass(hierarchy, level + 1, address, type, generate_random_number);
+    }
+    for (size_t i = 0; i < cache->num_writebacks; i++) {
+        cache_hierarchy_pass(hierarchy, level + 1, cache->writebacks[i], CACHE_ACCESS_WRITEBACK,
+                             generate_random_number);
+    }
+    return value;
+}
+
+/*
+ * Pass an access to the given level, or to the filter below the last one.
+ */
+static void cache_hierarchy_pass(cache_hierarchy_t *hierarchy, size_t level, uintptr_t address, int type,
+                                 func_t generate_random_number) {
+    if (level < hierarchy->num_levels) {
+        cache_hierarchy_visit(hierarchy, level, hierarchy->levels[level], address, type, generate_random_number);
+    } else {
+        cache_hierarchy_filter(hierarchy, address, type);
+    }
+}
+
+/*
+ * Read a single uint64_t integer through the hierarchy.
+ */
+uint64_t cache_hierarchy_read(cache_hierarchy_t *hierarchy, uintptr_t address, func_t generate_random_number) {
+    return cache_hierarchy_access(hierarchy, address, CACHE_ACCESS_LOAD, generate_random_number);
+}
+
+/*
+ * Access a single uint64_t integer through the hierarchy.
+ */
+uint64_t cache_hierarchy_access(cache_hierarchy_t *hierarchy, uintptr_t address, int type,
+                                func_t generate_random_number) {
+    if (type < 0 || type >= CACHE_ACCESS_TYPES) {
+        return 0;
+    }
+    return cache_hierarchy_visit(hierarchy, 0, cache_hierarchy_first(hierarchy, type), address, type,
+                                 generate_random_number);
+}
+
+static cache_queue_t *cache_queue_new(size_t capacity) {
+    size_t rounded = 1;
+    while (rounded < capacity || rounded < CACHE_QUEUE_BATCH) {
+        rounded *= 2;
+    }
+
+    cache_queue_t *queue = (cache_queue_t *)calloc(1, sizeof(cache_queue_t));
+    queue->addresses = (uint64_t *)malloc(rounded * sizeof(uint64_t));
+    queue->capacity = rounded;
+    return queue;
+}
+
+static void cache_queue_free(cache_queue_t *queue) {
+    free(queue->addresses);
+    free(queue);
+}
+
+/*
+ * Append an address to a queue, waiting for room if it is full. Addresses
+ * are made visible to the consumer CACHE_QUEUE_BATCH at a time.
+ */
+static void cache_queue_push(cache_queue_t *queue, uint64_t address) {
+
+    if (queue->producer_head - queue->producer_tail == queue->capacity) {
+        __atomic_store_n(&queue->head, queue->producer_head, __ATOMIC_RELEASE);
+        queue->producer_tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        while (queue->producer_head - queue->producer_tail == queue->capacity) {
+            sched_yield();
+            queue->producer_tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    queue->addresses[queue->producer_head & (queue->capacity - 1)] = address;
+    queue->producer_head++;
+    if (queue->producer_head % CACHE_QUEUE_BATCH == 0) {
+        __atomic_store_n(&queue->head, queue->producer_head, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Publish the addresses left in a queue, and tell the consumer no more will come.
+ */
+static void cache_queue_close(cache_queue_t *queue) {
+    __atomic_store_n(&queue->head, queue->producer_head, __ATOMIC_RELEASE);
+    __atomic_store_n(&queue->closed, true, __ATOMIC_RELEASE);
+}
+
+/*
+ * Queue an access leaving a level for the level below, or write it to the
+ * filter below the last one. Lines are larger than 4 bytes, so clearing the
+ * low bits of the address keeps the line.
+ */
+static void cache_hierarchy_push(cache_hierarchy_t *hierarchy, cache_queue_t *out, uint64_t address, int type) {
+    if (out != NULL) {
+        cache_queue_push(out, (address & ~CACHE_QUEUE_TYPE_MASK) | (uint64_t)type);
+    } else {
+        cache_hierarchy_filter(hierarchy, address, type);
+    }
+}
+
+/*
+ * Access a level on the thread that owns it, then queue its miss, and the
+ * dirty lines it evicted, for the level below.
+ */
+static uint64_t cache_stage_access(cache_hierarchy_t *hierarchy, cache_t *cache, cache_queue_t *out,
+                                   uintptr_t address, int type, func_t generate_random_number) {
+    uint64_t value;
+    bool missed = cache_access_missed(cache, address, type, generate_random_number, &value);
+    if (cache_access_passes(cache, type, missed)) {
+        cache_hierarchy_push(hierarchy, out, address, type);
+    }
+    for (size_t i = 0; i < cache->num_writebacks; i++) {
+        cache_hierarchy_push(hierarchy, out, cache->writebacks[i], CACHE_ACCESS_WRITEBACK);
+    }
+    return value;
+}
+
+/*
+ * Structure passed to the thread of a level.
+ */
+typedef struct cache_stage_s {
+    cache_hierarchy_t *hierarchy;
+    size_t level;
+} cache_stage_t;
+
+/*
+ * Body of the thread of a level: read the misses of the level above until
+ * its queue is closed, and queue the misses for the level below.
+ */
+static void *cache_stage_run(void *arg) {
+
+    cache_stage_t *stage = (cache_stage_t *)arg;
+    cache_hierarchy_t *hierarchy = stage->hierarchy;
+    cache_t *cache = hierarchy->levels[stage->level];
+    cache_queue_t *in = hierarchy->queues[stage->level - 1];
+    cache_queue_t *out = stage->level + 1 < hierarchy->num_levels ? hierarchy->queues[stage->level] : NULL;
+    free(stage);
+
+    for (;;) {
+        if (in->consumer_tail == in->consumer_head) {
+            // Read closed before head: addresses published before the queue
+            // was closed are then visible.
+            bool closed = __atomic_load_n(&in->closed, __ATOMIC_ACQUIRE);
+            in->consumer_head = __atomic_load_n(&in->head, __ATOMIC_ACQUIRE);
+            if (in->consumer_tail == in->consumer_head) {
+                if (closed) {
+                    break;
+                }
+                sched_yield();
+                continue;
+            }
+        }
+
+        uint64_t entry = in->addresses[in->consumer_tail & (in->capacity - 1)];
+        cache_stage_access(hierarchy, cache, out, entry & ~CACHE_QUEUE_TYPE_MASK, (int)(entry & CACHE_QUEUE_TYPE_MASK),
+                           rand);
+        in->consumer_tail++;
+        if (in->consumer_tail % CACHE_QUEUE_BATCH == 0 || in->consumer_tail == in->consumer_head) {
+            __atomic_store_n(&in->tail, in->consumer_tail, __ATOMIC_RELEASE);
+        }
+    }
+
+    if (out != NULL) {
+        cache_queue_close(out);
+    }
+    return NULL;
+}
+
+/*
+ * Start a thread for every level but the first.
+ */
+int cache_hierarchy_start_pipeline(cache_hierarchy_t *hierarchy, size_t capacity) {
+
+    if (hierarchy->pipelined) {
+        return -1;
+    }
+
+    for (size_t i = 0; i + 1 < hierarchy->num_levels; i++) {
+        hierarchy->queues[i] = cache_queue_new(capacity);
+    }
+    for (size_t i = 1; i < hierarchy->num_levels; i++) {
+        cache_stage_t *stage = (cache_stage_t *)malloc(sizeof(cache_stage_t));
+        stage->hierarchy = hierarchy;
+        stage->level = i;
+        if (pthread_create(&hierarchy->threads[i], NULL, cache_stage_run, stage) != 0) {
+            // Stop the threads already started; they see an empty queue.
+            free(stage);
+            cache_queue_close(hierarchy->queues[0]);
+            for (size_t j = 1; j < i; j++) {
+                pthread_join(hierarchy->threads[j], NULL);
+            }
+            for (size_t j = 0; j + 1 < hierarchy->num_levels; j++) {
+                cache_queue_free(hierarchy->queues[j]);
+                hierarchy->queues[j] = NULL;
+            }
+            return -1;
+        }
+    }
+
+    hierarchy->pipelined = true;
+    return 0;
+}
+
+/*
+ * Read through the first level, and queue a miss for the next level.
+ */
+uint64_t cache_hierarchy_read_pipelined(cache_hierarchy_t *hierarchy, uintptr_t address, func_t generate_random_number) {
+    return cache_hierarchy_access_pipelined(hierarchy, address, CACHE_ACCESS_LOAD, generate_random_number);
+}
+
+/*
+ * Access through the first level, and queue a miss for the next level.
+ */
+uint64_t cache_hierarchy_access_pipelined(cache_hierarchy_t *hierarchy, uintptr_t address, int type,
+                                          func_t generate_random_number) {
+    // An unknown type would not fit in the bits a queue keeps for it.
+    if (type < 0 || type >= CACHE_ACCESS_TYPES) {
+        return 0;
+    }
+    return cache_stage_access(hierarchy, cache_hierarchy_first(hierarchy, type), hierarchy->queues[0], address, type,
+                              generate_random_number);
+}
+
+/*
+ * Wait for every level to simulate the accesses queued so far, and stop
+ * the threads.
+ */
+void cache_hierarchy_stop_pipeline(cache_hierarchy_t *hierarchy) {
+
+    if (!hierarchy->pipelined) {
+        return;
+    }
+
+    // Closing the first queue stops each level in turn, once it is done.
+    if (hierarchy->num_levels > 1) {
+        cache_queue_close(hierarchy->queues[0]);
+    }
+    for (size_t i = 1; i < hierarchy->num_levels; i++) {
+        pthread_join(hierarchy->threads[i], NULL);
+    }
+    for (size_t i = 0; i + 1 < hierarchy->num_levels; i++) {
+        cache_queue_free(hierarchy->queues[i]);
+        hierarchy->queues[i] = NULL;
+    }
+    hierarchy->pipelined = false;
+}
+
+/*
+ * Read every access of a trace through the hierarchy.
+ */
+int cache_hierarchy_replay(cache_hierarchy_t *hierarchy, const char *path, bool pipelined) {
+
+    trace_reader_t *reader = trace_reader_open(path);
+    if (reader == NULL) {
+        return -1;
+    }
+    if (pipelined && cache_hierarchy_start_pipeline(hierarchy, CACHE_QUEUE_DEFAULT_CAPACITY) != 0) {
+        trace_reader_close(reader);
+        return -1;
+    }
+
+    uint64_t addresses[TRACE_BUFFER_SIZE / sizeof(uint64_t)];
+    uint64_t pcs[TRACE_BUFFER_SIZE / sizeof(uint64_t)];
+    bool has_pc = (reader->flags & TRACE_FLAG_PC) != 0;
+    bool fetch = has_pc && hierarchy->instruction_cache != NULL;
+    bool typed = (reader->flags & TRACE_FLAG_TYPE) != 0;
+    cache_t *first = hierarchy->levels[0];
+    size_t count;
+    while ((count = trace_read_block(reader, addresses, has_pc ? pcs : NULL, TRACE_BUFFER_SIZE / sizeof(uint64_t))) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (fetch && pipelined) {
+                cache_hierarchy_access_pipelined(hierarchy, pcs[i], CACHE_ACCESS_IFETCH, rand);
+            } else if (fetch) {
+                cache_hierarchy_access(hierarchy, pcs[i], CACHE_ACCESS_IFETCH, rand);
+            }
+            if (has_pc) {
+                first->access_pc = pcs[i];
+            }
+            uint64_t address = addresses[i];
+            int type = CACHE_ACCESS_LOAD;
+            if (typed) {
+                type = (int)(address & TRACE_TYPE_MASK);
+                address &= ~TRACE_TYPE_MASK;
+            }
+            if (pipelined) {
+                cache_hierarchy_access_pipelined(hierarchy, address, type, rand);
+            } else {
+                cache_hierarchy_access(hierarchy, address, type, rand);
+            }
+            first->access_pc = 0;
+        }
+    }
+
+    if (pipelined) {
+        cache_hierarchy_stop_pipeline(hierarchy);
+    }
+    int result = reader->error ? -1 : 0;
+    trace_reader_close(reader);
+    return result;
+}
+
+/*
+ * Return the cycles spent waiting on accesses of a type, beyond the
+ * latency of the first level.
+ */
+uint64_t cache_hierarchy_stall_cycles(cache_hierarchy_t *hierarchy, int type) {
+
+    // The processor does not wait on writes.
+    if (type >= CACHE_ACCESS_STORE) {
+        return 0;
+    }
+
+    // An access that hits in level i waits for the difference between its
+    // latency and the one of the first level, and a miss everywhere for memory.
+    uint64_t stalls = 0;
+    for (size_t i = 1; i < hierarchy->num_levels; i++) {
+        cache_t *cache = hierarchy->levels[i];
+        stalls += (cache->type_access_count[type] - cache->type_miss_count[type])
+                  * (hierarchy->latencies[i] - hierarchy->latencies[0]);
+    }
+    cache_t *last = hierarchy->num_levels > 1 ? hierarchy->levels[hierarchy->num_levels - 1]
+                                              : cache_hierarchy_first(hierarchy, type);
+    return stalls + last->type_miss_count[type] * (hierarchy->memory_latency - hierarchy->latencies[0]);
+}
+
+static const char *cache_access_type_names[CACHE_ACCESS_TYPES] = {"ifetch", "load", "store", "writeback"};
+
+/*
+ * Return the name of a type of access.
+ */
+const char *cache_access_type_name(int type) {
+    if (type < 0 || type >= CACHE_ACCESS_TYPES) {
+        return "unknown";
+    }
+    return cache_access_type_names[type];
+}
+
+/*
+ * Print the accesses, misses and miss rate of a cache, overall and per type.
+ */
+static void cache_hierarchy_print_level(FILE *out, const char *name, cache_t *cache) {
+    fprintf(out, "%-3s: accesses = %10" PRIu64 ", misses = %10" PRIu64 ", miss rate = %8.4f\n", name,
+            cache->access_count, cache->miss_count,
+            cache->access_count == 0 ? 0.0 : (double) cache->miss_count / cache->access_count);
+    for (int type = 0; type < CACHE_ACCESS_TYPES; type++) {
+        uint64_t accesses = cache->type_access_count[type], misses = cache->type_miss_count[type];
+        if (accesses > 0) {
+            fprintf(out, "  %-6s: accesses = %10" PRIu64 ", misses = %10" PRIu64 ", miss rate = %8.4f\n",
+                    cache_access_type_names[type], accesses, misses, (double) misses / accesses);
+        }
+    }
+}
+
+/*
+ * Print the accesses, misses and miss rate of every level, and the stall
+ * cycles of each type.
+ */
+void cache_hierarchy_print_stats(FILE *out, cache_hierarchy_t *hierarchy) {
+    char name[8];
+    if (hierarchy->instruction_cache != NULL) {
+        cache_hierarchy_print_level(out, "L1I", hierarchy->instruction_cache);
+        cache_hierarchy_print_level(out, "L1D", hierarchy->levels[0]);
+    } else {
+        cache_hierarchy_print_level(out, "L1", hierarchy->levels[0]);
+    }
+    for (size_t i = 1; i < hierarchy->num_levels; i++) {
+        snprintf(name, sizeof(name), "L%zu", i + 1);
+        cache_hierarchy_print_level(out, name, hierarchy->levels[i]);
+    }
+    for (int type = 0; type < CACHE_ACCESS_STORE; type++) {
+        fprintf(out, "%s stall cycles = %" PRIu64 "\n", cache_access_type_names[type],
+                cache_hierarchy_stall_cycles(hierarchy, type));
+    }
+}
@@ -0,0 +1,218 @@
+/*
+ * hierarchy.h
+ *
+ * Hierarchies of caches (L1, L2, LLC, ...), simulated either serially or
+ * as a pipeline with one thread per level.
+ *
+ * An access goes to the first level, and each miss goes on to the next
+ * level, which is neither inclusive nor exclusive of the ones above it.
+ * Since a level only sees the misses of the level above, in order, levels
+ * can run on their own thread: each one reads the misses of the level
+ * above from a bounded single-producer, single-consumer queue, and writes
+ * its own misses to the queue of the level below. Every level then sees
+ * the same accesses in the same order as in a serial simulation, so the
+ * statistics are identical, as long as no level uses a replacement policy
+ * that draws random numbers.
+ *
+ * The first level can be split into an instruction cache and a data
+ * cache: instruction fetches go to the former, loads and stores to the
+ * latter, and the misses of both go to the same second level. Every level
+ * keeps its statistics per type of access. With a latency per level, the
+ * cycles the processor waits on instruction fetches and loads can be
+ * derived from them; the cycles spent waiting on instruction fetches are
+ * front-end stalls. Writes retire through a store buffer, so the processor
+ * does not wait on them.
+ *
+ * Misses travel down the hierarchy, and so do dirty lines evicted from a
+ * write-back level: each is written back to the level below, after the
+ * miss that evicted it, as an access of type CACHE_ACCESS_WRITEBACK. A
+ * writeback that misses allocates its line without reading it from the
+ * level below, and dirties it. A write-through level passes every write on
+ * to the level below, hit or miss, and so does a write-no-allocate level
+ * for the writes that miss.
+ *
+ * The accesses leaving the last level can be written to a filter trace,
+ * with their types (see trace.h). Since a level only depends on the
+ * accesses that reach it, replaying the filter trace through a cache gives
+ * the same statistics as adding that cache below the last level, for a
+ * fraction of the accesses: studies of the last level of cache can then
+ * filter a trace through the upper levels once, and simulate only what
+ * goes past them.
+ */
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include "cache.h"
+#include <pthread.h>
+
+#define CACHE_HIERARCHY_MAX_LEVELS 8
+
+/*
+ * Default latencies, in cycles, of the levels and of memory.
+ */
+#define CACHE_HIERARCHY_DEFAULT_LATENCIES {4, 14, 40, 60, 80, 100, 120, 140}
+#define CACHE_HIERARCHY_DEFAULT_MEMORY_LATENCY 200
+
+/*
+ * Number of addresses in a queue between two levels.
+ */
+#define CACHE_QUEUE_DEFAULT_CAPACITY 4096
+
+/*
+ * Number of addresses a level writes to its queue before publishing them.
+ */
+#define CACHE_QUEUE_BATCH 64
+
+/*
+ * Bits of a queued address holding the type of access.
+ */
+#define CACHE_QUEUE_TYPE_MASK ((uint64_t) 3)
+
+/*
+ * Structure used to store a queue of addresses between two levels. The
+ * producer and the consumer keep private copies of head and tail, and only
+ * read the shared ones when the queue looks full or empty.
+ */
+typedef struct cache_queue_s {
+    uint64_t *addresses;
+    size_t capacity;
+
+    /* Written by the producer. */
+    uint64_t head;
+    bool closed;
+    uint8_t head_padding[64 - sizeof(uint64_t) - sizeof(bool)];
+
+    /* Written by the consumer. */
+    uint64_t tail;
+    uint8_t tail_padding[64 - sizeof(uint64_t)];
+
+    /* Private to the producer: next slot, and last tail read. */
+    uint64_t producer_head, producer_tail;
+    uint8_t producer_padding[64 - 2 * sizeof(uint64_t)];
+
+    /* Private to the consumer: next slot, and last head read. */
+    uint64_t consumer_tail, consumer_head;
+} cache_queue_t;
+
+/*
+ * Structure used to store a hierarchy. In pipelined mode, queues[i] holds
+ * the misses and writebacks of level i, read by the thread of level i + 1,
+ * tagged with their type in the offset bits.
+ */
+typedef struct cache_hierarchy_s {
+    size_t num_levels;
+    cache_t *levels[CACHE_HIERARCHY_MAX_LEVELS];
+
+    /* Instruction cache beside the first level, or NULL if it is unified. */
+    cache_t *instruction_cache;
+
+    /* Cycles to access each level, and memory. */
+    unsigned int latencies[CACHE_HIERARCHY_MAX_LEVELS];
+    unsigned int memory_latency;
+
+    /* Trace of the accesses leaving the last level, or NULL. */
+    struct trace_writer_s *filter;
+
+    bool pipelined;
+    cache_queue_t *queues[CACHE_HIERARCHY_MAX_LEVELS];
+    pthread_t threads[CACHE_HIERARCHY_MAX_LEVELS];
+} cache_hierarchy_t;
+
+/*
+ * Create a hierarchy of the given caches, from the closest to the
+ * processor to the furthest. The hierarchy owns the caches. Returns NULL
+ * on failure.
+ */
+cache_hierarchy_t *cache_hierarchy_new(size_t num_levels, cache_t **levels);
+
+/*
+ * Frees the hierarchy and its caches. A pipeline must be stopped first.
+ * The filter trace, if any, belongs to the caller.
+ */
+void cache_hierarchy_free(cache_hierarchy_t *hierarchy);
+
+/*
+ * Split the first level: instruction fetches go to instruction_cache, and
+ * loads and stores to the first level. The hierarchy owns the cache.
+ * Returns 0 on success and -1 on failure.
+ */
+int cache_hierarchy_split(cache_hierarchy_t *hierarchy, cache_t *instruction_cache);
+
+/*
+ * Set the latency, in cycles, of each level and of memory, none lower than
+ * the one of the first level. The instruction cache has the latency of the
+ * first level.
+ */
+void cache_hierarchy_set_latencies(cache_hierarchy_t *hierarchy, const unsigned int *latencies,
+                                   unsigned int memory_latency);
+
+/*
+ * Read a single uint64_t integer through the hierarchy. Returns the value
+ * read by the first level.
+ */
+uint64_t cache_hierarchy_read(cache_hierarchy_t *hierarchy, uintptr_t address, func_t generate_random_number);
+
+/*
+ * Access a single uint64_t integer through the hierarchy, with the given
+ * type of access. Returns the value read by the first level. Accesses of an
+ * unknown type are ignored, and read 0.
+ */
+uint64_t cache_hierarchy_access(cache_hierarchy_t *hierarchy, uintptr_t address, int type,
+                                func_t generate_random_number);
+
+/*
+ * Start a thread for every level but the first, connected by queues of
+ * at least capacity addresses. Returns 0 on success and -1 on failure.
+ */
+int cache_hierarchy_start_pipeline(cache_hierarchy_t *hierarchy, size_t capacity);
+
+/*
+ * Read through the first level on the calling thread, and queue a miss for
+ * the next level. The pipeline must be started.
+ */
+uint64_t cache_hierarchy_read_pipelined(cache_hierarchy_t *hierarchy, uintptr_t address, func_t generate_random_number);
+
+/*
+ * Access through the first level on the calling thread, with the given
+ * type of access, and queue a miss for the next level. The pipeline must
+ * be started.
+ */
+uint64_t cache_hierarchy_access_pipelined(cache_hierarchy_t *hierarchy, uintptr_t address, int type,
+                                          func_t generate_random_number);
+
+/*
+ * Wait for every level to simulate the accesses queued so far, and stop
+ * the threads.
+ */
+void cache_hierarchy_stop_pipeline(cache_hierarchy_t *hierarchy);
+
+/*
+ * Read every access of the trace at path through the hierarchy, whose
+ * caches should use CACHE_NODATAPOLICY, serially or with a pipeline. When
+ * the trace has program counters and the first level is split, each load
+ * is preceded by the fetch of its instruction. The accesses of a
+ * TRACE_FLAG_TYPE trace keep their types. Returns 0 on success and -1 on
+ * failure, including a truncated or corrupt trace.
+ */
+int cache_hierarchy_replay(cache_hierarchy_t *hierarchy, const char *path, bool pipelined);
+
+/*
+ * Return the cycles the processor waited on accesses of the given type,
+ * beyond the latency of the first level, which is 0 for stores and
+ * writebacks. The pipeline must be stopped.
+ */
+uint64_t cache_hierarchy_stall_cycles(cache_hierarchy_t *hierarchy, int type);
+
+/*
+ * Return the name of a type of access: "ifetch", "load", "store" or
+ * "writeback", or "unknown" for any other value.
+ */
+const char *cache_access_type_name(int type);
+
+/*
+ * Print the accesses, misses and miss rate of every level, per type of
+ * access, and the stall cycles of each type.
+ */
+void cache_hierarchy_print_stats(FILE *out, cache_hierarchy_t *hierarchy);
+
+#endif
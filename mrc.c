@@ -0,0 +1,299 @@
+#include "mrc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define MRC_EMPTY SIZE_MAX
+
+/*
+ * Mix the bits of a line address (the splitmix64 finalizer).
+ */
+static uint64_t mrc_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static size_t mrc_home(mrc_t *mrc, uintptr_t line) {
+    return (mrc_mix(line) >> 32) & mrc->table_mask;
+}
+
+/*
+ * Create an estimator.
+ */
+mrc_t *mrc_new(size_t line_size, size_t max_lines, double rate, size_t max_samples) {
+
+    if (line_size == 0 || max_lines == 0 || max_samples == 0 || rate <= 0) {
+        return NULL;
+    }
+
+    mrc_t *mrc = (mrc_t *)calloc(1, sizeof(mrc_t));
+    mrc->line_size = line_size;
+    mrc->threshold = rate >= 1 ? MRC_MODULUS : (uint32_t)(rate * MRC_MODULUS);
+    if (mrc->threshold == 0) {
+        mrc->threshold = 1;
+    }
+
+    // One more slot than max_samples, for the line added before one is dropped.
+    mrc->max_samples = max_samples;
+    mrc->samples = (mrc_sample_t *)malloc((max_samples + 1) * sizeof(mrc_sample_t));
+    mrc->free_slots = (size_t *)malloc((max_samples + 1) * sizeof(size_t));
+    mrc->heap = (size_t *)malloc((max_samples + 1) * sizeof(size_t));
+    for (size_t i = 0; i <= max_samples; i++) {
+        mrc->free_slots[i] = max_samples - i;
+    }
+
+    size_t table_size = 1;
+    while (table_size < 2 * (max_samples + 1)) {
+        table_size *= 2;
+    }
+    mrc->table = (size_t *)malloc(table_size * sizeof(size_t));
+    mrc->table_mask = table_size - 1;
+    for (size_t i = 0; i < table_size; i++) {
+        mrc->table[i] = MRC_EMPTY;
+    }
+
+    mrc->tree_size = 2 * (max_samples + 1);
+    mrc->tree = (size_t *)calloc(mrc->tree_size + 1, sizeof(size_t));
+    mrc->now = 1;
+
+    mrc->bucket_lines = (max_lines + MRC_BUCKETS - 1) / MRC_BUCKETS;
+    return mrc;
+}
+
+/*
+ * Frees all memory allocated for the given estimator.
+ */
+void mrc_free(mrc_t *mrc) {
+    free(mrc->samples);
+    free(mrc->free_slots);
+    free(mrc->heap);
+    free(mrc->table);
+    free(mrc->tree);
+    free(mrc);
+}
+
+/*
+ * Fenwick tree over access times, from 1 to tree_size.
+ */
+static void mrc_tree_add(mrc_t *mrc, size_t time, int delta) {
+    for (; time <= mrc->tree_size; time += time & -time) {
+        mrc->tree[time] += delta;
+    }
+}
+
+static size_t mrc_tree_prefix(mrc_t *mrc, size_t time) {
+    size_t sum = 0;
+    for (; time > 0; time -= time & -time) {
+        sum += mrc->tree[time];
+    }
+    return sum;
+}
+
+static int compare_times(const void *a, const void *b) {
+    const mrc_sample_t *x = *(const mrc_sample_t **)a, *y = *(const mrc_sample_t **)b;
+    return x->time < y->time ? -1 : x->time > y->time;
+}
+
+/*
+ * Renumber the last access times of the sampled lines from 1, keeping their
+ * order, when the tree runs out of times.
+ */
+static void mrc_compact(mrc_t *mrc) {
+
+    mrc_sample_t **sorted = (mrc_sample_t **)malloc(mrc->num_samples * sizeof(mrc_sample_t *));
+    for (size_t i = 0; i < mrc->num_samples; i++) {
+        sorted[i] = mrc->samples + mrc->heap[i];
+    }
+    qsort(sorted, mrc->num_samples, sizeof(mrc_sample_t *), compare_times);
+
+    memset(mrc->tree, 0, (mrc->tree_size + 1) * sizeof(size_t));
+    for (size_t i = 0; i < mrc->num_samples; i++) {
+        sorted[i]->time = i + 1;
+        mrc_tree_add(mrc, i + 1, 1);
+    }
+    mrc->now = mrc->num_samples + 1;
+    free(sorted);
+}
+
+/*
+ * Max-heap of slots, ordered by hash.
+ */
+static void mrc_heap_swap(mrc_t *mrc, size_t i, size_t j) {
+    size_t slot = mrc->heap[i];
+    mrc->heap[i] = mrc->heap[j];
+    mrc->heap[j] = slot;
+    mrc->samples[mrc->heap[i]].heap_index = i;
+    mrc->samples[mrc->heap[j]].heap_index = j;
+}
+
+static void mrc_heap_push(mrc_t *mrc, size_t slot) {
+    size_t i = mrc->num_samples++;
+    mrc->heap[i] = slot;
+    mrc->samples[slot].heap_index = i;
+    while (i > 0 && mrc->samples[mrc->heap[(i - 1) / 2]].hash < mrc->samples[mrc->heap[i]].hash) {
+        mrc_heap_swap(mrc, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static size_t mrc_heap_pop(mrc_t *mrc) {
+    size_t slot = mrc->heap[0];
+    mrc_heap_swap(mrc, 0, --mrc->num_samples);
+    size_t i = 0;
+    for (;;) {
+        size_t largest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < mrc->num_samples && mrc->samples[mrc->heap[left]].hash > mrc->samples[mrc->heap[largest]].hash) {
+            largest = left;
+        }
+        if (right < mrc->num_samples && mrc->samples[mrc->heap[right]].hash > mrc->samples[mrc->heap[largest]].hash) {
+            largest = right;
+        }
+        if (largest == i) {
+            break;
+        }
+        mrc_heap_swap(mrc, i, largest);
+        i = largest;
+    }
+    return slot;
+}
+
+/*
+ * Return the position of a line in the table: either its slot or an empty one.
+ */
+static size_t mrc_table_find(mrc_t *mrc, uintptr_t line) {
+    size_t position = mrc_home(mrc, line);
+    while (mrc->table[position] != MRC_EMPTY && mrc->samples[mrc->table[position]].line != line) {
+        position = (position + 1) & mrc->table_mask;
+    }
+    return position;
+}
+
+/*
+ * Remove the entry at a position of the table, moving back the entries
+ * after it so that lookups still find them.
+ */
+static void mrc_table_remove(mrc_t *mrc, size_t position) {
+    mrc->table[position] = MRC_EMPTY;
+    size_t next = (position + 1) & mrc->table_mask;
+    while (mrc->table[next] != MRC_EMPTY) {
+        size_t home = mrc_home(mrc, mrc->samples[mrc->table[next]].line);
+        // Move the entry back unless its home is cyclically in (position, next].
+        bool stays = position <= next ? (home > position && home <= next) : (home > position || home <= next);
+        if (!stays) {
+            mrc->table[position] = mrc->table[next];
+            mrc->table[next] = MRC_EMPTY;
+            position = next;
+        }
+        next = (next + 1) & mrc->table_mask;
+    }
+}
+
+/*
+ * Count an access to the given address.
+ */
+void mrc_access(mrc_t *mrc, uintptr_t address) {
+
+    mrc->access_count++;
+    uintptr_t line = address / mrc->line_size;
+    uint32_t hash = mrc_mix(line) & (MRC_MODULUS - 1);
+    if (hash >= mrc->threshold) {
+        return;
+    }
+
+    // Each sampled access stands for 1 / rate accesses.
+    double weight = (double) MRC_MODULUS / mrc->threshold;
+    if (mrc->now > mrc->tree_size) {
+        mrc_compact(mrc);
+    }
+
+    size_t position = mrc_table_find(mrc, line);
+    size_t slot = mrc->table[position];
+    if (slot != MRC_EMPTY) {
+        // The reuse distance is the number of lines accessed since.
+        mrc_sample_t *sample = mrc->samples + slot;
+        size_t distance = mrc_tree_prefix(mrc, mrc->now - 1) - mrc_tree_prefix(mrc, sample->time);
+        size_t bucket = (size_t)(distance * weight) / mrc->bucket_lines;
+        if (bucket < MRC_BUCKETS) {
+            mrc->histogram[bucket] += weight;
+        } else {
+            mrc->beyond += weight;
+        }
+        mrc_tree_add(mrc, sample->time, -1);
+        sample->time = mrc->now++;
+        mrc_tree_add(mrc, sample->time, 1);
+        return;
+    }
+
+    mrc->cold += weight;
+    slot = mrc->free_slots[mrc->max_samples - mrc->num_samples];
+    mrc_sample_t *sample = mrc->samples + slot;
+    sample->line = line;
+    sample->hash = hash;
+    sample->time = mrc->now++;
+    mrc_tree_add(mrc, sample->time, 1);
+    mrc->table[position] = slot;
+    mrc_heap_push(mrc, slot);
+
+    // Too many lines: drop the one with the largest hash, and stop sampling
+    // lines whose hash is as large.
+    if (mrc->num_samples > mrc->max_samples) {
+        slot = mrc_heap_pop(mrc);
+        sample = mrc->samples + slot;
+        mrc->threshold = sample->hash;
+        mrc_tree_add(mrc, sample->time, -1);
+        mrc_table_remove(mrc, mrc_table_find(mrc, sample->line));
+        mrc->free_slots[mrc->max_samples - mrc->num_samples] = slot;
+    }
+}
+
+/*
+ * Return the current sampling rate.
+ */
+double mrc_rate(mrc_t *mrc) {
+    return (double) mrc->threshold / MRC_MODULUS;
+}
+
+/*
+ * Return the estimated miss ratio of a fully associative LRU cache.
+ */
+double mrc_miss_ratio(mrc_t *mrc, size_t num_lines) {
+
+    if (mrc->access_count == 0) {
+        return 0.0;
+    }
+
+    // Accesses within a bucket hit only if the whole bucket fits.
+    double misses = mrc->cold + mrc->beyond;
+    for (size_t i = 0; i < MRC_BUCKETS; i++) {
+        if ((i + 1) * mrc->bucket_lines > num_lines) {
+            misses += mrc->histogram[i];
+        }
+    }
+
+    // The accesses the sample stands for and those seen differ by chance:
+    // count the difference as hits, so that ratios are over the accesses seen.
+    double ratio = misses / mrc->access_count;
+    return ratio < 0 ? 0.0 : ratio > 1 ? 1.0 : ratio;
+}
+
+/*
+ * Print the estimated miss ratio for every power of two number of lines.
+ */
+void mrc_print(FILE *out, mrc_t *mrc) {
+    fprintf(out, "Sampling rate = %8.6f\n", mrc_rate(mrc));
+    fprintf(out, "%12s %12s\n", "lines", "miss ratio");
+    for (size_t lines = 1; lines <= mrc->bucket_lines * MRC_BUCKETS; lines *= 2) {
+        fprintf(out, "%12zu %12.4f\n", lines, mrc_miss_ratio(mrc, lines));
+    }
+}
+
+/*
+ * Make every access of the cache go to the estimator.
+ */
+void cache_attach_mrc(cache_t *cache, mrc_t *mrc) {
+    cache->mrc = mrc;
+}
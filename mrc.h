@@ -0,0 +1,124 @@
+/*
+ * mrc.h
+ *
+ * Approximate miss ratio curves with spatial hashing (SHARDS).
+ *
+ * A line is sampled when the hash of its address is below a threshold, so
+ * every access to a sampled line is seen and reuse distances within the
+ * sample are exact. A reuse distance d among lines sampled at rate R is an
+ * estimate of a distance d / R among all lines. Each sampled access stands
+ * for 1 / R accesses, and the difference between the accesses seen and
+ * those the sample stands for is counted as hits (SHARDS_adj).
+ *
+ * At most max_samples lines are tracked: when a new line would exceed that,
+ * the line with the largest hash is dropped and the threshold is lowered to
+ * its hash. Memory is thus constant, whatever the length of the stream.
+ *
+ * The miss ratio of a fully associative LRU cache of C lines is the fraction
+ * of accesses whose reuse distance is C or more, or that are cold.
+ */
+#ifndef MRC_H
+#define MRC_H
+
+#include "cache.h"
+
+/*
+ * Hashes are reduced modulo MRC_MODULUS, and compared to a threshold
+ * between 0 and MRC_MODULUS.
+ */
+#define MRC_MODULUS (1 << 24)
+
+/*
+ * Number of buckets of the reuse distance histogram.
+ */
+#define MRC_BUCKETS 1024
+
+/*
+ * Structure used to store a sampled line.
+ */
+typedef struct mrc_sample_s {
+    uintptr_t line;
+    uint32_t hash;
+
+    /* Time of the last access, and position in the heap. */
+    size_t time;
+    size_t heap_index;
+} mrc_sample_t;
+
+/*
+ * Structure used to store the state of the estimator.
+ */
+typedef struct mrc_s {
+    size_t line_size;
+
+    /* Lines are sampled when their hash is below threshold. */
+    uint32_t threshold;
+
+    /* Sampled lines, with a stack of free slots. */
+    mrc_sample_t *samples;
+    size_t *free_slots;
+    size_t num_samples, max_samples;
+
+    /* Open addressing table from lines to slots, SIZE_MAX when empty. */
+    size_t *table;
+    size_t table_mask;
+
+    /* Max-heap of slots by hash, to find the line to drop. */
+    size_t *heap;
+
+    /* Fenwick tree counting the lines whose last access was at each time. */
+    size_t *tree;
+    size_t tree_size;
+    size_t now;
+
+    /* Reuse distance histogram, in buckets of bucket_lines lines, weighted
+     * by the accesses each sampled access stands for. */
+    size_t bucket_lines;
+    double histogram[MRC_BUCKETS];
+    double beyond, cold;
+
+    /* Number of accesses seen. */
+    uint64_t access_count;
+} mrc_t;
+
+/*
+ * Create an estimator for caches of up to max_lines lines of line_size
+ * bytes, sampling lines at the given rate and tracking at most max_samples
+ * of them. Returns NULL on failure.
+ */
+mrc_t *mrc_new(size_t line_size, size_t max_lines, double rate, size_t max_samples);
+
+/*
+ * Frees all memory allocated for the given estimator.
+ */
+void mrc_free(mrc_t *mrc);
+
+/*
+ * Count an access to the given address.
+ */
+void mrc_access(mrc_t *mrc, uintptr_t address);
+
+/*
+ * Return the current sampling rate.
+ */
+double mrc_rate(mrc_t *mrc);
+
+/*
+ * Return the estimated miss ratio of a fully associative LRU cache of
+ * num_lines lines.
+ */
+double mrc_miss_ratio(mrc_t *mrc, size_t num_lines);
+
+/*
+ * Print the estimated miss ratio for every power of two number of lines,
+ * up to the largest the estimator supports.
+ */
+void mrc_print(FILE *out, mrc_t *mrc);
+
+/*
+ * Make every access of the cache go to the estimator. The cache does not
+ * own the estimator, which must be freed after the cache.
+ */
+void cache_attach_mrc(cache_t *cache, mrc_t *mrc);
+
+#endif
@@ -0,0 +1,165 @@
+#include "mshr.h"
+#include "dram.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * Give the cache num_entries MSHRs.
+ */
+int cache_mshr_init(cache_t *cache, size_t num_entries, unsigned int miss_latency) {
+
+    if (num_entries == 0) {
+        return -1;
+    }
+    if (cache->mshr != NULL) {
+        cache_mshr_free(cache);
+    }
+
+    cache_mshr_t *mshr = (cache_mshr_t *)calloc(1, sizeof(cache_mshr_t));
+    mshr->num_entries = num_entries;
+    mshr->entries = (cache_mshr_entry_t *)calloc(num_entries, sizeof(cache_mshr_entry_t));
+    mshr->miss_latency = miss_latency;
+    mshr->updated_at = cache->cycle_count;
+
+    cache->mshr = mshr;
+    return 0;
+}
+
+/*
+ * Frees the MSHRs of a cache.
+ */
+void cache_mshr_free(cache_t *cache) {
+    free(cache->mshr->entries);
+    free(cache->mshr);
+    cache->mshr = NULL;
+}
+
+/*
+ * Account for the outstanding misses up to the given cycle.
+ */
+static void cache_mshr_account(cache_mshr_t *mshr, uint64_t cycle) {
+    if (cycle <= mshr->updated_at) {
+        return;
+    }
+    mshr->outstanding_cycles += mshr->num_outstanding * (cycle - mshr->updated_at);
+    if (mshr->num_outstanding > 0) {
+        mshr->busy_cycles += cycle - mshr->updated_at;
+    }
+    mshr->updated_at = cycle;
+}
+
+/*
+ * Return the index of the outstanding miss that completes first.
+ */
+static size_t cache_mshr_oldest(cache_mshr_t *mshr) {
+    size_t oldest = 0;
+    for (size_t i = 1; i < mshr->num_outstanding; i++) {
+        if (mshr->entries[i].ready_at < mshr->entries[oldest].ready_at) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+/*
+ * Release the MSHRs of all misses that complete by the given cycle.
+ */
+void cache_mshr_advance(cache_t *cache, uint64_t cycle) {
+
+    cache_mshr_t *mshr = cache->mshr;
+    while (mshr->num_outstanding > 0) {
+        size_t oldest = cache_mshr_oldest(mshr);
+        if (mshr->entries[oldest].ready_at > cycle) {
+            break;
+        }
+        cache_mshr_account(mshr, mshr->entries[oldest].ready_at);
+        mshr->entries[oldest] = mshr->entries[--mshr->num_outstanding];
+    }
+    cache_mshr_account(mshr, cycle);
+}
+
+/*
+ * Return the outstanding miss for a line, or NULL.
+ */
+static cache_mshr_entry_t *cache_mshr_find(cache_mshr_t *mshr, uintptr_t line_address) {
+    for (size_t i = 0; i < mshr->num_outstanding; i++) {
+        if (mshr->entries[i].line_address == line_address) {
+            return mshr->entries + i;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * A hit on a line that is still being fetched merges with its miss.
+ */
+void cache_mshr_hit(cache_t *cache, uintptr_t line_address) {
+    if (cache->mshr->num_outstanding > 0 && cache_mshr_find(cache->mshr, line_address) != NULL) {
+        cache->mshr->merged_misses++;
+    }
+}
+
+/*
+ * Start fetching a line, stalling first if all MSHRs are busy.
+ */
+void cache_mshr_miss(cache_t *cache, uintptr_t line_address) {
+
+    cache_mshr_t *mshr = cache->mshr;
+    if (cache_mshr_find(mshr, line_address) != NULL) {
+        mshr->merged_misses++;
+        return;
+    }
+
+    if (mshr->num_outstanding == mshr->num_entries) {
+        uint64_t ready_at = mshr->entries[cache_mshr_oldest(mshr)].ready_at;
+        mshr->full_stalls++;
+        mshr->stall_cycles += ready_at - cache->cycle_count;
+        cache->cycle_count = ready_at;
+        cache_mshr_advance(cache, ready_at);
+    }
+
+    cache_mshr_entry_t *entry = mshr->entries + mshr->num_outstanding++;
+    entry->line_address = line_address;
+    if (cache->dram != NULL) {
+        entry->ready_at = dram_access(cache->dram, line_address, cache->line_size, false, cache->cycle_count);
+    } else {
+        entry->ready_at = cache->cycle_count + mshr->miss_latency;
+    }
+    mshr->primary_misses++;
+}
+
+/*
+ * Wait until all outstanding misses complete.
+ */
+uint64_t cache_mshr_drain(cache_t *cache) {
+
+    cache_mshr_t *mshr = cache->mshr;
+    for (size_t i = 0; i < mshr->num_outstanding; i++) {
+        if (mshr->entries[i].ready_at > cache->cycle_count) {
+            cache->cycle_count = mshr->entries[i].ready_at;
+        }
+    }
+    cache_mshr_advance(cache, cache->cycle_count);
+    return cache->cycle_count;
+}
+
+/*
+ * Return the average number of outstanding misses while there was one.
+ */
+double cache_mshr_mlp(cache_t *cache) {
+    cache_mshr_t *mshr = cache->mshr;
+    return mshr->busy_cycles == 0 ? 0.0 : (double) mshr->outstanding_cycles / mshr->busy_cycles;
+}
+
+/*
+ * Print the number of primary and merged misses, the MLP and the stalls.
+ */
+void cache_mshr_print_stats(FILE *out, cache_t *cache) {
+
+    cache_mshr_t *mshr = cache->mshr;
+    fprintf(out, "Primary misses = %" PRIu64 ", merged misses = %" PRIu64 "\n",
+            mshr->primary_misses, mshr->merged_misses);
+    fprintf(out, "MLP              = %8.4f\n", cache_mshr_mlp(cache));
+    fprintf(out, "MSHR-full stalls = %" PRIu64 " (%" PRIu64 " cycles)\n", mshr->full_stalls, mshr->stall_cycles);
+}
@@ -0,0 +1,84 @@
+/*
+ * mshr.h
+ *
+ * Miss status holding registers, which make a cache non-blocking. A miss
+ * allocates an MSHR and the cache keeps serving accesses while the line is
+ * fetched; further misses to the same line merge into the same MSHR. Only
+ * when all MSHRs are busy does the cache stall, until the oldest miss
+ * completes.
+ *
+ * Misses take the time given by the cache's DRAM if it has one (see
+ * dram.h), and a fixed latency otherwise.
+ */
+#ifndef MSHR_H
+#define MSHR_H
+
+#include "cache.h"
+
+/*
+ * Structure used to store an outstanding miss.
+ */
+typedef struct cache_mshr_entry_s {
+    uintptr_t line_address;
+    uint64_t ready_at;
+} cache_mshr_entry_t;
+
+/*
+ * Structure used to store the MSHRs of a cache.
+ */
+typedef struct cache_mshr_s {
+    size_t num_entries;
+    size_t num_outstanding;
+    cache_mshr_entry_t *entries;
+
+    /* Latency of a miss when the cache has no DRAM. */
+    unsigned int miss_latency;
+
+    /* Cycle up to which the statistics below have been accumulated. */
+    uint64_t updated_at;
+
+    /* Sum over cycles of the number of outstanding misses, and number of
+     * cycles with at least one outstanding miss. */
+    uint64_t outstanding_cycles;
+    uint64_t busy_cycles;
+
+    /* Statistics about MSHR usage. */
+    uint64_t primary_misses, merged_misses;
+    uint64_t full_stalls, stall_cycles;
+} cache_mshr_t;
+
+/*
+ * Give the cache num_entries MSHRs. Without a DRAM, misses take
+ * miss_latency cycles. Returns 0 on success and -1 if num_entries is 0.
+ */
+int cache_mshr_init(cache_t *cache, size_t num_entries, unsigned int miss_latency);
+
+/*
+ * Frees the MSHRs of a cache.
+ */
+void cache_mshr_free(cache_t *cache);
+
+/*
+ * Wait until all outstanding misses complete, and return the cycle count.
+ */
+uint64_t cache_mshr_drain(cache_t *cache);
+
+/*
+ * Return the memory-level parallelism: the average number of outstanding
+ * misses over the cycles where there was at least one.
+ */
+double cache_mshr_mlp(cache_t *cache);
+
+/*
+ * Print the number of primary and merged misses, the MLP and the stalls.
+ */
+void cache_mshr_print_stats(FILE *out, cache_t *cache);
+
+/*
+ *  Helpers used by cache_read
+ */
+void cache_mshr_advance(cache_t *cache, uint64_t cycle);
+void cache_mshr_hit(cache_t *cache, uintptr_t line_address);
+void cache_mshr_miss(cache_t *cache, uintptr_t line_address);
+
+#endif
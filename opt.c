@@ -0,0 +1,236 @@
+#include "opt.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define OPT_EMPTY UINT64_MAX
+
+/*
+ * Open-addressing hash map from line address to the index of the last
+ * access seen to that line.
+ */
+typedef struct last_use_map_s {
+    uint64_t *keys;
+    uint64_t *values;
+    size_t capacity;
+    size_t count;
+} last_use_map_t;
+
+static void last_use_map_init(last_use_map_t *map, size_t capacity) {
+    map->capacity = capacity;
+    map->count = 0;
+    map->keys = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+    map->values = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+    memset(map->keys, 0xff, capacity * sizeof(uint64_t));
+}
+
+static void last_use_map_free(last_use_map_t *map) {
+    free(map->keys);
+    free(map->values);
+}
+
+static size_t last_use_map_slot(last_use_map_t *map, uint64_t key) {
+    size_t slot = (key * 0x9e3779b97f4a7c15ULL) & (map->capacity - 1);
+    while (map->keys[slot] != OPT_EMPTY && map->keys[slot] != key) {
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return slot;
+}
+
+static void last_use_map_grow(last_use_map_t *map) {
+    last_use_map_t bigger;
+    last_use_map_init(&bigger, map->capacity * 2);
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->keys[i] != OPT_EMPTY) {
+            size_t slot = last_use_map_slot(&bigger, map->keys[i]);
+            bigger.keys[slot] = map->keys[i];
+            bigger.values[slot] = map->values[i];
+        }
+    }
+    bigger.count = map->count;
+    last_use_map_free(map);
+    *map = bigger;
+}
+
+/*
+ * Store value for key, and return the value previously stored (or OPT_NEVER).
+ */
+static uint64_t last_use_map_exchange(last_use_map_t *map, uint64_t key, uint64_t value) {
+    if (2 * (map->count + 1) > map->capacity) {
+        last_use_map_grow(map);
+    }
+    size_t slot = last_use_map_slot(map, key);
+    uint64_t previous = OPT_NEVER;
+    if (map->keys[slot] == key) {
+        previous = map->values[slot];
+    } else {
+        map->keys[slot] = key;
+        map->count++;
+    }
+    map->values[slot] = value;
+    return previous;
+}
+
+/*
+ * Number of records in a raw trace file.
+ */
+static int trace_length(int fd, size_t *length) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+    *length = st.st_size / sizeof(uint64_t);
+    return 0;
+}
+
+/*
+ * Compute the next use of every access, walking the trace backwards.
+ */
+int opt_compute_next_use(const char *trace_path, const char *next_use_path, size_t line_size) {
+
+    int trace_fd = open(trace_path, O_RDONLY);
+    if (trace_fd < 0) {
+        return -1;
+    }
+    int next_fd = open(next_use_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (next_fd < 0) {
+        close(trace_fd);
+        return -1;
+    }
+
+    size_t length;
+    int result = trace_length(trace_fd, &length);
+
+    uint64_t *addresses = (uint64_t *)malloc(OPT_BLOCK_RECORDS * sizeof(uint64_t));
+    uint64_t *next_use = (uint64_t *)malloc(OPT_BLOCK_RECORDS * sizeof(uint64_t));
+    last_use_map_t map;
+    last_use_map_init(&map, 1024);
+
+    size_t end = length;
+    while (result == 0 && end > 0) {
+        size_t start = end > OPT_BLOCK_RECORDS ? end - OPT_BLOCK_RECORDS : 0;
+        size_t count = end - start;
+        off_t offset = start * sizeof(uint64_t);
+
+        if (pread(trace_fd, addresses, count * sizeof(uint64_t), offset) != (ssize_t)(count * sizeof(uint64_t))) {
+            result = -1;
+            break;
+        }
+        for (size_t i = count; i > 0; i--) {
+            next_use[i - 1] = last_use_map_exchange(&map, addresses[i - 1] / line_size, start + i - 1);
+        }
+        if (pwrite(next_fd, next_use, count * sizeof(uint64_t), offset) != (ssize_t)(count * sizeof(uint64_t))) {
+            result = -1;
+        }
+        end = start;
+    }
+
+    last_use_map_free(&map);
+    free(addresses);
+    free(next_use);
+    close(trace_fd);
+    close(next_fd);
+    return result;
+}
+
+/*
+ * Replay a trace through a cache, feeding OPT its next-use times.
+ */
+int opt_replay(cache_t *cache, const char *trace_path, const char *next_use_path) {
+
+    FILE *trace = fopen(trace_path, "rb");
+    if (trace == NULL) {
+        return -1;
+    }
+    FILE *next = NULL;
+    if (next_use_path != NULL) {
+        next = fopen(next_use_path, "rb");
+        if (next == NULL) {
+            fclose(trace);
+            return -1;
+        }
+    }
+
+    uint64_t *addresses = (uint64_t *)malloc(OPT_BLOCK_RECORDS * sizeof(uint64_t));
+    uint64_t *next_use = (uint64_t *)malloc(OPT_BLOCK_RECORDS * sizeof(uint64_t));
+    int result = 0;
+
+    size_t count;
+    while ((count = fread(addresses, sizeof(uint64_t), OPT_BLOCK_RECORDS, trace)) > 0) {
+        if (next != NULL && fread(next_use, sizeof(uint64_t), count, next) != count) {
+            result = -1;
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (next != NULL) {
+                cache->access_next_use = next_use[i];
+            }
+            cache_read(cache, addresses[i], rand);
+        }
+    }
+
+    free(addresses);
+    free(next_use);
+    fclose(trace);
+    if (next != NULL) {
+        fclose(next);
+    }
+    return result;
+}
+
+/*
+ * Print the miss rates of a cache and of OPT, and the gap between them.
+ */
+void opt_print_gap(FILE *out, cache_t *cache, cache_t *opt) {
+
+    uint64_t ac = cache_access_count(cache);
+    if (ac == 0) {
+        fprintf(out, "The cache wasn't used.\n");
+        return;
+    }
+    double miss_rate = (double) cache_miss_count(cache) / ac;
+    double opt_miss_rate = (double) cache_miss_count(opt) / cache_access_count(opt);
+
+    fprintf(out, "Miss rate     = %8.4f\n", miss_rate);
+    fprintf(out, "OPT miss rate = %8.4f\n", opt_miss_rate);
+    fprintf(out, "Gap to OPT    = %8.4f (%" PRIu64 " extra misses)\n", miss_rate - opt_miss_rate,
+            cache_miss_count(cache) - cache_miss_count(opt));
+}
+
+/*
+ * Run a trace through a cache and through OPT, and print the gap.
+ */
+int opt_compare(FILE *out, const char *trace_path, size_t num_bytes, size_t block_size,
+                size_t associativity, uint8_t policies) {
+
+    char next_use_path[] = "/tmp/opt-next-use-XXXXXX";
+    int fd = mkstemp(next_use_path);
+    if (fd < 0) {
+        return -1;
+    }
+    close(fd);
+
+    int result = opt_compute_next_use(trace_path, next_use_path, block_size);
+    if (result == 0) {
+        uint8_t other_policies = (policies & ~CACHE_REPLACEMENTPOLICY_MASK) | CACHE_NODATAPOLICY;
+        cache_t *cache = cache_new(num_bytes, block_size, associativity, policies | CACHE_NODATAPOLICY);
+        cache_t *opt = cache_new(num_bytes, block_size, associativity, other_policies | CACHE_REPLACEMENTPOLICY_OPT);
+
+        result = opt_replay(cache, trace_path, NULL);
+        if (result == 0) {
+            result = opt_replay(opt, trace_path, next_use_path);
+        }
+        if (result == 0) {
+            opt_print_gap(out, cache, opt);
+        }
+
+        cache_free(cache);
+        cache_free(opt);
+    }
+
+    remove(next_use_path);
+    return result;
+}
@@ -0,0 +1,55 @@
+/*
+ * opt.h
+ *
+ * Belady's OPT (MIN) replacement, used to measure how far a replacement
+ * policy is from optimal on a trace.
+ *
+ * Traces are raw files of uint64_t addresses, one per access. OPT needs the
+ * time of the next use of every access; opt_compute_next_use computes it in
+ * one backwards pass over the trace, reading it block by block, so that only
+ * the set of distinct lines has to fit in memory.
+ */
+#ifndef OPT_H
+#define OPT_H
+
+#include "cache.h"
+
+/*
+ * Next-use time of an access whose line is never used again.
+ */
+#define OPT_NEVER UINT64_MAX
+
+/*
+ * Number of trace records read or written at a time.
+ */
+#define OPT_BLOCK_RECORDS 65536
+
+/*
+ * Write, for each access of the trace at trace_path, the index of the next
+ * access to the same line (or OPT_NEVER) to next_use_path. Returns 0 on
+ * success and -1 on failure.
+ */
+int opt_compute_next_use(const char *trace_path, const char *next_use_path, size_t line_size);
+
+/*
+ * Replay the trace at trace_path through the cache, which must have been
+ * created with CACHE_NODATAPOLICY. If the cache uses CACHE_REPLACEMENTPOLICY_OPT,
+ * next_use_path must name the output of opt_compute_next_use, otherwise it
+ * may be NULL. Returns 0 on success and -1 on failure.
+ */
+int opt_replay(cache_t *cache, const char *trace_path, const char *next_use_path);
+
+/*
+ * Print the miss rates of cache and opt, and the gap between them.
+ */
+void opt_print_gap(FILE *out, cache_t *cache, cache_t *opt);
+
+/*
+ * Replay the trace at trace_path through a cache with the given geometry
+ * and policies and through the same cache using OPT, and print the gap.
+ * Returns 0 on success and -1 on failure.
+ */
+int opt_compare(FILE *out, const char *trace_path, size_t num_bytes, size_t block_size,
+                size_t associativity, uint8_t policies);
+
+#endif
@@ -0,0 +1,218 @@
+#include "partition.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * Give each tenant a contiguous range of ways, of the sizes in ways.
+ */
+static void cache_partition_assign(cache_t *cache, const size_t *ways) {
+    cache_partition_t *partition = cache->partition;
+    size_t first_way = 0;
+    for (size_t t = 0; t < partition->num_tenants; t++) {
+        uint64_t mask = ways[t] >= 64 ? ~0ULL : ((1ULL << ways[t]) - 1);
+        partition->tenants[t].way_mask = mask << first_way;
+        first_way += ways[t];
+    }
+}
+
+/*
+ * Partition the ways of the cache evenly between tenants.
+ */
+int cache_partition_init(cache_t *cache, size_t num_tenants, uint64_t repartition_interval) {
+
+    switch (cache->policies & CACHE_REPLACEMENTPOLICY_MASK) {
+        case CACHE_REPLACEMENTPOLICY_LRU:
+        case CACHE_REPLACEMENTPOLICY_LIP:
+        case CACHE_REPLACEMENTPOLICY_BIP:
+        case CACHE_REPLACEMENTPOLICY_DIP:
+            break;
+        default:
+            return -1;
+    }
+    if (num_tenants == 0 || num_tenants > CACHE_PARTITION_MAX_TENANTS
+        || num_tenants > cache->associativity || cache->associativity > CACHE_PARTITION_MAX_WAYS) {
+        return -1;
+    }
+    if (cache->partition != NULL) {
+        cache_partition_free(cache);
+    }
+
+    cache_partition_t *partition = (cache_partition_t *)malloc(sizeof(cache_partition_t));
+    partition->num_tenants = num_tenants;
+    partition->current_tenant = 0;
+    partition->repartition_interval = repartition_interval;
+    partition->accesses_since_repartition = 0;
+
+    partition->shadow_stride = cache->num_sets / CACHE_PARTITION_SHADOW_SETS;
+    if (partition->shadow_stride == 0) {
+        partition->shadow_stride = 1;
+    }
+    size_t num_shadow_sets = (cache->num_sets + partition->shadow_stride - 1) / partition->shadow_stride;
+
+    partition->tenants = (cache_tenant_t *)calloc(num_tenants, sizeof(cache_tenant_t));
+    for (size_t t = 0; t < num_tenants; t++) {
+        cache_tenant_t *tenant = partition->tenants + t;
+        tenant->shadow_tags = (uintptr_t *)malloc(num_shadow_sets * cache->associativity * sizeof(uintptr_t));
+        for (size_t i = 0; i < num_shadow_sets * cache->associativity; i++) {
+            tenant->shadow_tags[i] = CACHE_PARTITION_NO_TAG;
+        }
+        tenant->shadow_hits = (uint64_t *)calloc(cache->associativity, sizeof(uint64_t));
+    }
+
+    cache->partition = partition;
+    cache->policies |= CACHE_PARTITIONPOLICY;
+
+    // Start with an even split, the first tenants getting the leftover ways.
+    size_t ways[CACHE_PARTITION_MAX_TENANTS];
+    for (size_t t = 0; t < num_tenants; t++) {
+        ways[t] = cache->associativity / num_tenants + (t < cache->associativity % num_tenants ? 1 : 0);
+    }
+    cache_partition_assign(cache, ways);
+
+    return 0;
+}
+
+/*
+ * Frees the partitioning state of a cache.
+ */
+void cache_partition_free(cache_t *cache) {
+    cache_partition_t *partition = cache->partition;
+    for (size_t t = 0; t < partition->num_tenants; t++) {
+        free(partition->tenants[t].shadow_tags);
+        free(partition->tenants[t].shadow_hits);
+    }
+    free(partition->tenants);
+    free(partition);
+
+    cache->partition = NULL;
+    cache->policies &= ~CACHE_PARTITION_MASK;
+}
+
+/*
+ * Give a tenant the ways set in way_mask.
+ */
+void cache_partition_set_ways(cache_t *cache, unsigned int tenant, uint64_t way_mask) {
+    cache->partition->tenants[tenant].way_mask = way_mask;
+}
+
+/*
+ * Read a single long integer from the cache on behalf of a tenant.
+ */
+uint64_t cache_read_tenant(cache_t *cache, uintptr_t address, unsigned int tenant, func_t generate_random_number) {
+    cache->partition->current_tenant = tenant;
+    return cache_read(cache, address, generate_random_number);
+}
+
+/*
+ * Return the ways the current tenant may replace.
+ */
+uint64_t cache_partition_way_mask(cache_t *cache) {
+    return cache->partition->tenants[cache->partition->current_tenant].way_mask;
+}
+
+/*
+ * Count an access of the current tenant, and update its utility monitor
+ * if the set is sampled.
+ */
+void cache_partition_access(cache_t *cache, size_t index, uintptr_t tag) {
+
+    cache_partition_t *partition = cache->partition;
+    cache_tenant_t *tenant = partition->tenants + partition->current_tenant;
+    tenant->access_count++;
+
+    if (index % partition->shadow_stride == 0) {
+        uintptr_t *tags = tenant->shadow_tags + (index / partition->shadow_stride) * cache->associativity;
+
+        // Find the tag's position in MRU order; a miss drops the LRU entry.
+        size_t position = cache->associativity - 1;
+        for (size_t i = 0; i < cache->associativity; i++) {
+            if (tags[i] == tag) {
+                tenant->shadow_hits[i]++;
+                position = i;
+                break;
+            }
+        }
+        for (size_t i = position; i > 0; i--) {
+            tags[i] = tags[i - 1];
+        }
+        tags[0] = tag;
+    }
+
+    if (partition->repartition_interval != 0
+        && ++partition->accesses_since_repartition >= partition->repartition_interval) {
+        cache_partition_repartition(cache);
+        partition->accesses_since_repartition = 0;
+    }
+}
+
+/*
+ * Count a miss of the current tenant.
+ */
+void cache_partition_miss(cache_t *cache) {
+    cache->partition->tenants[cache->partition->current_tenant].miss_count++;
+}
+
+/*
+ * Reallocate ways with the lookahead algorithm of UCP: every tenant keeps
+ * at least one way, and the remaining ways are handed out one group at a
+ * time to the tenant with the highest number of extra hits per way.
+ */
+void cache_partition_repartition(cache_t *cache) {
+
+    cache_partition_t *partition = cache->partition;
+    size_t ways[CACHE_PARTITION_MAX_TENANTS];
+    for (size_t t = 0; t < partition->num_tenants; t++) {
+        ways[t] = 1;
+    }
+
+    size_t balance = cache->associativity - partition->num_tenants;
+    while (balance > 0) {
+        size_t winner = 0, winner_ways = 1;
+        double winner_utility = -1;
+
+        for (size_t t = 0; t < partition->num_tenants; t++) {
+            uint64_t *hits = partition->tenants[t].shadow_hits;
+            uint64_t gained = 0;
+            for (size_t k = 1; k <= balance; k++) {
+                gained += hits[ways[t] + k - 1];
+                double utility = (double) gained / k;
+                if (utility > winner_utility) {
+                    winner = t;
+                    winner_ways = k;
+                    winner_utility = utility;
+                }
+            }
+        }
+
+        ways[winner] += winner_ways;
+        balance -= winner_ways;
+    }
+
+    cache_partition_assign(cache, ways);
+
+    // Age the monitors so that allocations follow phase changes.
+    for (size_t t = 0; t < partition->num_tenants; t++) {
+        for (size_t i = 0; i < cache->associativity; i++) {
+            partition->tenants[t].shadow_hits[i] /= 2;
+        }
+    }
+}
+
+/*
+ * Print the ways, accesses and miss rate of every tenant.
+ */
+void cache_partition_print_stats(FILE *out, cache_t *cache) {
+
+    cache_partition_t *partition = cache->partition;
+    for (size_t t = 0; t < partition->num_tenants; t++) {
+        cache_tenant_t *tenant = partition->tenants + t;
+        fprintf(out, "Tenant %zu: ways = %2d, accesses = %10" PRIu64 ", ", t,
+                __builtin_popcountll(tenant->way_mask), tenant->access_count);
+        if (tenant->access_count == 0) {
+            fprintf(out, "unused\n");
+        } else {
+            fprintf(out, "miss rate = %8.4f\n", (double) tenant->miss_count / tenant->access_count);
+        }
+    }
+}
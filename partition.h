@@ -0,0 +1,105 @@
+/*
+ * partition.h
+ *
+ * Way partitioning of a cache between tenants, in the style of Intel CAT,
+ * and utility-based cache partitioning (UCP) which periodically moves ways
+ * to the tenants that would gain the most hits from them.
+ *
+ * All tenants can hit on any line, but a tenant only replaces lines in the
+ * ways of its way mask. Victims are chosen in LRU order, so partitioning
+ * needs a cache whose policy keeps lru_list up to date (LRU, LIP, BIP or DIP).
+ */
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include "cache.h"
+
+/*
+ * Maximum number of tenants, and maximum associativity of a partitioned cache.
+ */
+#define CACHE_PARTITION_MAX_TENANTS 64
+#define CACHE_PARTITION_MAX_WAYS    64
+
+/*
+ * Number of sets sampled by each tenant's utility monitor.
+ */
+#define CACHE_PARTITION_SHADOW_SETS 32
+
+/*
+ * Marks an empty entry in the shadow tags.
+ */
+#define CACHE_PARTITION_NO_TAG UINTPTR_MAX
+
+/*
+ * Structure used to store a tenant: its ways, statistics, and a utility
+ * monitor made of shadow tags for a sample of the sets. The shadow tags
+ * of a set are kept in MRU order with the full associativity of the cache,
+ * and shadow_hits counts the hits at each position of that order.
+ */
+typedef struct cache_tenant_s {
+    uint64_t way_mask;
+    uint64_t access_count, miss_count;
+
+    uintptr_t *shadow_tags;
+    uint64_t *shadow_hits;
+} cache_tenant_t;
+
+/*
+ * Structure used to store the partitioning state of a cache.
+ */
+typedef struct cache_partition_s {
+    size_t num_tenants;
+    cache_tenant_t *tenants;
+
+    /* Tenant of the access being simulated. */
+    unsigned int current_tenant;
+
+    /* Only sets whose index is a multiple of shadow_stride are monitored. */
+    size_t shadow_stride;
+
+    /* Number of accesses between two UCP reallocations, 0 to disable UCP. */
+    uint64_t repartition_interval;
+    uint64_t accesses_since_repartition;
+} cache_partition_t;
+
+/*
+ * Partition the ways of the cache evenly between num_tenants tenants. If
+ * repartition_interval is not 0, ways are reallocated with UCP every
+ * repartition_interval accesses. Returns 0 on success and -1 if the cache
+ * cannot be partitioned.
+ */
+int cache_partition_init(cache_t *cache, size_t num_tenants, uint64_t repartition_interval);
+
+/*
+ * Frees the partitioning state of a cache.
+ */
+void cache_partition_free(cache_t *cache);
+
+/*
+ * Give a tenant the ways set in way_mask, as with a CAT capacity bitmask.
+ */
+void cache_partition_set_ways(cache_t *cache, unsigned int tenant, uint64_t way_mask);
+
+/*
+ * Read a single long integer from the cache on behalf of a tenant.
+ */
+uint64_t cache_read_tenant(cache_t *cache, uintptr_t address, unsigned int tenant, func_t generate_random_number);
+
+/*
+ * Reallocate ways between tenants according to their utility monitors.
+ */
+void cache_partition_repartition(cache_t *cache);
+
+/*
+ * Print the ways, accesses and miss rate of every tenant.
+ */
+void cache_partition_print_stats(FILE *out, cache_t *cache);
+
+/*
+ *  Helpers used by cache_read
+ */
+uint64_t cache_partition_way_mask(cache_t *cache);
+void cache_partition_access(cache_t *cache, size_t index, uintptr_t tag);
+void cache_partition_miss(cache_t *cache);
+
+#endif
@@ -0,0 +1,137 @@
+#include "pctable.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define CACHE_PC_TABLE_INITIAL_CAPACITY 256
+
+/*
+ * Start attributing the accesses and misses of the cache to program counters.
+ */
+void cache_pc_table_init(cache_t *cache) {
+
+    if (cache->pc_table != NULL) {
+        cache_pc_table_free(cache);
+    }
+
+    cache_pc_table_t *table = (cache_pc_table_t *)malloc(sizeof(cache_pc_table_t));
+    table->capacity = CACHE_PC_TABLE_INITIAL_CAPACITY;
+    table->count = 0;
+    table->entries = (cache_pc_entry_t *)calloc(table->capacity, sizeof(cache_pc_entry_t));
+    table->current = NULL;
+
+    cache->pc_table = table;
+}
+
+/*
+ * Frees the program counter table of a cache.
+ */
+void cache_pc_table_free(cache_t *cache) {
+    free(cache->pc_table->entries);
+    free(cache->pc_table);
+    cache->pc_table = NULL;
+}
+
+/*
+ * Return the slot of a program counter: either its entry or an empty one.
+ */
+static cache_pc_entry_t *cache_pc_table_slot(cache_pc_table_t *table, uintptr_t pc) {
+    size_t slot = (pc * 0x9e3779b97f4a7c15ULL) >> 20 & (table->capacity - 1);
+    while (table->entries[slot].access_count != 0 && table->entries[slot].pc != pc) {
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    return table->entries + slot;
+}
+
+static void cache_pc_table_grow(cache_pc_table_t *table) {
+    cache_pc_entry_t *entries = table->entries;
+    size_t capacity = table->capacity;
+
+    table->capacity *= 2;
+    table->entries = (cache_pc_entry_t *)calloc(table->capacity, sizeof(cache_pc_entry_t));
+    for (size_t i = 0; i < capacity; i++) {
+        if (entries[i].access_count != 0) {
+            *cache_pc_table_slot(table, entries[i].pc) = entries[i];
+        }
+    }
+    free(entries);
+}
+
+/*
+ * Read a single long integer from the cache, on behalf of the instruction at pc.
+ */
+uint64_t cache_read_pc(cache_t *cache, uintptr_t address, uintptr_t pc, func_t generate_random_number) {
+    cache->access_pc = pc;
+    uint64_t value = cache_read(cache, address, generate_random_number);
+    cache->access_pc = 0;
+    return value;
+}
+
+/*
+ * Return the statistics of a program counter, or NULL if it was never seen.
+ */
+cache_pc_entry_t *cache_pc_table_find(cache_t *cache, uintptr_t pc) {
+    cache_pc_entry_t *entry = cache_pc_table_slot(cache->pc_table, pc);
+    return entry->access_count != 0 ? entry : NULL;
+}
+
+/*
+ * Count an access of the current program counter.
+ */
+void cache_pc_table_access(cache_t *cache) {
+
+    cache_pc_table_t *table = cache->pc_table;
+    if (table->current == NULL || table->current->pc != cache->access_pc) {
+        if (2 * (table->count + 1) > table->capacity) {
+            cache_pc_table_grow(table);
+        }
+        table->current = cache_pc_table_slot(table, cache->access_pc);
+        if (table->current->access_count == 0) {
+            table->current->pc = cache->access_pc;
+            table->count++;
+        }
+    }
+    table->current->access_count++;
+}
+
+/*
+ * Count a miss of the current program counter.
+ */
+void cache_pc_table_miss(cache_t *cache) {
+    cache->pc_table->current->miss_count++;
+}
+
+static int compare_misses(const void *a, const void *b) {
+    const cache_pc_entry_t *x = (const cache_pc_entry_t *)a, *y = (const cache_pc_entry_t *)b;
+    if (x->miss_count != y->miss_count) {
+        return x->miss_count < y->miss_count ? 1 : -1;
+    }
+    return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+/*
+ * Print the top program counters, ranked by number of misses.
+ */
+void cache_pc_table_print(FILE *out, cache_t *cache, size_t top) {
+
+    cache_pc_table_t *table = cache->pc_table;
+    cache_pc_entry_t *ranked = (cache_pc_entry_t *)malloc(table->count * sizeof(cache_pc_entry_t));
+    size_t count = 0;
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i].access_count != 0) {
+            ranked[count++] = table->entries[i];
+        }
+    }
+    qsort(ranked, count, sizeof(cache_pc_entry_t), compare_misses);
+
+    uint64_t total_misses = cache_miss_count(cache);
+    fprintf(out, "%-18s %12s %12s %9s %9s\n", "PC", "accesses", "misses", "miss rate", "of misses");
+    for (size_t i = 0; i < count && i < top; i++) {
+        fprintf(out, "0x%016" PRIxPTR " %12" PRIu64 " %12" PRIu64 " %9.4f %9.4f\n", ranked[i].pc,
+                ranked[i].access_count, ranked[i].miss_count,
+                (double) ranked[i].miss_count / ranked[i].access_count,
+                total_misses == 0 ? 0.0 : (double) ranked[i].miss_count / total_misses);
+    }
+
+    free(ranked);
+}
@@ -0,0 +1,64 @@
+/*
+ * pctable.h
+ *
+ * Attribution of accesses and misses to the program counter of the
+ * instruction that made them, to find which loads cause the most misses.
+ */
+#ifndef PCTABLE_H
+#define PCTABLE_H
+
+#include "cache.h"
+
+/*
+ * Structure used to store the statistics of one program counter. Entries
+ * with an access_count of 0 are empty.
+ */
+typedef struct cache_pc_entry_s {
+    uintptr_t pc;
+    uint64_t access_count, miss_count;
+} cache_pc_entry_t;
+
+/*
+ * Structure used to store a hash table of program counters.
+ */
+typedef struct cache_pc_table_s {
+    size_t capacity;
+    size_t count;
+    cache_pc_entry_t *entries;
+
+    /* Entry of the access being simulated. */
+    cache_pc_entry_t *current;
+} cache_pc_table_t;
+
+/*
+ * Start attributing the accesses and misses of the cache to program counters.
+ */
+void cache_pc_table_init(cache_t *cache);
+
+/*
+ * Frees the program counter table of a cache.
+ */
+void cache_pc_table_free(cache_t *cache);
+
+/*
+ * Read a single long integer from the cache, on behalf of the instruction at pc.
+ */
+uint64_t cache_read_pc(cache_t *cache, uintptr_t address, uintptr_t pc, func_t generate_random_number);
+
+/*
+ * Return the statistics of a program counter, or NULL if it was never seen.
+ */
+cache_pc_entry_t *cache_pc_table_find(cache_t *cache, uintptr_t pc);
+
+/*
+ * Print the top program counters, ranked by number of misses.
+ */
+void cache_pc_table_print(FILE *out, cache_t *cache, size_t top);
+
+/*
+ *  Helpers used by cache_read
+ */
+void cache_pc_table_access(cache_t *cache);
+void cache_pc_table_miss(cache_t *cache);
+
+#endif
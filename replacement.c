@@ -0,0 +1,378 @@
+#include "replacement.h"
+#include "partition.h"
+#include "fullassoc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Move the cache lines inside a cache set so the cache line with the
+ * given index is tagged as the most recently used one. The least
+ * recently used cache line will be the 0'th one in the set, the
+ * second least recently used cache line will be next, etc.  Cache
+ * lines whose valid bit is 0 will occur before all cache lines whose
+ * valid bit is 1.
+ */
+static void cache_line_make_mru(cache_t *cache, cache_set_t *cache_set, size_t line_index) {
+    size_t index_of_line_index = -1;
+    for (size_t i = 0; i < cache->associativity; i++) {
+        if (cache_set->lru_list[i] == line_index) {
+            index_of_line_index = i;
+            break;
+        }
+    }
+
+    for (size_t i = index_of_line_index + 1; i < cache->associativity; i++) {
+        cache_set->lru_list[i - 1] = cache_set->lru_list[i];
+    }
+    cache_set->lru_list[cache->associativity - 1] = line_index;
+}
+
+/*
+ * Move the cache lines inside a cache set so the cache line with the
+ * given index is tagged as the least recently used one.
+ */
+static void cache_line_make_lru(cache_t *cache, cache_set_t *cache_set, size_t line_index) {
+    size_t index_of_line_index = 0;
+    for (size_t i = 0; i < cache->associativity; i++) {
+        if (cache_set->lru_list[i] == line_index) {
+            index_of_line_index = i;
+            break;
+        }
+    }
+
+    for (size_t i = index_of_line_index; i > 0; i--) {
+        cache_set->lru_list[i] = cache_set->lru_list[i - 1];
+    }
+    cache_set->lru_list[0] = line_index;
+}
+
+/*
+ * Return the index of the line to replace in a set ordered by lru_list:
+ * the invalid line closest to the MRU position if there is one, otherwise
+ * the least recently used line. In a partitioned cache, only the ways of
+ * the current tenant are considered.
+ */
+static size_t cache_set_lru_victim(cache_t *cache, cache_set_t *cache_set, func_t generate_random_number) {
+
+  cache_line_t* lines = cache_set->lines + cache_set->first_index;
+
+  if ((cache->policies & CACHE_PARTITION_MASK) == CACHE_PARTITIONPOLICY) {
+    uint64_t way_mask = cache_partition_way_mask(cache);
+    for (int i = (cache -> associativity); i > 0; i--) {
+      size_t index = cache_set->lru_list[i-1];
+      if ((way_mask >> index & 1) && !lines[index].is_valid) {
+        return index;
+      }
+    }
+    for (size_t i = 0; i < cache->associativity; i++) {
+      if (way_mask >> cache_set->lru_list[i] & 1) {
+        return cache_set->lru_list[i];
+      }
+    }
+    return cache_set->lru_list[0];
+  }
+
+  for (int i = (cache -> associativity); i > 0; i--) {
+    size_t index = cache_set->lru_list[i-1];
+    if (!lines[index].is_valid) {
+      return index;
+    }
+  }
+  return cache_set->lru_list[0];
+}
+
+static void cache_lru_hit(cache_t *cache, cache_set_t *cache_set, size_t way) {
+    cache_line_make_mru(cache, cache_set, way);
+}
+
+static void cache_lru_fill(cache_t *cache, cache_set_t *cache_set, size_t way, func_t generate_random_number) {
+    cache_line_make_mru(cache, cache_set, way);
+}
+
+/*
+ * LIP inserts at the LRU position, and BIP too, except that one insertion
+ * in CACHE_BIP_EPSILON on average goes to the MRU position.
+ */
+static void cache_lip_fill(cache_t *cache, cache_set_t *cache_set, size_t way, func_t generate_random_number) {
+    cache_line_make_lru(cache, cache_set, way);
+}
+
+static void cache_bip_fill(cache_t *cache, cache_set_t *cache_set, size_t way, func_t generate_random_number) {
+    if (generate_random_number() % CACHE_BIP_EPSILON == 0) {
+        cache_line_make_mru(cache, cache_set, way);
+    } else {
+        cache_line_make_lru(cache, cache_set, way);
+    }
+}
+
+static bool cache_lru_hit_is_stable(cache_t *cache, cache_set_t *cache_set, size_t way) {
+    return cache_set->lru_list[cache->associativity - 1] == way;
+}
+
+/*
+ * Function to choose a random unmarked line from the cache. If all lines are
+ * marked, then it unmarks them all first.
+ */
+size_t choose_unmarked_cache_line(cache_t *cache, cache_set_t *cache_set, func_t generate_random_number) {
+
+  cache_line_t* lines = cache_set->lines + cache_set->first_index;
+
+  //unmark all if all were marked
+  if (cache_set->num_marked == cache->associativity) {
+    for(int i = 0; i < cache->associativity; i++) {
+      lines[i].is_marked = false;
+    }
+    cache_set->num_marked = 0;
+  }
+
+  //if there is invalid cache, replace it
+  for (int i = 0; i < cache->associativity; i++) {
+    if (lines[i].is_valid == false) {
+      return i;
+    }
+  }
+
+  int select = generate_random_number() % (cache->associativity - cache_set->num_marked);
+  for (int i = 0; i < cache->associativity; i++) {
+    if (select == 0 && lines[i].is_marked == false) {
+      return i;
+    }
+    if (lines[i].is_marked == false) {
+      select --;
+    }
+  }
+
+  // num_marked counts the marked lines, so one of the others was chosen.
+  assert(false);
+  return 0;
+}
+
+static void cache_rm_fill(cache_t *cache, cache_set_t *cache_set, size_t way, func_t generate_random_number) {
+    cache_set->lines[cache_set->first_index + way].is_marked = true;
+    cache_set->num_marked ++;
+}
+
+static void cache_rm_invalidate(cache_t *cache, cache_set_t *cache_set, size_t way) {
+    cache_line_t *line = cache_set->lines + cache_set->first_index + way;
+    if (line->is_marked) {
+        line->is_marked = false;
+        cache_set->num_marked--;
+    }
+}
+
+/*
+ * Hits change nothing under randomized marking.
+ */
+static bool cache_rm_hit_is_stable(cache_t *cache, cache_set_t *cache_set, size_t way) {
+    return true;
+}
+
+/*
+ * OPT records the time of every use, and evicts an invalid line if there
+ * is one, otherwise the line whose next use is farthest in the future.
+ */
+static void cache_opt_use(cache_t *cache, cache_set_t *cache_set, size_t way) {
+    cache->next_use[cache_set->first_index + way] = cache->access_next_use;
+}
+
+static size_t cache_opt_victim(cache_t *cache, cache_set_t *cache_set, func_t generate_random_number) {
+    cache_line_t *lines = cache_set->lines + cache_set->first_index;
+    uint64_t *next_use = cache->next_use + cache_set->first_index;
+    size_t index = 0;
+    for (size_t i = 0; i < cache->associativity; i++) {
+        if (!lines[i].is_valid) {
+            return i;
+        }
+        if (next_use[i] > next_use[index]) {
+            index = i;
+        }
+    }
+    return index;
+}
+
+static void cache_opt_fill(cache_t *cache, cache_set_t *cache_set, size_t way, func_t generate_random_number) {
+    cache_opt_use(cache, cache_set, way);
+}
+
+/*
+ * Return which leader group (0 or 1) a set belongs to for set dueling,
+ * or -1 if it is a follower set.
+ */
+static int cache_set_duel_leader(cache_t *cache, cache_set_t *cache_set) {
+    size_t position = (cache_set - cache->sets) % cache->duel.leader_stride;
+    if (position == 0) {
+        return 0;
+    }
+    if (position == cache->duel.leader_stride / 2) {
+        return 1;
+    }
+    return -1;
+}
+
+/*
+ * Return the dueling policy used by a set: its own in leader sets, and
+ * the one whose leaders miss less in follower sets.
+ */
+static const cache_replacement_t *cache_set_duel_member(cache_t *cache, cache_set_t *cache_set) {
+    int leader = cache_set_duel_leader(cache, cache_set);
+    if (leader >= 0) {
+        return cache->duel.members[leader];
+    }
+    return cache->duel.members[cache->duel.psel > cache->duel.psel_max / 2];
+}
+
+static void cache_dip_hit(cache_t *cache, cache_set_t *cache_set, size_t way) {
+    const cache_replacement_t *member = cache_set_duel_member(cache, cache_set);
+    if (member->on_hit != NULL) {
+        member->on_hit(cache, cache_set, way);
+    }
+}
+
+/*
+ * Choosing a victim means the set missed: move the selector away from the
+ * policy of a leader set.
+ */
+static size_t cache_dip_victim(cache_t *cache, cache_set_t *cache_set, func_t generate_random_number) {
+    int leader = cache_set_duel_leader(cache, cache_set);
+    if (leader == 0 && cache->duel.psel < cache->duel.psel_max) {
+        cache->duel.psel++;
+    } else if (leader == 1 && cache->duel.psel > 0) {
+        cache->duel.psel--;
+    }
+    return cache_set_duel_member(cache, cache_set)->choose_victim(cache, cache_set, generate_random_number);
+}
+
+static void cache_dip_fill(cache_t *cache, cache_set_t *cache_set, size_t way, func_t generate_random_number) {
+    const cache_replacement_t *member = cache_set_duel_member(cache, cache_set);
+    if (member->on_fill != NULL) {
+        member->on_fill(cache, cache_set, way, generate_random_number);
+    }
+}
+
+static void cache_dip_invalidate(cache_t *cache, cache_set_t *cache_set, size_t way) {
+    const cache_replacement_t *member = cache_set_duel_member(cache, cache_set);
+    if (member->on_invalidate != NULL) {
+        member->on_invalidate(cache, cache_set, way);
+    }
+}
+
+static bool cache_dip_hit_is_stable(cache_t *cache, cache_set_t *cache_set, size_t way) {
+    const cache_replacement_t *member = cache_set_duel_member(cache, cache_set);
+    return member->hit_is_stable != NULL && member->hit_is_stable(cache, cache_set, way);
+}
+
+static const cache_replacement_t cache_replacement_lru = {
+    "lru", 0, cache_lru_hit, cache_set_lru_victim, cache_lru_fill, NULL, cache_lru_hit_is_stable,
+};
+static const cache_replacement_t cache_replacement_lip = {
+    "lip", 0, cache_lru_hit, cache_set_lru_victim, cache_lip_fill, NULL, cache_lru_hit_is_stable,
+};
+static const cache_replacement_t cache_replacement_bip = {
+    "bip", 0, cache_lru_hit, cache_set_lru_victim, cache_bip_fill, NULL, cache_lru_hit_is_stable,
+};
+static const cache_replacement_t cache_replacement_dip = {
+    "dip", 0, cache_dip_hit, cache_dip_victim, cache_dip_fill, cache_dip_invalidate, cache_dip_hit_is_stable,
+};
+static const cache_replacement_t cache_replacement_rm = {
+    "rm", 0, NULL, choose_unmarked_cache_line, cache_rm_fill, cache_rm_invalidate, cache_rm_hit_is_stable,
+};
+static const cache_replacement_t cache_replacement_opt = {
+    "opt", 0, cache_opt_use, cache_opt_victim, cache_opt_fill, NULL, NULL,
+};
+
+/*
+ * Built-in policies, indexed by their replacement bits.
+ */
+static const cache_replacement_t *cache_replacement_builtins[] = {
+    NULL,                   // RANDOM
+    &cache_replacement_lru,
+    NULL,                   // MRU
+    &cache_replacement_opt,
+    &cache_replacement_rm,
+    &cache_replacement_lip,
+    &cache_replacement_bip,
+    &cache_replacement_dip,
+};
+
+static const cache_replacement_t *cache_replacement_registered[CACHE_REPLACEMENT_MAX_REGISTERED];
+static size_t cache_replacement_num_registered = 0;
+
+/*
+ * Return the built-in policy selected by the replacement bits of policies.
+ */
+const cache_replacement_t *cache_replacement_builtin(uint8_t policies) {
+    return cache_replacement_builtins[(policies & CACHE_REPLACEMENTPOLICY_MASK) >> 2];
+}
+
+/*
+ * Register a policy.
+ */
+int cache_replacement_register(const cache_replacement_t *replacement) {
+    if (replacement->choose_victim == NULL || cache_replacement_find(replacement->name) != NULL
+        || cache_replacement_num_registered == CACHE_REPLACEMENT_MAX_REGISTERED) {
+        return -1;
+    }
+    cache_replacement_registered[cache_replacement_num_registered++] = replacement;
+    return 0;
+}
+
+/*
+ * Return the policy with the given name.
+ */
+const cache_replacement_t *cache_replacement_find(const char *name) {
+    for (size_t i = 0; i < sizeof(cache_replacement_builtins) / sizeof(cache_replacement_builtins[0]); i++) {
+        if (cache_replacement_builtins[i] != NULL && strcmp(cache_replacement_builtins[i]->name, name) == 0) {
+            return cache_replacement_builtins[i];
+        }
+    }
+    for (size_t i = 0; i < cache_replacement_num_registered; i++) {
+        if (strcmp(cache_replacement_registered[i]->name, name) == 0) {
+            return cache_replacement_registered[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Make a cache use the given policy, with fresh state. Compressed caches
+ * evict in lru_list order, so they only take policies keeping it.
+ */
+int cache_replacement_install(cache_t *cache, const cache_replacement_t *replacement) {
+
+    if (cache->compression != NULL && replacement != &cache_replacement_lru && replacement != &cache_replacement_lip
+        && replacement != &cache_replacement_bip && replacement != &cache_replacement_dip) {
+        return -1;
+    }
+
+    uint8_t *state = NULL;
+    if (replacement->state_size > 0) {
+        state = (uint8_t *)calloc(cache->num_sets, replacement->state_size);
+        if (state == NULL) {
+            return -1;
+        }
+    }
+    if (cache->fully_associative != NULL) {
+        cache_fully_associative_disable(cache);
+    }
+    free(cache->replacement_state);
+    cache->replacement_state = state;
+    cache->replacement = replacement;
+    cache->last_line = NULL;
+    return 0;
+}
+
+/*
+ * Make a cache duel between two policies.
+ */
+void cache_duel_init_replacements(cache_t *cache, const cache_replacement_t *replacement_0,
+                                  const cache_replacement_t *replacement_1) {
+    cache->duel.members[0] = replacement_0;
+    cache->duel.members[1] = replacement_1;
+    cache->duel.leader_stride = cache->num_sets / CACHE_DUEL_LEADER_SETS;
+    if (cache->duel.leader_stride < 4) {
+        cache->duel.leader_stride = 4;
+    }
+    cache->duel.psel_max = (1 << CACHE_DUEL_PSEL_BITS) - 1;
+    cache->duel.psel = (cache->duel.psel_max + 1) / 2;
+}
@@ -0,0 +1,93 @@
+/*
+ * replacement.h
+ *
+ * Replacement policies as tables of functions, so that new policies can be
+ * tried without touching the lookup code in cache.c.
+ *
+ * A policy is told of every hit and fill in a set, is asked which way to
+ * evict, and is told when a line is invalidated behind its back (by
+ * compression, for instance). It can keep state_size bytes of state per
+ * set, zeroed when the policy is installed, in addition to the lru_list
+ * and marks every set has.
+ *
+ * The policy of a cache is resolved once, when it is created or when
+ * another policy is installed, so reads call it directly instead of
+ * looking at the policy bits on every access.
+ */
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include "cache.h"
+
+/*
+ * Maximum number of policies registered on top of the built-in ones.
+ */
+#define CACHE_REPLACEMENT_MAX_REGISTERED 16
+
+/*
+ * Structure used to store a replacement policy. Any function but
+ * choose_victim may be NULL.
+ */
+typedef struct cache_replacement_s {
+    const char *name;
+
+    /* Bytes of state per set. */
+    size_t state_size;
+
+    /* A line of the set was read. */
+    void (*on_hit)(cache_t *cache, cache_set_t *cache_set, size_t way);
+
+    /* Return the way to fill next, preferring invalid lines. */
+    size_t (*choose_victim)(cache_t *cache, cache_set_t *cache_set, func_t generate_random_number);
+
+    /* The way returned by choose_victim is being filled. */
+    void (*on_fill)(cache_t *cache, cache_set_t *cache_set, size_t way, func_t generate_random_number);
+
+    /* A line of the set was invalidated without being replaced. */
+    void (*on_invalidate)(cache_t *cache, cache_set_t *cache_set, size_t way);
+
+    /* Whether another hit on the way would leave the state unchanged. */
+    bool (*hit_is_stable)(cache_t *cache, cache_set_t *cache_set, size_t way);
+} cache_replacement_t;
+
+/*
+ * Return the built-in policy selected by the replacement bits of policies,
+ * or NULL if it is not implemented.
+ */
+const cache_replacement_t *cache_replacement_builtin(uint8_t policies);
+
+/*
+ * Register a policy, so that cache_replacement_find knows it. The policy
+ * must outlive every cache using it. Returns 0 on success and -1 if the
+ * name is taken or there is no room left.
+ */
+int cache_replacement_register(const cache_replacement_t *replacement);
+
+/*
+ * Return the built-in or registered policy with the given name ("lru",
+ * "lip", "bip", "dip", "rm", "opt"), or NULL if there is none.
+ */
+const cache_replacement_t *cache_replacement_find(const char *name);
+
+/*
+ * Make a cache use the given policy. The cache should not have been
+ * accessed yet. Returns 0 on success and -1 on failure, which includes
+ * policies other than LRU, LIP, BIP and DIP in compressed caches.
+ */
+int cache_replacement_install(cache_t *cache, const cache_replacement_t *replacement);
+
+/*
+ * Make a cache using set dueling ("dip") duel between two policies, which
+ * must keep no state of their own.
+ */
+void cache_duel_init_replacements(cache_t *cache, const cache_replacement_t *replacement_0,
+                                  const cache_replacement_t *replacement_1);
+
+/*
+ * Return the state of a set.
+ */
+static inline void *cache_replacement_state(cache_t *cache, cache_set_t *cache_set) {
+    return cache->replacement_state + (cache_set - cache->sets) * cache->replacement->state_size;
+}
+
+#endif
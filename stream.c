@@ -0,0 +1,215 @@
+#include "stream.h"
+#include "pctable.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+ * Number of records the consumer reads from the ring at once.
+ */
+#define STREAM_BATCH 256
+
+/*
+ * Microseconds the consumer sleeps when the ring is empty.
+ */
+#define STREAM_IDLE_SLEEP 50
+
+/*
+ * Create a ring in shared memory.
+ */
+stream_consumer_t *stream_consumer_create(const char *name, size_t capacity) {
+
+    size_t rounded = 1;
+    while (rounded < (capacity == 0 ? STREAM_DEFAULT_CAPACITY : capacity)) {
+        rounded *= 2;
+    }
+    size_t length = sizeof(stream_ring_t) + rounded * sizeof(stream_record_t);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, length) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // The object is zero-filled: only the constant fields need writing, and
+    // the magic last, since producers check it.
+    stream_ring_t *ring = (stream_ring_t *)mapping;
+    ring->version = STREAM_VERSION;
+    ring->capacity = rounded;
+    __atomic_store_n(&ring->magic, STREAM_MAGIC, __ATOMIC_RELEASE);
+
+    stream_consumer_t *consumer = (stream_consumer_t *)malloc(sizeof(stream_consumer_t));
+    consumer->name = strdup(name);
+    consumer->ring = ring;
+    consumer->records = (stream_record_t *)(ring + 1);
+    consumer->length = length;
+    consumer->tail = 0;
+    return consumer;
+}
+
+/*
+ * Remove the ring and free the consumer.
+ */
+void stream_consumer_free(stream_consumer_t *consumer) {
+    munmap(consumer->ring, consumer->length);
+    shm_unlink(consumer->name);
+    free(consumer->name);
+    free(consumer);
+}
+
+/*
+ * Move up to count records out of the ring.
+ */
+size_t stream_consume(stream_consumer_t *consumer, stream_record_t *records, size_t count) {
+
+    stream_ring_t *ring = consumer->ring;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    while (consumer->tail + n != head && n < count) {
+        records[n] = consumer->records[(consumer->tail + n) & (ring->capacity - 1)];
+        n++;
+    }
+
+    // The records are copied: the producer may now reuse their slots.
+    consumer->tail += n;
+    __atomic_store_n(&ring->tail, consumer->tail, __ATOMIC_RELEASE);
+    return n;
+}
+
+/*
+ * Read every access of the stream through the cache, until the producer
+ * closes the ring.
+ */
+uint64_t stream_replay(stream_consumer_t *consumer, cache_t *cache) {
+
+    stream_record_t records[STREAM_BATCH];
+    struct timespec pause = {0, STREAM_IDLE_SLEEP * 1000};
+    uint64_t count = 0;
+
+    for (;;) {
+        // Read closed before consuming: records pushed before the producer
+        // closed the ring are then visible.
+        bool closed = __atomic_load_n(&consumer->ring->producer_closed, __ATOMIC_ACQUIRE);
+        size_t n = stream_consume(consumer, records, STREAM_BATCH);
+        for (size_t i = 0; i < n; i++) {
+            cache_read_pc(cache, records[i].address, records[i].pc, rand);
+        }
+        count += n;
+
+        if (n == 0) {
+            if (closed) {
+                break;
+            }
+            nanosleep(&pause, NULL);
+        }
+    }
+    return count;
+}
+
+/*
+ * Print the number of records streamed, dropped, and the times the
+ * producer had to wait.
+ */
+void stream_print_stats(FILE *out, stream_consumer_t *consumer) {
+    stream_ring_t *ring = consumer->ring;
+    uint64_t dropped = __atomic_load_n(&ring->dropped_count, __ATOMIC_RELAXED);
+    uint64_t full = __atomic_load_n(&ring->full_count, __ATOMIC_RELAXED);
+    fprintf(out, "Records consumed = %" PRIu64 "\n", consumer->tail);
+    fprintf(out, "Records dropped  = %" PRIu64 "\n", dropped);
+    fprintf(out, "Producer waits   = %" PRIu64 "\n", full);
+}
+
+/*
+ * Attach to a ring in shared memory, as its only producer.
+ */
+stream_producer_t *stream_producer_open(const char *name, int mode) {
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    off_t length = lseek(fd, 0, SEEK_END);
+    if (length < (off_t) sizeof(stream_ring_t)) {
+        close(fd);
+        return NULL;
+    }
+    void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    stream_ring_t *ring = (stream_ring_t *)mapping;
+    uint32_t detached = 0;
+    if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != STREAM_MAGIC || ring->version != STREAM_VERSION
+        || sizeof(stream_ring_t) + ring->capacity * sizeof(stream_record_t) > (size_t) length
+        || !__atomic_compare_exchange_n(&ring->producer_attached, &detached, 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        munmap(mapping, length);
+        return NULL;
+    }
+
+    stream_producer_t *producer = (stream_producer_t *)malloc(sizeof(stream_producer_t));
+    producer->ring = ring;
+    producer->records = (stream_record_t *)(ring + 1);
+    producer->length = length;
+    producer->mode = mode;
+    producer->head = ring->head;
+    producer->tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return producer;
+}
+
+/*
+ * Push an access.
+ */
+bool stream_push(stream_producer_t *producer, uint64_t address, uint64_t pc) {
+
+    stream_ring_t *ring = producer->ring;
+
+    // Only read the shared tail when the private copy says the ring is full.
+    if (producer->head - producer->tail == ring->capacity) {
+        producer->tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (producer->head - producer->tail == ring->capacity) {
+            if (producer->mode == STREAM_MODE_DROP) {
+                __atomic_store_n(&ring->dropped_count, ring->dropped_count + 1, __ATOMIC_RELAXED);
+                return false;
+            }
+            __atomic_store_n(&ring->full_count, ring->full_count + 1, __ATOMIC_RELAXED);
+            while (producer->head - producer->tail == ring->capacity) {
+                sched_yield();
+                producer->tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+            }
+        }
+    }
+
+    stream_record_t *record = producer->records + (producer->head & (ring->capacity - 1));
+    record->address = address;
+    record->pc = pc;
+    producer->head++;
+    __atomic_store_n(&ring->head, producer->head, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*
+ * Tell the consumer that no more accesses will come, and detach from the ring.
+ */
+void stream_producer_close(stream_producer_t *producer) {
+    __atomic_store_n(&producer->ring->producer_closed, 1, __ATOMIC_RELEASE);
+    munmap(producer->ring, producer->length);
+    free(producer);
+}
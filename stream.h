@@ -0,0 +1,141 @@
+/*
+ * stream.h
+ *
+ * Streaming of accesses from an instrumented process to a simulator
+ * running in another process, through a ring buffer in shared memory.
+ *
+ * The simulator creates the ring with stream_consumer_create, and the
+ * instrumented program attaches to it by name with stream_producer_open and
+ * pushes one record per access. There is a single producer and a single
+ * consumer, which only share the head and tail counters, so no lock or
+ * system call is needed on either side.
+ *
+ * When the ring is full, a blocking producer waits for the consumer
+ * (backpressure), while a dropping producer discards the record. Both are
+ * counted in the ring, and reported by the consumer.
+ */
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "cache.h"
+
+#define STREAM_MAGIC   0x4d525453 /* "STRM" */
+#define STREAM_VERSION 1
+
+/*
+ * What a producer does when the ring is full.
+ */
+#define STREAM_MODE_BLOCK 0
+#define STREAM_MODE_DROP  1
+
+/*
+ * Number of records in a ring created with a capacity of 0.
+ */
+#define STREAM_DEFAULT_CAPACITY 65536
+
+/*
+ * Structure used to store an access.
+ */
+typedef struct stream_record_s {
+    uint64_t address;
+    uint64_t pc;
+} stream_record_t;
+
+/*
+ * Header at the start of the shared memory, followed by capacity records.
+ * Fields written by the producer and by the consumer live on different
+ * cache lines.
+ */
+typedef struct stream_ring_s {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint8_t padding[64 - 2 * sizeof(uint32_t) - sizeof(uint64_t)];
+
+    /* Written by the producer: records pushed, records dropped, times it
+     * found the ring full and waited, and whether it attached and closed. */
+    uint64_t head;
+    uint64_t dropped_count;
+    uint64_t full_count;
+    uint32_t producer_attached;
+    uint32_t producer_closed;
+    uint8_t producer_padding[64 - 3 * sizeof(uint64_t) - 2 * sizeof(uint32_t)];
+
+    /* Written by the consumer: records consumed. */
+    uint64_t tail;
+    uint8_t consumer_padding[64 - sizeof(uint64_t)];
+} stream_ring_t;
+
+/*
+ * Structure used by an instrumented program to push accesses.
+ */
+typedef struct stream_producer_s {
+    stream_ring_t *ring;
+    stream_record_t *records;
+    size_t length;
+    int mode;
+
+    /* Private copies of head, and of the last tail read from the ring. */
+    uint64_t head, tail;
+} stream_producer_t;
+
+/*
+ * Structure used by the simulator to read accesses.
+ */
+typedef struct stream_consumer_s {
+    char *name;
+    stream_ring_t *ring;
+    stream_record_t *records;
+    size_t length;
+
+    /* Private copy of tail. */
+    uint64_t tail;
+} stream_consumer_t;
+
+/*
+ * Create a ring of at least capacity records, rounded up to a power of two,
+ * in the shared memory object name (for instance "/cache"). Returns NULL on
+ * failure.
+ */
+stream_consumer_t *stream_consumer_create(const char *name, size_t capacity);
+
+/*
+ * Remove the ring and free the consumer.
+ */
+void stream_consumer_free(stream_consumer_t *consumer);
+
+/*
+ * Move up to count records out of the ring, and return how many were moved.
+ */
+size_t stream_consume(stream_consumer_t *consumer, stream_record_t *records, size_t count);
+
+/*
+ * Read every access of the stream through the cache, which should use
+ * CACHE_NODATAPOLICY, until the producer closes the ring. Returns the number
+ * of accesses read.
+ */
+uint64_t stream_replay(stream_consumer_t *consumer, cache_t *cache);
+
+/*
+ * Print the number of records streamed, dropped, and the times the
+ * producer had to wait.
+ */
+void stream_print_stats(FILE *out, stream_consumer_t *consumer);
+
+/*
+ * Attach to the ring in the shared memory object name, as its only
+ * producer. Returns NULL on failure.
+ */
+stream_producer_t *stream_producer_open(const char *name, int mode);
+
+/*
+ * Push an access. Returns false if it was dropped.
+ */
+bool stream_push(stream_producer_t *producer, uint64_t address, uint64_t pc);
+
+/*
+ * Tell the consumer that no more accesses will come, and detach from the ring.
+ */
+void stream_producer_close(stream_producer_t *producer);
+
+#endif
@@ -0,0 +1,62 @@
+#include "cache.h"
+#include "stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+ * Simulate a cache fed by an instrumented process through a shared memory
+ * ring (see stream.h), then print its statistics.
+ *
+ * Usage: streamd NAME BYTES BLOCK ASSOCIATIVITY [CAPACITY]
+ */
+
+static const char *ring_name;
+
+/*
+ * Remove the ring if the daemon is interrupted before the producer closes it.
+ */
+static void interrupted(int signal) {
+    shm_unlink(ring_name);
+    _exit(1);
+}
+
+int main(int argc, char **argv) {
+
+    if (argc < 5) {
+        fprintf(stderr, "Usage: %s NAME BYTES BLOCK ASSOCIATIVITY [CAPACITY]\n", argv[0]);
+        return 1;
+    }
+
+    size_t capacity = argc > 5 ? strtoull(argv[5], NULL, 0) : 0;
+    stream_consumer_t *consumer = stream_consumer_create(argv[1], capacity);
+    if (consumer == NULL) {
+        fprintf(stderr, "Could not create ring %s\n", argv[1]);
+        return 1;
+    }
+    ring_name = argv[1];
+    signal(SIGINT, interrupted);
+    signal(SIGTERM, interrupted);
+
+    cache_t *cache = cache_new(strtoull(argv[2], NULL, 0), strtoull(argv[3], NULL, 0), strtoull(argv[4], NULL, 0),
+                               CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    if (cache == NULL) {
+        fprintf(stderr, "Lines must hold 8 bytes or more\n");
+        stream_consumer_free(consumer);
+        return 1;
+    }
+
+    fprintf(stderr, "Waiting for accesses on %s\n", argv[1]);
+    stream_replay(consumer, cache);
+
+    size_t ac = cache_access_count(cache);
+    size_t mc = cache_miss_count(cache);
+    printf("Miss rate = %8.4f\n", ac == 0 ? 0.0 : (double) mc / ac);
+    stream_print_stats(stdout, consumer);
+
+    cache_free(cache);
+    stream_consumer_free(consumer);
+    return 0;
+}
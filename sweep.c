@@ -0,0 +1,383 @@
+#include "sweep.h"
+#include "trace.h"
+#include "batch.h"
+#include "replacement.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * Decode a trace into memory.
+ */
+sweep_trace_t *sweep_trace_load(const char *path) {
+
+    trace_reader_t *reader = trace_reader_open(path);
+    if (reader == NULL) {
+        return NULL;
+    }
+
+    sweep_trace_t *trace = (sweep_trace_t *)calloc(1, sizeof(sweep_trace_t));
+    bool has_pc = (reader->flags & TRACE_FLAG_PC) != 0;
+    size_t capacity = TRACE_BUFFER_SIZE;
+    trace->addresses = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+    trace->pcs = has_pc ? (uint64_t *)malloc(capacity * sizeof(uint64_t)) : NULL;
+
+    size_t count;
+    while ((count = trace_read_block(reader, trace->addresses + trace->count,
+                                     has_pc ? trace->pcs + trace->count : NULL, capacity - trace->count)) > 0) {
+        trace->count += count;
+        if (trace->count == capacity) {
+            capacity *= 2;
+            trace->addresses = (uint64_t *)realloc(trace->addresses, capacity * sizeof(uint64_t));
+            if (has_pc) {
+                trace->pcs = (uint64_t *)realloc(trace->pcs, capacity * sizeof(uint64_t));
+            }
+        }
+    }
+
+    // Without caches that do not allocate on writes, which sweeps refuse
+    // for typed traces, misses do not depend on the type of access, so a
+    // sweep drops the types.
+    trace->typed = (reader->flags & TRACE_FLAG_TYPE) != 0;
+    if (trace->typed) {
+        for (size_t i = 0; i < trace->count; i++) {
+            trace->addresses[i] &= ~TRACE_TYPE_MASK;
+        }
+    }
+
+    bool error = reader->error;
+    trace_reader_close(reader);
+    if (error) {
+        sweep_trace_free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+/*
+ * Frees a decoded trace.
+ */
+void sweep_trace_free(sweep_trace_t *trace) {
+    free(trace->addresses);
+    free(trace->pcs);
+    free(trace);
+}
+
+/*
+ * Random numbers of the job a thread is running.
+ */
+static __thread uint64_t sweep_seed;
+
+static int sweep_random(void) {
+    sweep_seed = sweep_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (int)(sweep_seed >> 33);
+}
+
+/*
+ * Structure used to store the jobs of a thread. The owner takes jobs from
+ * the tail, and thieves from the head.
+ */
+typedef struct sweep_deque_s {
+    pthread_mutex_t lock;
+    size_t *jobs;
+    size_t head, tail;
+} sweep_deque_t;
+
+/*
+ * Structure shared by the threads of a sweep.
+ */
+typedef struct sweep_s {
+    const sweep_trace_t *trace;
+    const sweep_config_t *configs;
+    sweep_result_t *results;
+    sweep_deque_t *deques;
+    size_t num_threads;
+} sweep_t;
+
+/*
+ * Structure passed to each thread.
+ */
+typedef struct sweep_worker_s {
+    sweep_t *sweep;
+    size_t id;
+} sweep_worker_t;
+
+/*
+ * Take the next job of a thread, stealing one if it has none left. Returns
+ * false when every deque is empty.
+ */
+static bool sweep_take(sweep_t *sweep, size_t id, size_t *job) {
+
+    sweep_deque_t *own = sweep->deques + id;
+    pthread_mutex_lock(&own->lock);
+    bool found = own->tail > own->head;
+    if (found) {
+        *job = own->jobs[--own->tail];
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    // Jobs are never added, so a deque found empty stays empty.
+    for (size_t i = 1; i < sweep->num_threads && !found; i++) {
+        sweep_deque_t *victim = sweep->deques + (id + i) % sweep->num_threads;
+        pthread_mutex_lock(&victim->lock);
+        found = victim->tail > victim->head;
+        if (found) {
+            *job = victim->jobs[victim->head++];
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return found;
+}
+
+/*
+ * Check that every configuration can be simulated: caches need lines of 8
+ * bytes or more, and the types of a typed trace are gone, so no cache may
+ * depend on them by not allocating on writes.
+ */
+static bool sweep_configs_check(const sweep_trace_t *trace, const sweep_config_t *configs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (configs[i].line_size < 8) {
+            return false;
+        }
+        if (trace->typed && (configs[i].policies & CACHE_WRITEPOLICY_WRITENOALLOCATE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Simulate a configuration over the whole trace.
+ */
+static void sweep_simulate(const sweep_trace_t *trace, const sweep_config_t *config, sweep_result_t *result) {
+
+    cache_t *cache = cache_new(config->size, config->line_size, config->associativity,
+                               config->policies | CACHE_NODATAPOLICY);
+    sweep_seed = SWEEP_SEED;
+    cache_read_batch(cache, trace->addresses, trace->pcs, trace->count, NULL, sweep_random);
+
+    result->access_count = cache_access_count(cache);
+    result->miss_count = cache_miss_count(cache);
+    result->cycle_count = cache_cycle_count(cache);
+    cache_free(cache);
+}
+
+static void *sweep_worker_run(void *arg) {
+    sweep_worker_t *worker = (sweep_worker_t *)arg;
+    sweep_t *sweep = worker->sweep;
+    size_t job;
+    while (sweep_take(sweep, worker->id, &job)) {
+        sweep_simulate(sweep->trace, sweep->configs + job, sweep->results + job);
+    }
+    return NULL;
+}
+
+/*
+ * Simulate every configuration over the trace.
+ */
+int sweep_run(const sweep_trace_t *trace, const sweep_config_t *configs, size_t count,
+              sweep_result_t *results, size_t num_threads) {
+
+    if (!sweep_configs_check(trace, configs, count)) {
+        return -1;
+    }
+    if (num_threads == 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = processors > 0 ? processors : 1;
+    }
+    if (num_threads > count) {
+        num_threads = count > 0 ? count : 1;
+    }
+
+    // Deal the jobs out round-robin.
+    sweep_t sweep = {trace, configs, results, NULL, num_threads};
+    sweep.deques = (sweep_deque_t *)calloc(num_threads, sizeof(sweep_deque_t));
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&sweep.deques[i].lock, NULL);
+        sweep.deques[i].jobs = (size_t *)malloc((count / num_threads + 1) * sizeof(size_t));
+    }
+    for (size_t job = 0; job < count; job++) {
+        sweep_deque_t *deque = sweep.deques + job % num_threads;
+        deque->jobs[deque->tail++] = job;
+    }
+
+    // The calling thread is worker 0.
+    pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    sweep_worker_t *workers = (sweep_worker_t *)malloc(num_threads * sizeof(sweep_worker_t));
+    size_t started = 1;
+    for (size_t i = 0; i < num_threads; i++) {
+        workers[i].sweep = &sweep;
+        workers[i].id = i;
+    }
+    for (; started < num_threads; started++) {
+        if (pthread_create(&threads[started], NULL, sweep_worker_run, &workers[started]) != 0) {
+            break;
+        }
+    }
+    // Jobs of threads that could not start are stolen by the others.
+    sweep_worker_run(&workers[0]);
+    for (size_t i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_mutex_destroy(&sweep.deques[i].lock);
+        free(sweep.deques[i].jobs);
+    }
+    free(sweep.deques);
+    free(threads);
+    free(workers);
+    return 0;
+}
+
+/*
+ * Structure used to store caches of the same geometry simulated in lock
+ * step, with their interleaved lines and LRU lists, and the state of the
+ * random numbers of each.
+ */
+typedef struct sweep_group_s {
+    size_t count;
+    cache_t **caches;
+    size_t *jobs;
+    uint64_t *seeds;
+    cache_line_t *lines;
+    size_t *lru_lists;
+} sweep_group_t;
+
+/*
+ * Give the caches of a group shared arrays of lines and LRU lists, where
+ * the ways of set s of cache k come at (s * count + k) * associativity.
+ */
+static void sweep_group_interleave(sweep_group_t *group) {
+
+    cache_t *first = group->caches[0];
+    size_t associativity = first->associativity;
+    size_t num_lines = first->num_sets * group->count * associativity;
+    group->lines = (cache_line_t *)calloc(num_lines, sizeof(cache_line_t));
+    group->lru_lists = (size_t *)malloc(num_lines * sizeof(size_t));
+
+    for (size_t k = 0; k < group->count; k++) {
+        cache_t *cache = group->caches[k];
+        free(cache->lines);
+        cache->lines = group->lines;
+        for (size_t s = 0; s < cache->num_sets; s++) {
+            cache_set_t *cache_set = cache->sets + s;
+            free(cache_set->lru_list);
+            cache_set->first_index = (s * group->count + k) * associativity;
+            cache_set->lines = group->lines;
+            cache_set->lru_list = group->lru_lists + cache_set->first_index;
+            for (size_t way = 0; way < associativity; way++) {
+                cache_set->lru_list[way] = way;
+            }
+        }
+    }
+}
+
+/*
+ * Frees the caches of a group and their shared arrays.
+ */
+static void sweep_group_free(sweep_group_t *group) {
+    for (size_t k = 0; k < group->count; k++) {
+        cache_t *cache = group->caches[k];
+        cache->lines = NULL;
+        for (size_t s = 0; s < cache->num_sets; s++) {
+            cache->sets[s].lru_list = NULL;
+        }
+        cache_free(cache);
+    }
+    free(group->lines);
+    free(group->lru_lists);
+    free(group->caches);
+    free(group->jobs);
+    free(group->seeds);
+}
+
+/*
+ * Simulate every configuration over the trace in lock step.
+ */
+int sweep_run_lockstep(const sweep_trace_t *trace, const sweep_config_t *configs, size_t count,
+                       sweep_result_t *results) {
+
+    if (!sweep_configs_check(trace, configs, count)) {
+        return -1;
+    }
+    // Group the configurations by geometry.
+    sweep_group_t *groups = (sweep_group_t *)calloc(count, sizeof(sweep_group_t));
+    size_t num_groups = 0;
+    for (size_t job = 0; job < count; job++) {
+        const sweep_config_t *config = configs + job;
+        sweep_group_t *group = groups;
+        while (group < groups + num_groups
+               && (configs[group->jobs[0]].size != config->size || configs[group->jobs[0]].line_size != config->line_size
+                   || configs[group->jobs[0]].associativity != config->associativity)) {
+            group++;
+        }
+        if (group == groups + num_groups) {
+            num_groups++;
+            group->caches = (cache_t **)malloc(count * sizeof(cache_t *));
+            group->jobs = (size_t *)malloc(count * sizeof(size_t));
+            group->seeds = (uint64_t *)malloc(count * sizeof(uint64_t));
+        }
+        group->caches[group->count] = cache_new(config->size, config->line_size, config->associativity,
+                                                config->policies | CACHE_NODATAPOLICY);
+        group->jobs[group->count] = job;
+        group->seeds[group->count] = SWEEP_SEED;
+        group->count++;
+    }
+    for (size_t g = 0; g < num_groups; g++) {
+        sweep_group_interleave(groups + g);
+    }
+
+    // Decompose a block of addresses once per geometry, then read each
+    // address through every cache of the geometry.
+    uint64_t indices[CACHE_BATCH_SIZE], tags[CACHE_BATCH_SIZE];
+    for (size_t start = 0; start < trace->count; start += CACHE_BATCH_SIZE) {
+        size_t n = trace->count - start < CACHE_BATCH_SIZE ? trace->count - start : CACHE_BATCH_SIZE;
+        const uint64_t *addresses = trace->addresses + start;
+        for (size_t g = 0; g < num_groups; g++) {
+            sweep_group_t *group = groups + g;
+            cache_decompose(group->caches[0], addresses, n, NULL, indices, tags);
+            for (size_t i = 0; i < n; i++) {
+                for (size_t k = 0; k < group->count; k++) {
+                    cache_t *cache = group->caches[k];
+                    if (trace->pcs != NULL) {
+                        cache->access_pc = trace->pcs[start + i];
+                    }
+                    sweep_seed = group->seeds[k];
+                    cache_read_decomposed(cache, addresses[i], indices[i], tags[i], sweep_random);
+                    cache->access_pc = 0;
+                    group->seeds[k] = sweep_seed;
+                }
+            }
+        }
+    }
+
+    for (size_t g = 0; g < num_groups; g++) {
+        sweep_group_t *group = groups + g;
+        for (size_t k = 0; k < group->count; k++) {
+            sweep_result_t *result = results + group->jobs[k];
+            result->access_count = cache_access_count(group->caches[k]);
+            result->miss_count = cache_miss_count(group->caches[k]);
+            result->cycle_count = cache_cycle_count(group->caches[k]);
+        }
+        sweep_group_free(group);
+    }
+    free(groups);
+    return 0;
+}
+
+/*
+ * Print one line of CSV per configuration.
+ */
+void sweep_print_csv(FILE *out, const sweep_config_t *configs, const sweep_result_t *results, size_t count) {
+    fprintf(out, "size,line,associativity,policy,accesses,misses,miss_rate,cycles\n");
+    for (size_t i = 0; i < count; i++) {
+        const cache_replacement_t *replacement = cache_replacement_builtin(configs[i].policies);
+        fprintf(out, "%zu,%zu,%zu,%s,%" PRIu64 ",%" PRIu64 ",%.6f,%" PRIu64 "\n", configs[i].size,
+                configs[i].line_size, configs[i].associativity,
+                replacement != NULL ? replacement->name : "none", results[i].access_count, results[i].miss_count,
+                results[i].access_count == 0 ? 0.0 : (double) results[i].miss_count / results[i].access_count,
+                results[i].cycle_count);
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * sweep.h
+ *
+ * Design-space sweeps: one trace simulated through many cache geometries
+ * and policies at once.
+ *
+ * The trace is decoded once into memory shared by every thread. Each
+ * configuration is a job, simulated from start to end by one thread with a
+ * cache of its own, so threads share nothing but the trace while they run.
+ * Jobs are dealt out to per-thread deques; a thread takes its own jobs
+ * from the back, and when it runs out, steals from the front of the deque
+ * of another thread, so that a few large caches do not leave the other
+ * threads idle at the end.
+ *
+ * Policies that draw random numbers get a generator seeded afresh for each
+ * job, so results do not depend on the number of threads or on which
+ * thread ran which job.
+ *
+ * Small caches are cheap to simulate, and then decoding addresses and
+ * walking the trace cost as much as the simulation itself. A lock-step
+ * sweep instead runs all the caches over the trace in a single pass.
+ */
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "cache.h"
+#include <pthread.h>
+
+/*
+ * Seed of the random numbers of every job.
+ */
+#define SWEEP_SEED 1
+
+/*
+ * Structure used to store a trace decoded into memory.
+ */
+typedef struct sweep_trace_s {
+    uint64_t *addresses;
+
+    /* Program counters, or NULL if the trace has none. */
+    uint64_t *pcs;
+
+    size_t count;
+
+    /* Whether the trace had types, which are not kept. */
+    bool typed;
+} sweep_trace_t;
+
+/*
+ * Structure used to store a configuration to simulate.
+ */
+typedef struct sweep_config_s {
+    size_t size, line_size, associativity;
+    uint8_t policies;
+} sweep_config_t;
+
+/*
+ * Structure used to store the statistics of a configuration.
+ */
+typedef struct sweep_result_s {
+    uint64_t access_count, miss_count, cycle_count;
+} sweep_result_t;
+
+/*
+ * Decode the trace at path (see trace.h) into memory. Returns NULL on
+ * failure, including a truncated or corrupt trace.
+ */
+sweep_trace_t *sweep_trace_load(const char *path);
+
+/*
+ * Frees a decoded trace.
+ */
+void sweep_trace_free(sweep_trace_t *trace);
+
+/*
+ * Simulate every configuration over the trace with num_threads threads, or
+ * one per processor if it is 0, and store the statistics of configs[i] in
+ * results[i]. Returns 0 on success and -1 on failure, which includes
+ * caches that do not allocate on writes with a typed trace.
+ */
+int sweep_run(const sweep_trace_t *trace, const sweep_config_t *configs, size_t count,
+              sweep_result_t *results, size_t num_threads);
+
+/*
+ * Simulate every configuration over the trace on the calling thread, in
+ * lock step: each access goes through every cache before the next one.
+ * Configurations with the same geometry share the decomposition of each
+ * address into set index and tag, and their tags and LRU lists are
+ * interleaved set by set, so that an access finds the state of its set in
+ * every cache in the same few lines of memory. Gives the same results as
+ * sweep_run. Returns 0 on success and -1 on failure.
+ */
+int sweep_run_lockstep(const sweep_trace_t *trace, const sweep_config_t *configs, size_t count,
+                       sweep_result_t *results);
+
+/*
+ * Print one line of CSV per configuration, with its statistics.
+ */
+void sweep_print_csv(FILE *out, const sweep_config_t *configs, const sweep_result_t *results, size_t count);
+
+#endif
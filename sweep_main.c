@@ -0,0 +1,112 @@
+#include "cache.h"
+#include "config.h"
+#include "sweep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Simulate every combination of the given sizes, line sizes,
+ * associativities and policies over a trace, and print a table of the
+ * results as CSV.
+ *
+ * Usage: sweep [-l] TRACE SIZES LINES ASSOCIATIVITIES POLICIES [THREADS]
+ *
+ * Lists are separated by commas, as in: sweep app.trace 16384,32768 64 4,8 lru,dip
+ * With -l, every cache runs in lock step on the calling thread, which is
+ * faster for many small caches (see sweep.h).
+ */
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-l] TRACE SIZES LINES ASSOCIATIVITIES POLICIES [THREADS]\n", program);
+}
+
+/*
+ * Parse a list of numbers separated by commas. Returns the number of
+ * values, or 0 on failure.
+ */
+static size_t parse_numbers(char *arg, size_t *values, size_t capacity) {
+    size_t count = 0;
+    for (char *token = strtok(arg, ","); token != NULL; token = strtok(NULL, ",")) {
+        char *end;
+        size_t value = strtoull(token, &end, 0);
+        if (count == capacity || *end != '\0' || value == 0 || (value & (value - 1)) != 0) {
+            return 0;
+        }
+        values[count++] = value;
+    }
+    return count;
+}
+
+/*
+ * Parse a list of policy names separated by commas. Returns the number of
+ * policies, or 0 on failure.
+ */
+static size_t parse_policies(char *arg, uint8_t *policies, size_t capacity) {
+    size_t count = 0;
+    for (char *token = strtok(arg, ","); token != NULL; token = strtok(NULL, ",")) {
+        if (count == capacity || cache_config_policy(token, policies + count) != 0) {
+            return 0;
+        }
+        count++;
+    }
+    return count;
+}
+
+int main(int argc, char **argv) {
+
+    const char *program = argv[0];
+    bool lockstep = argc > 1 && strcmp(argv[1], "-l") == 0;
+    if (lockstep) {
+        argc--;
+        argv++;
+    }
+
+    size_t sizes[64], lines[64], associativities[64];
+    uint8_t policies[64];
+    size_t num_sizes, num_lines, num_associativities, num_policies;
+    if (argc < 6 || argc > 7
+        || (num_sizes = parse_numbers(argv[2], sizes, 64)) == 0
+        || (num_lines = parse_numbers(argv[3], lines, 64)) == 0
+        || (num_associativities = parse_numbers(argv[4], associativities, 64)) == 0
+        || (num_policies = parse_policies(argv[5], policies, 64)) == 0) {
+        usage(program);
+        return 1;
+    }
+    size_t num_threads = argc > 6 ? strtoull(argv[6], NULL, 0) : 0;
+
+    // Skip the combinations whose sets would not hold a single line, and
+    // lines of fewer than the 8 bytes caches need.
+    size_t count = 0;
+    sweep_config_t *configs = (sweep_config_t *)malloc(num_sizes * num_lines * num_associativities * num_policies
+                                                       * sizeof(sweep_config_t));
+    for (size_t s = 0; s < num_sizes; s++)
+        for (size_t l = 0; l < num_lines; l++)
+            for (size_t a = 0; a < num_associativities; a++)
+                for (size_t p = 0; p < num_policies; p++)
+                    if (sizes[s] >= lines[l] * associativities[a] && lines[l] >= 8) {
+                        sweep_config_t config = {sizes[s], lines[l], associativities[a], policies[p]};
+                        configs[count++] = config;
+                    }
+
+    sweep_trace_t *trace = sweep_trace_load(argv[1]);
+    if (trace == NULL) {
+        fprintf(stderr, "Could not read trace %s\n", argv[1]);
+        free(configs);
+        return 1;
+    }
+
+    sweep_result_t *results = (sweep_result_t *)malloc(count * sizeof(sweep_result_t));
+    int result = lockstep ? sweep_run_lockstep(trace, configs, count, results)
+                          : sweep_run(trace, configs, count, results, num_threads);
+    if (result == 0) {
+        sweep_print_csv(stdout, configs, results, count);
+    } else {
+        fprintf(stderr, "Could not simulate the configurations\n");
+    }
+
+    free(results);
+    sweep_trace_free(trace);
+    free(configs);
+    return result == 0 ? 0 : 1;
+}
@@ -2,6 +2,25 @@
 extern "C"
 {
 #include "cache.h"
+#include "checkpoint.h"
+#include "opt.h"
+#include "partition.h"
+#include "compress.h"
+#include "dram.h"
+#include "mshr.h"
+#include "trace.h"
+#include "pctable.h"
+#include "heatmap.h"
+#include "events.h"
+#include "mrc.h"
+#include "stream.h"
+#include "hierarchy.h"
+#include "batch.h"
+#include "timeseries.h"
+#include "replacement.h"
+#include "config.h"
+#include "sweep.h"
+#include "fullassoc.h"
 }
 
 TEST_CASE("cache_line_check_validity_and_tag", "[weight=1][part=test]")
@@ -29,23 +48,48 @@ TEST_CASE("cache_line_check_validity_and_tag", "[weight=1][part=test]")
 TEST_CASE("cache_line_retrieve_data", "[weight=1][part=test]")
 {
     uint64_t block[] = {100, 101};
-    cache_line_t cache_line;
-    cache_line.block = (uint8_t *)block;
 
-    long data = cache_line_retrieve_data(&cache_line, 0);
+    long data = cache_line_retrieve_data((uint8_t *)block, 0);
     REQUIRE(data == 100);
 
-    data = cache_line_retrieve_data(&cache_line, 8);
+    data = cache_line_retrieve_data((uint8_t *)block, 8);
     REQUIRE(data == 101);
 }
 
 #define ASSERT_EQUAL(A, B) REQUIRE((A) == (B))
 
+TEST_CASE("cache_new::tag_mask", "[weight=1][part=test]")
+{
+    // The tag holds every address bit above the index, so that lines far
+    // apart in memory do not share a tag.
+    cache_t *cache = cache_new(256, 64, 4, CACHE_REPLACEMENTPOLICY_LRU);
+    ASSERT_EQUAL(cache->tag_mask, ~(uint64_t) 63);
+    cache_free(cache);
+
+    cache = cache_new(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU);
+    ASSERT_EQUAL(cache->tag_mask, ~(uint64_t) 1023);
+    cache_free(cache);
+
+    // Victims keep the top bits of their address, and lines too short for
+    // the tag to fit in 61 bits are refused.
+    cache = cache_new(256, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITEBACK | CACHE_NODATAPOLICY);
+    uintptr_t high = (uintptr_t) 1 << 63 | (uintptr_t) 1 << 61;
+    for (uintptr_t i = 0; i < 5; i++) {
+        cache_access(cache, high + i * 64, CACHE_ACCESS_STORE, rand);
+    }
+    ASSERT_EQUAL(cache->num_writebacks, 1);
+    ASSERT_EQUAL(cache->writebacks[0], high);
+    cache_free(cache);
+    REQUIRE(cache_new(1024, 4, 4, CACHE_REPLACEMENTPOLICY_LRU) == NULL);
+}
+
 TEST_CASE("cache_set_find_matching_line::LRU", "[weight=1][part=test]")
 {
 
     cache_t cache;
     cache.policies = CACHE_REPLACEMENTPOLICY_LRU;
+    cache.replacement = cache_replacement_builtin(cache.policies);
+    cache.fully_associative = NULL;
     cache.num_lines = 16;
     cache.num_sets = 4;
     cache.associativity = cache.num_lines / cache.num_sets;
@@ -154,6 +198,8 @@ TEST_CASE("cache_set_find_matching_line::RANDOM", "[weight=1][part=test]")
 
     cache_t cache;
     cache.policies = CACHE_REPLACEMENTPOLICY_RANDOMIZED_MARKING;
+    cache.replacement = cache_replacement_builtin(cache.policies);
+    cache.fully_associative = NULL;
     cache.num_lines = 16;
     cache.num_sets = 4;
     cache.associativity = cache.num_lines / cache.num_sets;
@@ -206,6 +252,8 @@ TEST_CASE("find_available_cache_line::LRU", "[weight=1][part=test]")
 {
     cache_t cache;
     cache.policies = CACHE_REPLACEMENTPOLICY_LRU;
+    cache.replacement = cache_replacement_builtin(cache.policies);
+    cache.fully_associative = NULL;
     cache.num_lines = 16;
     cache.num_sets = 4;
     cache.associativity = cache.num_lines / cache.num_sets;
@@ -341,6 +389,8 @@ TEST_CASE("find_available_cache_line::RANDOM", "[weight=1][part=test]")
 {
     cache_t cache;
     cache.policies = CACHE_REPLACEMENTPOLICY_RANDOMIZED_MARKING;
+    cache.replacement = cache_replacement_builtin(cache.policies);
+    cache.fully_associative = NULL;
     cache.num_lines = 16;
     cache.num_sets = 4;
     cache.associativity = cache.num_lines / cache.num_sets;
@@ -442,3 +492,1546 @@ TEST_CASE("find_available_cache_line::RANDOM", "[weight=1][part=test]")
     ASSERT_EQUAL(lines[3].is_marked, 1);
 }
 
+TEST_CASE("cache_checkpoint/cache_restore", "[weight=1][part=test]")
+{
+    static uint64_t data[4096] __attribute__ ((aligned (64)));
+    for (size_t i = 0; i < 4096; i++) {
+        data[i] = i;
+    }
+
+    cache_t *warm = cache_new(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITEBACK);
+    for (size_t i = 0; i < 4096; i += 3) {
+        cache_access(warm, (uintptr_t) &data[i], i % 2 == 0 ? CACHE_ACCESS_LOAD : CACHE_ACCESS_STORE, rand);
+    }
+    REQUIRE(warm->writeback_count > 0);
+    ASSERT_EQUAL(cache_checkpoint(warm, "test_checkpoint.bin"), 0);
+
+    cache_t *restored = cache_restore("test_checkpoint.bin");
+    REQUIRE(restored != NULL);
+    ASSERT_EQUAL(restored->num_sets, warm->num_sets);
+    ASSERT_EQUAL(restored->associativity, warm->associativity);
+    ASSERT_EQUAL(cache_access_count(restored), cache_access_count(warm));
+    ASSERT_EQUAL(cache_miss_count(restored), cache_miss_count(warm));
+    ASSERT_EQUAL(restored->writeback_count, warm->writeback_count);
+    for (int type = 0; type < CACHE_ACCESS_TYPES; type++) {
+        ASSERT_EQUAL(restored->type_access_count[type], warm->type_access_count[type]);
+        ASSERT_EQUAL(restored->type_miss_count[type], warm->type_miss_count[type]);
+    }
+    for (size_t i = 0; i < warm->num_sets; i++) {
+        ASSERT_EQUAL(restored->sets[i].access_count, warm->sets[i].access_count);
+        ASSERT_EQUAL(restored->sets[i].miss_count, warm->sets[i].miss_count);
+        ASSERT_EQUAL(restored->sets[i].eviction_count, warm->sets[i].eviction_count);
+    }
+    for (size_t i = 0; i < warm->num_lines; i++) {
+        ASSERT_EQUAL(restored->lines[i].is_valid, warm->lines[i].is_valid);
+        ASSERT_EQUAL(restored->lines[i].tag, warm->lines[i].tag);
+    }
+
+    // Both caches must behave identically from here on.
+    for (size_t i = 0; i < 4096; i += 5) {
+        ASSERT_EQUAL(cache_read(restored, (uintptr_t) &data[i], rand), cache_read(warm, (uintptr_t) &data[i], rand));
+    }
+    ASSERT_EQUAL(cache_miss_count(restored), cache_miss_count(warm));
+    ASSERT_EQUAL(restored->writeback_count, warm->writeback_count);
+
+    cache_free(restored);
+    cache_free(warm);
+
+    // OPT keeps the next use of every line.
+    cache_t *opt = cache_new(1024, 64, 4, CACHE_REPLACEMENTPOLICY_OPT | CACHE_NODATAPOLICY);
+    for (size_t i = 0; i < 64; i++) {
+        opt->access_next_use = 100 + i;
+        cache_read(opt, (i % 24) * 64, rand);
+    }
+    ASSERT_EQUAL(cache_checkpoint(opt, "test_checkpoint.bin"), 0);
+    restored = cache_restore("test_checkpoint.bin");
+    REQUIRE(restored != NULL);
+    for (size_t i = 0; i < opt->num_lines; i++) {
+        ASSERT_EQUAL(restored->next_use[i], opt->next_use[i]);
+    }
+    cache_free(restored);
+
+    // Corrupt geometries, lru_list entries and marks are refused. The
+    // lru_list of OPT caches follows the next uses of the lines.
+    size_t lru_offset = sizeof(cache_checkpoint_header_t) + opt->num_lines * sizeof(uint64_t) * 2
+                      + opt->num_sets * 3 * sizeof(uint64_t);
+    size_t marked_offset = lru_offset + opt->num_lines * sizeof(uint32_t);
+    struct { size_t offset; uint64_t value; size_t size; } corruptions[] = {
+        {offsetof(cache_checkpoint_header_t, line_size), 0, sizeof(uint64_t)},
+        {offsetof(cache_checkpoint_header_t, line_size), 48, sizeof(uint64_t)},
+        {offsetof(cache_checkpoint_header_t, associativity), 3, sizeof(uint64_t)},
+        {offsetof(cache_checkpoint_header_t, num_lines), 1ULL << 40, sizeof(uint64_t)},
+        {lru_offset + sizeof(uint32_t), 4, sizeof(uint32_t)},
+        {marked_offset, 5, sizeof(uint32_t)},
+    };
+    for (size_t i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]); i++) {
+        ASSERT_EQUAL(cache_checkpoint(opt, "test_checkpoint.bin"), 0);
+        FILE *file = fopen("test_checkpoint.bin", "r+b");
+        fseek(file, corruptions[i].offset, SEEK_SET);
+        fwrite(&corruptions[i].value, corruptions[i].size, 1, file);
+        fclose(file);
+        REQUIRE(cache_restore("test_checkpoint.bin") == NULL);
+    }
+
+    cache_free(opt);
+    remove("test_checkpoint.bin");
+}
+
+TEST_CASE("opt_replay", "[weight=1][part=test]")
+{
+    // Three lines accessed in a loop, through a single set of two lines.
+    uint64_t trace[12];
+    for (size_t i = 0; i < 12; i++) {
+        trace[i] = (i % 3) * 64 + 8;
+    }
+    FILE *file = fopen("test_opt_trace.bin", "wb");
+    fwrite(trace, sizeof(uint64_t), 12, file);
+    fclose(file);
+
+    ASSERT_EQUAL(opt_compute_next_use("test_opt_trace.bin", "test_opt_next.bin", 64), 0);
+    uint64_t next_use[12];
+    file = fopen("test_opt_next.bin", "rb");
+    ASSERT_EQUAL(fread(next_use, sizeof(uint64_t), 12, file), 12);
+    fclose(file);
+    ASSERT_EQUAL(next_use[0], 3);
+    ASSERT_EQUAL(next_use[8], 11);
+    ASSERT_EQUAL(next_use[9], OPT_NEVER);
+
+    cache_t *lru = cache_new(128, 64, 2, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    ASSERT_EQUAL(opt_replay(lru, "test_opt_trace.bin", NULL), 0);
+    ASSERT_EQUAL(cache_miss_count(lru), 12);
+
+    cache_t *opt = cache_new(128, 64, 2, CACHE_REPLACEMENTPOLICY_OPT | CACHE_NODATAPOLICY);
+    ASSERT_EQUAL(opt_replay(opt, "test_opt_trace.bin", "test_opt_next.bin"), 0);
+    ASSERT_EQUAL(cache_access_count(opt), 12);
+    ASSERT_EQUAL(cache_miss_count(opt), 7);
+
+    cache_free(lru);
+    cache_free(opt);
+    remove("test_opt_trace.bin");
+    remove("test_opt_next.bin");
+}
+
+TEST_CASE("find_available_cache_line::LIP", "[weight=1][part=test]")
+{
+    cache_t cache;
+    cache.policies = CACHE_REPLACEMENTPOLICY_LIP;
+    cache.replacement = cache_replacement_builtin(cache.policies);
+    cache.fully_associative = NULL;
+    cache.num_lines = 16;
+    cache.num_sets = 4;
+    cache.associativity = cache.num_lines / cache.num_sets;
+
+    cache_set_t cache_set;
+    cache_line_t lines[] = {{true, false, false, 10}, {true, false, false, 11}, {false, false, false, 12}, {false, false, false, 13}};
+    size_t lru_list[] = {3, 2, 1, 0};
+    cache_set.lines = lines;
+    cache_set.first_index = 0;
+    cache_set.lru_list = lru_list;
+
+    cache_line_t *actual = find_available_cache_line(&cache, &cache_set, [](){ return 0; });
+    ASSERT_EQUAL(actual, &lines[2]);
+    ASSERT_EQUAL(lru_list[0], 2);
+    ASSERT_EQUAL(lru_list[1], 3);
+    ASSERT_EQUAL(lru_list[2], 1);
+    ASSERT_EQUAL(lru_list[3], 0);
+
+    lines[2].is_valid = true;
+    actual = find_available_cache_line(&cache, &cache_set, [](){ return 0; });
+    ASSERT_EQUAL(actual, &lines[3]);
+    ASSERT_EQUAL(lru_list[0], 3);
+    ASSERT_EQUAL(lru_list[1], 2);
+    ASSERT_EQUAL(lru_list[2], 1);
+    ASSERT_EQUAL(lru_list[3], 0);
+
+    // A full set keeps replacing the line in the LRU position.
+    lines[3].is_valid = true;
+    actual = find_available_cache_line(&cache, &cache_set, [](){ return 0; });
+    ASSERT_EQUAL(actual, &lines[3]);
+    ASSERT_EQUAL(lru_list[0], 3);
+    ASSERT_EQUAL(lru_list[1], 2);
+    ASSERT_EQUAL(lru_list[2], 1);
+    ASSERT_EQUAL(lru_list[3], 0);
+
+    // BIP occasionally inserts in the MRU position.
+    cache.policies = CACHE_REPLACEMENTPOLICY_BIP;
+    cache.replacement = cache_replacement_builtin(cache.policies);
+    actual = find_available_cache_line(&cache, &cache_set, [](){ return 1; });
+    ASSERT_EQUAL(actual, &lines[3]);
+    ASSERT_EQUAL(lru_list[0], 3);
+
+    actual = find_available_cache_line(&cache, &cache_set, [](){ return CACHE_BIP_EPSILON; });
+    ASSERT_EQUAL(actual, &lines[3]);
+    ASSERT_EQUAL(lru_list[0], 2);
+    ASSERT_EQUAL(lru_list[1], 1);
+    ASSERT_EQUAL(lru_list[2], 0);
+    ASSERT_EQUAL(lru_list[3], 3);
+}
+
+TEST_CASE("cache_read::DIP", "[weight=1][part=test]")
+{
+    // A loop over 1.5 times the cache size thrashes LRU.
+    cache_t *lru = cache_new(32768, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    cache_t *dip = cache_new(32768, 64, 4, CACHE_REPLACEMENTPOLICY_DIP | CACHE_NODATAPOLICY);
+    for (int k = 0; k < 20; k++) {
+        for (uintptr_t address = 0; address < 49152; address += 64) {
+            cache_read(lru, address, rand);
+            cache_read(dip, address, rand);
+        }
+    }
+
+    ASSERT_EQUAL(cache_miss_count(lru), cache_access_count(lru));
+    REQUIRE(cache_miss_count(dip) < cache_miss_count(lru) * 3 / 4);
+    REQUIRE(dip->duel.psel > dip->duel.psel_max / 2);
+
+    cache_free(lru);
+    cache_free(dip);
+}
+
+TEST_CASE("cache_partition", "[weight=1][part=test]")
+{
+    // Tenant 0 streams through memory, tenant 1 loops over 6 lines per set.
+    cache_t *fixed = cache_new(8192, 64, 8, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    cache_t *ucp = cache_new(8192, 64, 8, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    ASSERT_EQUAL(cache_partition_init(fixed, 2, 0), 0);
+    ASSERT_EQUAL(cache_partition_init(ucp, 2, 1000), 0);
+    ASSERT_EQUAL(fixed->partition->tenants[0].way_mask, 0x0f);
+    ASSERT_EQUAL(fixed->partition->tenants[1].way_mask, 0xf0);
+
+    uintptr_t stream = 1 << 20;
+    for (int k = 0; k < 50; k++) {
+        for (uintptr_t address = 0; address < 6144; address += 64) {
+            cache_read_tenant(fixed, address, 1, rand);
+            cache_read_tenant(ucp, address, 1, rand);
+            cache_read_tenant(fixed, stream, 0, rand);
+            cache_read_tenant(ucp, stream, 0, rand);
+            stream += 64;
+        }
+    }
+
+    // With four ways, the loop always misses; UCP moves ways to tenant 1.
+    cache_tenant_t *tenants = fixed->partition->tenants;
+    ASSERT_EQUAL(tenants[1].miss_count, tenants[1].access_count);
+    ASSERT_EQUAL(tenants[0].miss_count, tenants[0].access_count);
+
+    tenants = ucp->partition->tenants;
+    REQUIRE(__builtin_popcountll(tenants[1].way_mask) >= 6);
+    ASSERT_EQUAL(tenants[0].way_mask & tenants[1].way_mask, 0);
+    REQUIRE(tenants[1].miss_count < tenants[1].access_count / 4);
+    ASSERT_EQUAL(tenants[0].access_count + tenants[1].access_count, cache_access_count(ucp));
+
+    cache_free(fixed);
+    cache_free(ucp);
+}
+
+TEST_CASE("compress_bdi_size/compress_fpc_size", "[weight=1][part=test]")
+{
+    uint64_t block[8] = {0};
+    ASSERT_EQUAL(compress_bdi_size((uint8_t *)block, 64), 1);
+    ASSERT_EQUAL(compress_fpc_size((uint8_t *)block, 64), 2);
+
+    // Pointers into the same region compress to one base and small deltas.
+    for (int i = 0; i < 8; i++) {
+        block[i] = 0x7f0000001000ULL + i * 16;
+    }
+    ASSERT_EQUAL(compress_bdi_size((uint8_t *)block, 64), 8 + 8 * 1 + 1);
+
+    // Small integers compress well with both algorithms.
+    for (int i = 0; i < 8; i++) {
+        block[i] = i;
+    }
+    ASSERT_EQUAL(compress_bdi_size((uint8_t *)block, 64), 8 + 8 * 1 + 1);
+    REQUIRE(compress_fpc_size((uint8_t *)block, 64) < 16);
+
+    for (int i = 0; i < 8; i++) {
+        block[i] = 0x9e3779b97f4a7c15ULL * (i + 1);
+    }
+    ASSERT_EQUAL(compress_bdi_size((uint8_t *)block, 64), 64);
+    REQUIRE(compress_fpc_size((uint8_t *)block, 64) > 64);
+}
+
+TEST_CASE("cache_new_compressed", "[weight=1][part=test]")
+{
+    static uint64_t data[1024] __attribute__ ((aligned (64)));
+
+    // Twice the cache size of zeros fits in the compressed cache.
+    for (size_t i = 0; i < 1024; i++) {
+        data[i] = 0;
+    }
+    cache_t *cache = cache_new_compressed(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU, CACHE_COMPRESSION_BEST);
+    for (int k = 0; k < 2; k++) {
+        for (size_t i = 0; i < 1024; i += 8) {
+            cache_read(cache, (uintptr_t) &data[i], rand);
+        }
+    }
+    ASSERT_EQUAL(cache_miss_count(cache), 128);
+    ASSERT_EQUAL(cache_compression_effective_capacity(cache), 8192);
+    cache_free(cache);
+
+    // Incompressible data only fits as many lines as the uncompressed cache.
+    for (size_t i = 0; i < 1024; i++) {
+        data[i] = 0x9e3779b97f4a7c15ULL * (i + 1);
+    }
+    cache = cache_new_compressed(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU, CACHE_COMPRESSION_BEST);
+    for (int k = 0; k < 2; k++) {
+        for (size_t i = 0; i < 1024; i += 8) {
+            cache_read(cache, (uintptr_t) &data[i], rand);
+        }
+    }
+    ASSERT_EQUAL(cache_miss_count(cache), 256);
+    ASSERT_EQUAL(cache_compression_effective_capacity(cache), 4096);
+
+    // Evictions follow lru_list, which randomized marking and OPT do not keep.
+    ASSERT_EQUAL(cache_replacement_install(cache, cache_replacement_find("rm")), -1);
+    ASSERT_EQUAL(cache_replacement_install(cache, cache_replacement_find("lip")), 0);
+    cache_free(cache);
+    REQUIRE(cache_new_compressed(4096, 64, 4, CACHE_REPLACEMENTPOLICY_RANDOMIZED_MARKING,
+                                 CACHE_COMPRESSION_BEST) == NULL);
+    REQUIRE(cache_new_compressed(4096, 64, 4, CACHE_REPLACEMENTPOLICY_OPT, CACHE_COMPRESSION_BEST) == NULL);
+}
+
+TEST_CASE("cache_new_compressed::writeback", "[weight=1][part=test]")
+{
+    // Lines 1024 bytes apart share a set of the compressed cache, whose 8
+    // tags hold 256 bytes of compressed data.
+    static uint64_t data[12 * 128] __attribute__ ((aligned (1024)));
+    for (size_t i = 0; i < 12 * 128; i++) {
+        data[i] = i < 8 * 128 ? 0 : 0x9e3779b97f4a7c15ULL * (i + 1);
+    }
+    cache_t *cache = cache_new_compressed(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITEBACK,
+                                          CACHE_COMPRESSION_BEST);
+
+    // Stores of zeros all fit, and dirty every line.
+    for (size_t j = 0; j < 8; j++) {
+        cache_access(cache, (uintptr_t) &data[j * 128], CACHE_ACCESS_STORE, rand);
+    }
+    ASSERT_EQUAL(cache_miss_count(cache), 8);
+
+    // Each incompressible line replaces a dirty line, until the fourth one
+    // no longer fits beside the others, and evicts every dirty line left.
+    for (size_t j = 8; j < 11; j++) {
+        cache_read(cache, (uintptr_t) &data[j * 128], rand);
+        ASSERT_EQUAL(cache->num_writebacks, 1);
+    }
+    cache_read(cache, (uintptr_t) &data[11 * 128], rand);
+    ASSERT_EQUAL(cache->num_writebacks, 5);
+    ASSERT_EQUAL(cache->writeback_count, 8);
+    for (size_t i = 0; i < cache->num_writebacks; i++) {
+        REQUIRE(cache->writebacks[i] >= (uintptr_t) &data[3 * 128]);
+        REQUIRE(cache->writebacks[i] < (uintptr_t) &data[8 * 128]);
+        ASSERT_EQUAL(cache->writebacks[i] % 1024, (uintptr_t) data % 1024);
+    }
+    ASSERT_EQUAL(cache_compression_effective_capacity(cache), 256);
+    cache_free(cache);
+}
+
+TEST_CASE("dram_access", "[weight=1][part=test]")
+{
+    dram_config_t config;
+    dram_config_default(&config);
+    dram_t *dram = dram_new(&config);
+
+    // An empty bank activates the row, then the row is hit.
+    uint64_t done = dram_access(dram, 0, 64, false, 0);
+    ASSERT_EQUAL(done, config.t_rcd + config.t_cas + config.t_burst);
+    uint64_t now = 1000;
+    ASSERT_EQUAL(dram_access(dram, 64, 64, false, now), now + config.t_cas + config.t_burst);
+
+    // Another row of the same bank conflicts with the open one.
+    uintptr_t same_bank = config.row_size * config.channels * config.banks * config.ranks;
+    ASSERT_EQUAL(dram_access(dram, same_bank, 64, false, now * 2),
+                 now * 2 + config.t_rp + config.t_rcd + config.t_cas + config.t_burst);
+    ASSERT_EQUAL(dram->row_hits, 1);
+    ASSERT_EQUAL(dram->row_empty, 1);
+    ASSERT_EQUAL(dram->row_conflicts, 1);
+    dram_free(dram);
+
+    // With closed pages, rows are never hit.
+    config.page_policy = DRAM_PAGEPOLICY_CLOSED;
+    dram = dram_new(&config);
+    dram_access(dram, 0, 64, false, 0);
+    ASSERT_EQUAL(dram_access(dram, 64, 64, false, 1000), 1000 + config.t_rcd + config.t_cas + config.t_burst);
+    ASSERT_EQUAL(dram->row_hits, 0);
+    dram_free(dram);
+
+    // Addresses cannot be split across no banks, or an odd number of them.
+    config.banks = 0;
+    REQUIRE(dram_new(&config) == NULL);
+    config.banks = 12;
+    REQUIRE(dram_new(&config) == NULL);
+    dram_config_default(&config);
+    config.row_size = 0;
+    REQUIRE(dram_new(&config) == NULL);
+}
+
+TEST_CASE("cache_attach_dram", "[weight=1][part=test]")
+{
+    dram_config_t config;
+    dram_config_default(&config);
+
+    // The same misses cost more when they keep switching rows of a bank.
+    uintptr_t same_bank = config.row_size * config.channels * config.banks * config.ranks;
+    uint64_t cycles[2];
+    for (int k = 0; k < 2; k++) {
+        dram_t *dram = dram_new(&config);
+        cache_t *cache = cache_new(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+        cache_attach_dram(cache, dram);
+        for (uintptr_t i = 0; i < 64; i++) {
+            uintptr_t address = k == 0 ? i * 64 : (i % 2) * same_bank + (i / 2) * 64;
+            cache_read(cache, address, rand);
+        }
+        ASSERT_EQUAL(cache_miss_count(cache), 64);
+        cycles[k] = cache_cycle_count(cache);
+        cache_free(cache);
+        dram_free(dram);
+    }
+    REQUIRE(cycles[0] < cycles[1]);
+
+    // Writebacks that miss fill their line without reading it.
+    dram_t *dram = dram_new(&config);
+    cache_t *cache = cache_new(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    cache_attach_dram(cache, dram);
+    cache_mshr_init(cache, 4, 100);
+    for (uintptr_t i = 0; i < 8; i++) {
+        cache_access(cache, i * 64, CACHE_ACCESS_WRITEBACK, rand);
+    }
+    ASSERT_EQUAL(cache_miss_count(cache), 8);
+    ASSERT_EQUAL(cache->mshr->primary_misses, 0);
+    ASSERT_EQUAL(dram->read_count, 0);
+    cache_free(cache);
+    dram_free(dram);
+}
+
+TEST_CASE("cache_mshr", "[weight=1][part=test]")
+{
+    // Eight independent misses of 100 cycles, with four MSHRs.
+    cache_t *cache = cache_new(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    cache_mshr_init(cache, 4, 100);
+    for (uintptr_t i = 0; i < 8; i++) {
+        cache_read(cache, i * 64, rand);
+    }
+    ASSERT_EQUAL(cache->mshr->primary_misses, 8);
+    ASSERT_EQUAL(cache->mshr->full_stalls, 1);
+    ASSERT_EQUAL(cache->mshr->stall_cycles, 96);
+    ASSERT_EQUAL(cache_mshr_drain(cache), 204);
+    REQUIRE(cache_mshr_mlp(cache) > 3.5);
+    cache_free(cache);
+
+    // Accesses to a line being fetched merge with its miss.
+    cache = cache_new(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    cache_mshr_init(cache, 4, 100);
+    for (uintptr_t i = 0; i < 8; i++) {
+        cache_read(cache, i * 8, rand);
+    }
+    ASSERT_EQUAL(cache_miss_count(cache), 1);
+    ASSERT_EQUAL(cache->mshr->primary_misses, 1);
+    ASSERT_EQUAL(cache->mshr->merged_misses, 7);
+    ASSERT_EQUAL(cache_mshr_drain(cache), 101);
+    ASSERT_EQUAL(cache_mshr_mlp(cache), 1.0);
+
+    // A cache cannot have no MSHRs at all.
+    ASSERT_EQUAL(cache_mshr_init(cache, 0, 100), -1);
+    REQUIRE(cache->mshr != NULL);
+    cache_free(cache);
+}
+
+TEST_CASE("trace_write/trace_read", "[weight=1][part=test]")
+{
+    // Row-major and column-major walks, then some irregular accesses.
+    trace_writer_t *writer = trace_writer_open("test_trace.ctr", 0);
+    REQUIRE(writer != NULL);
+    for (uint64_t i = 0; i < 64; i++) {
+        for (uint64_t j = 0; j < 64; j++) {
+            trace_write(writer, 0x601040 + (i * 64 + j) * 8);
+        }
+    }
+    for (uint64_t j = 0; j < 64; j++) {
+        for (uint64_t i = 0; i < 64; i++) {
+            trace_write(writer, 0x601040 + (i * 64 + j) * 8);
+        }
+    }
+    uint64_t irregular[] = {0, 0xffffffffffffffc0ULL, 64, 64, 64, 8, 0x7fff0000};
+    for (size_t k = 0; k < 7; k++) {
+        trace_write(writer, irregular[k]);
+    }
+    ASSERT_EQUAL(writer->record_count, 8192 + 7);
+    ASSERT_EQUAL(trace_writer_close(writer), 0);
+
+    FILE *file = fopen("test_trace.ctr", "rb");
+    fseek(file, 0, SEEK_END);
+    REQUIRE(ftell(file) < 1024);
+    fclose(file);
+
+    trace_reader_t *reader = trace_reader_open("test_trace.ctr");
+    REQUIRE(reader != NULL);
+    uint64_t address;
+    for (uint64_t i = 0; i < 64; i++) {
+        for (uint64_t j = 0; j < 64; j++) {
+            REQUIRE(trace_read(reader, &address));
+            ASSERT_EQUAL(address, 0x601040 + (i * 64 + j) * 8);
+        }
+    }
+    uint64_t block[4096];
+    ASSERT_EQUAL(trace_read_block(reader, block, NULL, 4096), 4096);
+    ASSERT_EQUAL(block[1], 0x601040 + 64 * 8);
+    ASSERT_EQUAL(block[4095], 0x601040 + 4095 * 8);
+    ASSERT_EQUAL(trace_read_block(reader, block, NULL, 4096), 7);
+    for (size_t k = 0; k < 7; k++) {
+        ASSERT_EQUAL(block[k], irregular[k]);
+    }
+    REQUIRE(!trace_read(reader, &address));
+    trace_reader_close(reader);
+
+    cache_t *cache = cache_new(16384, 64, 1, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    ASSERT_EQUAL(trace_replay(cache, "test_trace.ctr"), 0);
+    ASSERT_EQUAL(cache_access_count(cache), 8192 + 7);
+
+    // A trace cut in the middle of a record, or holding a varint longer
+    // than 64 bits, is an error rather than the end of the trace.
+    file = fopen("test_trace.ctr", "rb");
+    uint8_t bytes[1024];
+    size_t length = fread(bytes, 1, sizeof(bytes), file);
+    fclose(file);
+    REQUIRE(bytes[length - 2] & 0x80);
+    file = fopen("test_trace_cut.ctr", "wb");
+    fwrite(bytes, 1, length - 1, file);
+    fclose(file);
+    ASSERT_EQUAL(trace_replay(cache, "test_trace_cut.ctr"), -1);
+    ASSERT_EQUAL(cache_access_count(cache), 2 * (8192 + 7) - 1);
+    REQUIRE(sweep_trace_load("test_trace_cut.ctr") == NULL);
+    cache_t *levels[1] = {cache_new(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY)};
+    cache_hierarchy_t *hierarchy = cache_hierarchy_new(1, levels);
+    ASSERT_EQUAL(cache_hierarchy_replay(hierarchy, "test_trace_cut.ctr", false), -1);
+    cache_hierarchy_free(hierarchy);
+
+    file = fopen("test_trace_cut.ctr", "wb");
+    fwrite(bytes, 1, sizeof(trace_header_t), file);
+    for (int k = 0; k < 11; k++) {
+        fputc(0x80, file);
+    }
+    fputc(0, file);
+    fclose(file);
+    reader = trace_reader_open("test_trace_cut.ctr");
+    REQUIRE(!trace_read(reader, &address));
+    REQUIRE(reader->error);
+    trace_reader_close(reader);
+    cache_free(cache);
+    remove("test_trace.ctr");
+    remove("test_trace_cut.ctr");
+
+    // A write that fails partway through the trace is reported on close.
+    writer = trace_writer_open("/dev/full", 0);
+    if (writer != NULL) {
+        uint64_t seed = 3;
+        for (size_t i = 0; i < 100000; i++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            trace_write(writer, seed);
+        }
+        REQUIRE(writer->error);
+        ASSERT_EQUAL(trace_writer_close(writer), -1);
+    }
+}
+
+TEST_CASE("cache_pc_table", "[weight=1][part=test]")
+{
+    // Two loads walk an array by rows and by columns, and a third re-reads
+    // one word; the column walk misses most.
+    trace_writer_t *writer = trace_writer_open("test_trace_pc.ctr", TRACE_FLAG_PC);
+    for (uint64_t i = 0; i < 64; i++) {
+        for (uint64_t j = 0; j < 64; j++) {
+            trace_write_pc(writer, (i * 64 + j) * 8, 0x400100);
+            trace_write_pc(writer, 0x100000, 0x400180);
+        }
+    }
+    for (uint64_t j = 0; j < 64; j++) {
+        for (uint64_t i = 0; i < 64; i++) {
+            trace_write_pc(writer, (i * 64 + j) * 8, 0x400200);
+        }
+    }
+    ASSERT_EQUAL(trace_writer_close(writer), 0);
+
+    trace_reader_t *reader = trace_reader_open("test_trace_pc.ctr");
+    uint64_t addresses[3], pcs[3];
+    ASSERT_EQUAL(trace_read_block(reader, addresses, pcs, 3), 3);
+    ASSERT_EQUAL(addresses[2], 8);
+    ASSERT_EQUAL(pcs[0], 0x400100);
+    ASSERT_EQUAL(pcs[1], 0x400180);
+    ASSERT_EQUAL(pcs[2], 0x400100);
+    trace_reader_close(reader);
+
+    cache_t *cache = cache_new(16384, 64, 1, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    cache_pc_table_init(cache);
+    ASSERT_EQUAL(trace_replay(cache, "test_trace_pc.ctr"), 0);
+    ASSERT_EQUAL(cache->pc_table->count, 3);
+
+    cache_pc_entry_t *rows = cache_pc_table_find(cache, 0x400100);
+    cache_pc_entry_t *same = cache_pc_table_find(cache, 0x400180);
+    cache_pc_entry_t *columns = cache_pc_table_find(cache, 0x400200);
+    REQUIRE(cache_pc_table_find(cache, 0x400300) == NULL);
+    ASSERT_EQUAL(rows->access_count, 4096);
+    ASSERT_EQUAL(same->access_count, 4096);
+    ASSERT_EQUAL(columns->access_count, 4096);
+    ASSERT_EQUAL(rows->miss_count + same->miss_count + columns->miss_count, cache_miss_count(cache));
+    REQUIRE(columns->miss_count > rows->miss_count);
+    REQUIRE(rows->miss_count > same->miss_count);
+
+    // Later reads without a program counter are not charged to the last one.
+    ASSERT_EQUAL(cache->access_pc, 0);
+    cache_read_pc(cache, 0x200000, 0x400300, rand);
+    cache_read(cache, 0x300000, rand);
+    ASSERT_EQUAL(cache_pc_table_find(cache, 0x400300)->access_count, 1);
+    ASSERT_EQUAL(cache_pc_table_find(cache, 0)->access_count, 1);
+
+    cache_free(cache);
+    remove("test_trace_pc.ctr");
+}
+
+
+TEST_CASE("cache_heatmap", "[weight=1][part=test]")
+{
+    // Walking a column of 64 rows of 512 bytes on a direct-mapped cache only
+    // uses every eighth set, and two rows share each of them.
+    cache_t *cache = cache_new(16384, 64, 1, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    cache_region_register(cache, "a", 0, 512, 64);
+    for (int pass = 0; pass < 4; pass++) {
+        for (uintptr_t i = 0; i < 64; i++) {
+            cache_read(cache, i * 512, rand);
+        }
+    }
+
+    uint64_t accesses = 0, misses = 0;
+    size_t hot_sets = 0;
+    for (size_t i = 0; i < cache->num_sets; i++) {
+        accesses += cache->sets[i].access_count;
+        misses += cache->sets[i].miss_count;
+        if (cache->sets[i].miss_count > 0) {
+            hot_sets++;
+        }
+    }
+    ASSERT_EQUAL(accesses, cache_access_count(cache));
+    ASSERT_EQUAL(misses, cache_miss_count(cache));
+    ASSERT_EQUAL(hot_sets, 32);
+    ASSERT_EQUAL(cache->sets[8].miss_count, 8);
+    ASSERT_EQUAL(cache->sets[8].eviction_count, 7);
+
+    ASSERT_EQUAL(cache_region_sets_touched(cache, cache->regions, 512), 32);
+    ASSERT_EQUAL(cache_region_padding(cache, cache->regions), 64);
+    ASSERT_EQUAL(cache_region_sets_touched(cache, cache->regions, 512 + 64), 64);
+
+    cache_free(cache);
+}
+
+TEST_CASE("cache_events", "[weight=1][part=test]")
+{
+    // Three lines share the single set of a 2-way cache.
+    cache_t *cache = cache_new(128, 64, 2, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY | CACHE_TRACEPOLICY);
+    REQUIRE(cache->events != NULL);
+    cache_read(cache, 0, rand);
+    cache_read(cache, 64, rand);
+    cache_read(cache, 8, rand);
+    cache_read(cache, 128, rand);
+
+    cache_event_t events[16];
+    ASSERT_EQUAL(cache_events_read(cache, events, 16), 8);
+    uint8_t types[] = {CACHE_EVENT_MISS, CACHE_EVENT_FILL, CACHE_EVENT_MISS, CACHE_EVENT_FILL,
+                       CACHE_EVENT_HIT, CACHE_EVENT_MISS, CACHE_EVENT_EVICT, CACHE_EVENT_FILL};
+    for (size_t i = 0; i < 8; i++) {
+        ASSERT_EQUAL(events[i].type, types[i]);
+    }
+    ASSERT_EQUAL(events[4].access, 3);
+    ASSERT_EQUAL(events[4].address, 0);
+    ASSERT_EQUAL(events[4].way, events[1].way);
+    ASSERT_EQUAL(events[6].address, 64);
+    ASSERT_EQUAL(events[6].way, events[3].way);
+    ASSERT_EQUAL(events[7].address, 128);
+    ASSERT_EQUAL(cache_events_read(cache, events, 16), 0);
+
+    // A ring smaller than the trace only loses events when nothing drains it.
+    ASSERT_EQUAL(cache_events_init(cache, 64), 0);
+    for (uintptr_t i = 0; i < 1000; i++) {
+        cache_read(cache, i * 64, rand);
+    }
+    ASSERT_EQUAL(cache_events_read(cache, events, 16), 16);
+    ASSERT_EQUAL(cache->events->dropped_count, 3 * 1000 - 2 - 64);
+
+    ASSERT_EQUAL(cache_events_init(cache, 64), 0);
+    ASSERT_EQUAL(cache_events_start_drain(cache, "test_events.bin"), 0);
+    for (uintptr_t i = 0; i < 1000; i++) {
+        cache_read(cache, i * 64, rand);
+    }
+    ASSERT_EQUAL(cache_events_stop_drain(cache), 0);
+    ASSERT_EQUAL(cache->events->dropped_count, 0);
+
+    FILE *file = fopen("test_events.bin", "rb");
+    cache_events_header_t header;
+    ASSERT_EQUAL(fread(&header, sizeof(header), 1, file), 1);
+    ASSERT_EQUAL(header.magic, CACHE_EVENTS_MAGIC);
+    size_t count = 0, fills = 0;
+    cache_event_t event;
+    while (fread(&event, sizeof(event), 1, file) == 1) {
+        count++;
+        if (event.type == CACHE_EVENT_FILL) {
+            ASSERT_EQUAL(event.address, 64 * (fills++));
+        }
+    }
+    ASSERT_EQUAL(count, 3 * 1000);
+    ASSERT_EQUAL(fills, 1000);
+    fclose(file);
+    remove("test_events.bin");
+
+    cache_free(cache);
+}
+
+TEST_CASE("mrc", "[weight=1][part=test]")
+{
+    // Without sampling, the curve is exact: it matches fully associative
+    // LRU caches of every size. Sampled curves are close.
+    mrc_t *exact = mrc_new(64, 2048, 1.0, 8192);
+    mrc_t *sampled = mrc_new(64, 2048, 0.1, 8192);
+    mrc_t *bounded = mrc_new(64, 2048, 0.1, 256);
+    cache_t *caches[3];
+    size_t sizes[] = {128, 512, 2048};
+    for (size_t i = 0; i < 3; i++) {
+        caches[i] = cache_new(sizes[i] * 64, 64, sizes[i], CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    }
+    cache_attach_mrc(caches[0], exact);
+
+    // Random accesses to working sets of 200, 1000 and 4000 lines.
+    uint64_t seed = 1;
+    for (size_t i = 0; i < 200000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t working_set = (seed >> 60) < 8 ? 200 : (seed >> 60) < 12 ? 1000 : 4000;
+        uintptr_t address = ((seed >> 33) % working_set) * 64;
+        for (size_t j = 0; j < 3; j++) {
+            cache_read(caches[j], address, rand);
+        }
+        mrc_access(sampled, address);
+        mrc_access(bounded, address);
+    }
+
+    ASSERT_EQUAL(exact->access_count, 200000);
+    for (size_t i = 0; i < 3; i++) {
+        double ratio = (double) cache_miss_count(caches[i]) / cache_access_count(caches[i]);
+        REQUIRE(mrc_miss_ratio(exact, sizes[i]) == Approx(ratio));
+        REQUIRE(mrc_miss_ratio(sampled, sizes[i]) == Approx(ratio).margin(0.05));
+        if (sizes[i] >= 512) {
+            REQUIRE(mrc_miss_ratio(bounded, sizes[i]) == Approx(ratio).margin(0.05));
+        }
+        cache_free(caches[i]);
+    }
+
+    // Only the bounded sample had to lower its rate, which makes it too
+    // coarse for the smallest cache.
+    REQUIRE(mrc_rate(sampled) == Approx(0.1).epsilon(0.001));
+    REQUIRE(mrc_rate(bounded) < 0.1);
+    ASSERT_EQUAL(bounded->num_samples, 256);
+
+    mrc_free(exact);
+    mrc_free(sampled);
+    mrc_free(bounded);
+}
+
+/*
+ * Producer of the stream test: a row walk of a 64x64 array of words.
+ */
+static void *stream_test_producer(void *arg) {
+    stream_producer_t *producer = (stream_producer_t *)arg;
+    for (uint64_t i = 0; i < 4096; i++) {
+        stream_push(producer, i * 8, 0x400000 + (i % 2) * 4);
+    }
+    stream_producer_close(producer);
+    return NULL;
+}
+
+TEST_CASE("stream", "[weight=1][part=test]")
+{
+    // A blocking producer in another thread waits whenever the small ring is full.
+    stream_consumer_t *consumer = stream_consumer_create("/cache_test_stream", 60);
+    REQUIRE(consumer != NULL);
+    ASSERT_EQUAL(consumer->ring->capacity, 64);
+    REQUIRE(stream_consumer_create("/cache_test_stream", 60) == NULL);
+
+    stream_producer_t *producer = stream_producer_open("/cache_test_stream", STREAM_MODE_BLOCK);
+    REQUIRE(producer != NULL);
+    REQUIRE(stream_producer_open("/cache_test_stream", STREAM_MODE_BLOCK) == NULL);
+
+    cache_t *cache = cache_new(16384, 64, 1, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    cache_pc_table_init(cache);
+    pthread_t thread;
+    ASSERT_EQUAL(pthread_create(&thread, NULL, stream_test_producer, producer), 0);
+    ASSERT_EQUAL(stream_replay(consumer, cache), 4096);
+    pthread_join(thread, NULL);
+
+    ASSERT_EQUAL(cache_access_count(cache), 4096);
+    ASSERT_EQUAL(cache_miss_count(cache), 512);
+    ASSERT_EQUAL(cache_pc_table_find(cache, 0x400004)->access_count, 2048);
+    ASSERT_EQUAL(consumer->ring->dropped_count, 0);
+    cache_free(cache);
+    stream_consumer_free(consumer);
+
+    // A dropping producer never waits.
+    consumer = stream_consumer_create("/cache_test_stream", 16);
+    producer = stream_producer_open("/cache_test_stream", STREAM_MODE_DROP);
+    for (uint64_t i = 0; i < 100; i++) {
+        ASSERT_EQUAL(stream_push(producer, i, 0), i < 16);
+    }
+    stream_record_t records[32];
+    ASSERT_EQUAL(stream_consume(consumer, records, 32), 16);
+    ASSERT_EQUAL(records[15].address, 15);
+    REQUIRE(stream_push(producer, 100, 0));
+    stream_producer_close(producer);
+
+    ASSERT_EQUAL(stream_consume(consumer, records, 32), 1);
+    ASSERT_EQUAL(records[0].address, 100);
+    ASSERT_EQUAL(consumer->ring->dropped_count, 84);
+    ASSERT_EQUAL(consumer->ring->full_count, 0);
+    stream_consumer_free(consumer);
+}
+
+TEST_CASE("cache_hierarchy", "[weight=1][part=test]")
+{
+    // The same accesses through a serial and a pipelined three-level
+    // hierarchy give the same statistics at every level.
+    cache_hierarchy_t *hierarchies[2];
+    for (size_t i = 0; i < 2; i++) {
+        cache_t *levels[3] = {
+            cache_new(4096, 64, 2, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY),
+            cache_new(32768, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY),
+            cache_new(262144, 64, 8, CACHE_REPLACEMENTPOLICY_LIP | CACHE_NODATAPOLICY),
+        };
+        hierarchies[i] = cache_hierarchy_new(3, levels);
+    }
+    ASSERT_EQUAL(cache_hierarchy_start_pipeline(hierarchies[1], 64), 0);
+
+    uint64_t seed = 7;
+    for (size_t i = 0; i < 200000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t range = (seed >> 62) == 0 ? 1 << 20 : (seed >> 62) == 1 ? 1 << 16 : 1 << 12;
+        uintptr_t address = ((seed >> 20) % range) & ~(uintptr_t) 7;
+        cache_hierarchy_read(hierarchies[0], address, rand);
+        cache_hierarchy_read_pipelined(hierarchies[1], address, rand);
+    }
+    cache_hierarchy_stop_pipeline(hierarchies[1]);
+
+    for (size_t level = 0; level < 3; level++) {
+        cache_t *serial = hierarchies[0]->levels[level];
+        cache_t *pipelined = hierarchies[1]->levels[level];
+        ASSERT_EQUAL(cache_access_count(serial), cache_access_count(pipelined));
+        ASSERT_EQUAL(cache_miss_count(serial), cache_miss_count(pipelined));
+        if (level > 0) {
+            ASSERT_EQUAL(cache_access_count(serial), cache_miss_count(hierarchies[0]->levels[level - 1]));
+        }
+        for (size_t i = 0; i < serial->num_sets; i++) {
+            ASSERT_EQUAL(serial->sets[i].miss_count, pipelined->sets[i].miss_count);
+        }
+    }
+    REQUIRE(cache_miss_count(hierarchies[0]->levels[2]) > 0);
+
+    cache_hierarchy_free(hierarchies[0]);
+    cache_hierarchy_free(hierarchies[1]);
+}
+
+/*
+ * Random number generators with separate, identical sequences, so that two
+ * caches make the same random choices.
+ */
+static uint64_t fast_path_seeds[2];
+static int fast_path_random_0() {
+    fast_path_seeds[0] = fast_path_seeds[0] * 6364136223846793005ULL + 1442695040888963407ULL;
+    return fast_path_seeds[0] >> 33;
+}
+static int fast_path_random_1() {
+    fast_path_seeds[1] = fast_path_seeds[1] * 6364136223846793005ULL + 1442695040888963407ULL;
+    return fast_path_seeds[1] >> 33;
+}
+
+TEST_CASE("cache_read::last_line", "[weight=1][part=test]")
+{
+    // Reads that skip the search of the set leave the cache exactly as the
+    // full lookup does, for every implemented policy.
+    uint8_t policies[] = {CACHE_REPLACEMENTPOLICY_LRU, CACHE_REPLACEMENTPOLICY_LIP, CACHE_REPLACEMENTPOLICY_BIP,
+                          CACHE_REPLACEMENTPOLICY_DIP, CACHE_REPLACEMENTPOLICY_RANDOMIZED_MARKING,
+                          CACHE_REPLACEMENTPOLICY_OPT};
+    for (size_t p = 0; p < 6; p++) {
+        cache_t *fast = cache_new(4096, 64, 4, policies[p] | CACHE_NODATAPOLICY);
+        cache_t *slow = cache_new(4096, 64, 4, policies[p] | CACHE_NODATAPOLICY);
+        fast_path_seeds[0] = fast_path_seeds[1] = 3;
+
+        // Row walks, which read each block eight times in a row, mixed with
+        // random reads and repeated reads of a few words.
+        uint64_t seed = 5;
+        size_t skipped = 0;
+        for (size_t i = 0; i < 50000; i++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            uintptr_t address;
+            if (i % 4096 < 2048) {
+                address = (i % 4096) * 8;
+            } else if ((seed >> 62) == 0) {
+                address = (seed >> 40) % 4 * 8;
+            } else {
+                address = ((seed >> 20) % 65536) & ~(uintptr_t) 7;
+            }
+            fast->access_next_use = slow->access_next_use = seed >> 44;
+
+            if (fast->last_line != NULL && fast->last_line_address == (address & ~fast->block_offset_mask)) {
+                skipped++;
+            }
+            cache_read(fast, address, fast_path_random_0);
+            slow->last_line = NULL;
+            cache_read(slow, address, fast_path_random_1);
+        }
+        if (policies[p] != CACHE_REPLACEMENTPOLICY_OPT) {
+            REQUIRE(skipped > 10000);
+        }
+
+        ASSERT_EQUAL(cache_miss_count(fast), cache_miss_count(slow));
+        ASSERT_EQUAL(fast->duel.psel, slow->duel.psel);
+        for (size_t i = 0; i < fast->num_lines; i++) {
+            ASSERT_EQUAL(fast->lines[i].is_valid, slow->lines[i].is_valid);
+            ASSERT_EQUAL(fast->lines[i].is_marked, slow->lines[i].is_marked);
+            ASSERT_EQUAL(fast->lines[i].tag, slow->lines[i].tag);
+            if (fast->next_use != NULL) {
+                ASSERT_EQUAL(fast->next_use[i], slow->next_use[i]);
+            }
+        }
+        for (size_t i = 0; i < fast->num_sets; i++) {
+            ASSERT_EQUAL(fast->sets[i].num_marked, slow->sets[i].num_marked);
+            ASSERT_EQUAL(fast->sets[i].miss_count, slow->sets[i].miss_count);
+            for (size_t j = 0; j < fast->associativity; j++) {
+                ASSERT_EQUAL(fast->sets[i].lru_list[j], slow->sets[i].lru_list[j]);
+            }
+        }
+
+        cache_free(fast);
+        cache_free(slow);
+    }
+}
+
+TEST_CASE("cache_read_batch", "[weight=1][part=test]")
+{
+    // Every kernel the processor supports splits addresses as cache_read does.
+    cache_t *cache = cache_new(32768, 64, 4, CACHE_REPLACEMENTPOLICY_LRU);
+    uint64_t addresses[37], lines[37], indices[37], tags[37];
+    uint64_t seed = 11;
+    for (size_t i = 0; i < 37; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        addresses[i] = seed;
+    }
+    for (int kernel = CACHE_DECOMPOSE_SCALAR; kernel <= cache_decompose_kernel(); kernel++) {
+        cache_decompose_with(cache, kernel, addresses, 37, lines, indices, tags);
+        for (size_t i = 0; i < 37; i++) {
+            ASSERT_EQUAL(lines[i], addresses[i] & ~(uint64_t) 63);
+            ASSERT_EQUAL(indices[i], (addresses[i] >> 6) % 128);
+            ASSERT_EQUAL(tags[i], addresses[i] >> 13);
+        }
+    }
+    cache_free(cache);
+
+    // A batch reads the same values and leaves the same state as single reads.
+    static int64_t array[4096];
+    uint64_t batch[6000], values[6000];
+    for (size_t i = 0; i < 4096; i++) {
+        array[i] = i * 3;
+    }
+    for (size_t i = 0; i < 6000; i++) {
+        batch[i] = (uintptr_t) &array[i < 4096 ? i : (i * 37) % 4096];
+    }
+    cache_t *batched = cache_new(4096, 64, 2, CACHE_REPLACEMENTPOLICY_LRU);
+    cache_t *single = cache_new(4096, 64, 2, CACHE_REPLACEMENTPOLICY_LRU);
+    cache_read_batch(batched, batch, NULL, 6000, values, rand);
+    for (size_t i = 0; i < 6000; i++) {
+        ASSERT_EQUAL(values[i], cache_read(single, batch[i], rand));
+    }
+    ASSERT_EQUAL(cache_access_count(batched), 6000);
+    ASSERT_EQUAL(cache_miss_count(batched), cache_miss_count(single));
+    for (size_t i = 0; i < batched->num_sets; i++) {
+        ASSERT_EQUAL(batched->sets[i].miss_count, single->sets[i].miss_count);
+    }
+    cache_free(batched);
+    cache_free(single);
+}
+
+TEST_CASE("cache_timeseries", "[weight=1][part=test]")
+{
+    // Phases that reuse a small array alternate with phases that stream
+    // through a large one.
+    cache_t *cache = cache_new(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    ASSERT_EQUAL(cache_timeseries_init(cache, 1000, 8), 0);
+    for (uint32_t phase = 0; phase < 4; phase++) {
+        cache_timeseries_label(cache, phase);
+        for (uintptr_t i = 0; i < 1000; i++) {
+            cache_read(cache, phase % 2 == 0 ? (i % 32) * 64 : 65536 + (phase * 1000 + i) * 64, rand);
+        }
+    }
+
+    cache_timeseries_t *timeseries = cache->timeseries;
+    ASSERT_EQUAL(timeseries->count, 4);
+    ASSERT_EQUAL(timeseries->snapshots[1].access_count, 1000);
+    ASSERT_EQUAL(timeseries->snapshots[1].miss_count, 32);
+    ASSERT_EQUAL(timeseries->snapshots[2].miss_count - timeseries->snapshots[1].miss_count, 1000);
+    ASSERT_EQUAL(timeseries->snapshots[3].label, 2);
+
+    ASSERT_EQUAL(cache_timeseries_write_csv(cache, "test_timeseries.csv"), 0);
+    FILE *file = fopen("test_timeseries.csv", "r");
+    char line[128];
+    REQUIRE(fgets(line, sizeof(line), file) != NULL);
+    REQUIRE(std::string(line) == "window,first_access,accesses,misses,miss_rate,cycles,label\n");
+    size_t windows = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        windows++;
+    }
+    ASSERT_EQUAL(windows, 4);
+    fclose(file);
+    remove("test_timeseries.csv");
+
+    // A full series keeps every other snapshot, and its interval doubles.
+    for (uintptr_t i = 0; i < 6000; i++) {
+        cache_read(cache, (i % 32) * 64, rand);
+    }
+    ASSERT_EQUAL(timeseries->interval, 2000);
+    ASSERT_EQUAL(timeseries->count, 5);
+    for (size_t i = 0; i < timeseries->count; i++) {
+        ASSERT_EQUAL(timeseries->snapshots[i].access_count, i * 2000);
+    }
+    ASSERT_EQUAL(timeseries->snapshots[1].miss_count, 32 + 1000);
+    ASSERT_EQUAL(timeseries->snapshots[2].miss_count, 32 + 1000 + 32 + 1000);
+    cache_free(cache);
+
+    // Snapshots go on past 2^32 accesses.
+    cache = cache_new(4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    cache->access_count = ((uint64_t) 1 << 32) - 10;
+    ASSERT_EQUAL(cache_timeseries_init(cache, 8, 8), 0);
+    for (uintptr_t i = 0; i < 32; i++) {
+        cache_read(cache, i * 64, rand);
+    }
+    ASSERT_EQUAL(cache_access_count(cache), ((uint64_t) 1 << 32) + 22);
+    ASSERT_EQUAL(cache->timeseries->count, 4);
+    ASSERT_EQUAL(cache->timeseries->snapshots[3].access_count, ((uint64_t) 1 << 32) + 14);
+
+    cache_free(cache);
+}
+
+TEST_CASE("cache_line_block", "[weight=1][part=test]")
+{
+    // Flags and tag share a word, and blocks are found from the line index.
+    ASSERT_EQUAL(sizeof(cache_line_t), 8);
+    cache_line_t line = {true, false, true, ((uintptr_t) 1 << 60) + 5};
+    REQUIRE(line.is_valid);
+    REQUIRE(!line.is_dirty);
+    REQUIRE(line.is_marked);
+    ASSERT_EQUAL(line.tag, ((uintptr_t) 1 << 60) + 5);
+
+    static int64_t array[64];
+    for (size_t i = 0; i < 64; i++) {
+        array[i] = i;
+    }
+    cache_t *cache = cache_new(1024, 64, 2, CACHE_REPLACEMENTPOLICY_LRU);
+    ASSERT_EQUAL(cache_line_block(cache, cache->lines + 3), cache->memory + 3 * 64);
+    ASSERT_EQUAL(cache_read(cache, (uintptr_t) &array[9], rand), 9);
+    ASSERT_EQUAL(cache_read(cache, (uintptr_t) &array[10], rand), 10);
+    cache_free(cache);
+
+    cache = cache_new(1024, 64, 2, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    REQUIRE(cache_line_block(cache, cache->lines + 3) == NULL);
+    cache_free(cache);
+}
+
+TEST_CASE("cache_hierarchy::split", "[weight=1][part=test]")
+{
+    // Instruction fetches and data accesses go to their own first level and
+    // share the second, serially and pipelined, with statistics per type.
+    cache_hierarchy_t *hierarchies[2];
+    for (size_t i = 0; i < 2; i++) {
+        cache_t *levels[2] = {
+            cache_new(4096, 64, 2, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY),
+            cache_new(65536, 64, 8, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY),
+        };
+        hierarchies[i] = cache_hierarchy_new(2, levels);
+        ASSERT_EQUAL(cache_hierarchy_split(hierarchies[i],
+                     cache_new(4096, 64, 2, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY)), 0);
+    }
+    ASSERT_EQUAL(cache_hierarchy_start_pipeline(hierarchies[1], 64), 0);
+
+    // A loop of 16KB of code, larger than the instruction cache, loading and
+    // storing over 8KB of data.
+    for (size_t i = 0; i < 20000; i++) {
+        uintptr_t pc = 0x400000 + (i % 4096) * 4;
+        uintptr_t data = 0x10000000 + (i * 72) % 8192;
+        int type = i % 3 == 0 ? CACHE_ACCESS_STORE : CACHE_ACCESS_LOAD;
+        cache_hierarchy_access(hierarchies[0], pc, CACHE_ACCESS_IFETCH, rand);
+        cache_hierarchy_access(hierarchies[0], data, type, rand);
+        cache_hierarchy_access_pipelined(hierarchies[1], pc, CACHE_ACCESS_IFETCH, rand);
+        cache_hierarchy_access_pipelined(hierarchies[1], data, type, rand);
+    }
+    cache_hierarchy_stop_pipeline(hierarchies[1]);
+
+    for (size_t h = 0; h < 2; h++) {
+        cache_t *l1i = hierarchies[h]->instruction_cache;
+        cache_t *l1d = hierarchies[h]->levels[0];
+        cache_t *l2 = hierarchies[h]->levels[1];
+        ASSERT_EQUAL(l1i->type_access_count[CACHE_ACCESS_IFETCH], 20000);
+        ASSERT_EQUAL(l1i->type_access_count[CACHE_ACCESS_LOAD] + l1i->type_access_count[CACHE_ACCESS_STORE], 0);
+        ASSERT_EQUAL(l1d->type_access_count[CACHE_ACCESS_IFETCH], 0);
+        ASSERT_EQUAL(l1d->type_access_count[CACHE_ACCESS_STORE], 6667);
+        for (int type = 0; type < CACHE_ACCESS_TYPES; type++) {
+            cache_t *first = type == CACHE_ACCESS_IFETCH ? l1i : l1d;
+            ASSERT_EQUAL(l2->type_access_count[type], first->type_miss_count[type]);
+            ASSERT_EQUAL(l2->type_access_count[type], hierarchies[0]->levels[1]->type_access_count[type]);
+            ASSERT_EQUAL(l2->type_miss_count[type], hierarchies[0]->levels[1]->type_miss_count[type]);
+        }
+
+        // The code misses in the instruction cache on every line, and only the
+        // first time in the second level.
+        ASSERT_EQUAL(l1i->type_miss_count[CACHE_ACCESS_IFETCH], 20000 / 16);
+        ASSERT_EQUAL(l2->type_miss_count[CACHE_ACCESS_IFETCH], 256);
+        ASSERT_EQUAL(cache_hierarchy_stall_cycles(hierarchies[h], CACHE_ACCESS_IFETCH),
+                     (uint64_t) (20000 / 16 - 256) * (14 - 4) + 256 * (200 - 4));
+    }
+
+    // Stores dirty the lines of write-back caches.
+    cache_t *cache = cache_new(4096, 64, 2, CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITEBACK
+                                            | CACHE_NODATAPOLICY);
+    cache_access(cache, 0x1000, CACHE_ACCESS_LOAD, rand);
+    cache_access(cache, 0x2000, CACHE_ACCESS_STORE, rand);
+    cache_access(cache, 0x3000, CACHE_ACCESS_LOAD, rand);
+    cache_access(cache, 0x3000, CACHE_ACCESS_STORE, rand);
+    size_t dirty = 0;
+    for (size_t i = 0; i < cache->num_sets * cache->associativity; i++) {
+        dirty += cache->lines[i].is_valid && cache->lines[i].is_dirty;
+    }
+    ASSERT_EQUAL(dirty, 2);
+    ASSERT_EQUAL(cache->access_type, CACHE_ACCESS_LOAD);
+    cache_free(cache);
+
+    cache_hierarchy_free(hierarchies[0]);
+    cache_hierarchy_free(hierarchies[1]);
+}
+
+/*
+ * First-in, first-out replacement, with the next way to fill of each set
+ * as its state.
+ */
+static size_t fifo_victim(cache_t *cache, cache_set_t *cache_set, func_t generate_random_number) {
+    return *(size_t *)cache_replacement_state(cache, cache_set);
+}
+static void fifo_fill(cache_t *cache, cache_set_t *cache_set, size_t way, func_t generate_random_number) {
+    size_t *next = (size_t *)cache_replacement_state(cache, cache_set);
+    *next = (way + 1) % cache->associativity;
+}
+static const cache_replacement_t fifo = {"fifo", sizeof(size_t), NULL, fifo_victim, fifo_fill, NULL, NULL};
+
+TEST_CASE("cache_replacement", "[weight=1][part=test]")
+{
+    // Policies are found by name, and names are unique.
+    REQUIRE(cache_replacement_find("lru") == cache_replacement_builtin(CACHE_REPLACEMENTPOLICY_LRU));
+    REQUIRE(cache_replacement_find("fifo") == NULL);
+    ASSERT_EQUAL(cache_replacement_register(&fifo), 0);
+    ASSERT_EQUAL(cache_replacement_register(&fifo), -1);
+    REQUIRE(cache_replacement_find("fifo") == &fifo);
+
+    // With two ways, reading the first line again saves it from LRU but not
+    // from FIFO.
+    cache_t *lru = cache_new(1024, 64, 2, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    cache_t *first_in = cache_new(1024, 64, 2, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    ASSERT_EQUAL(cache_replacement_install(first_in, cache_replacement_find("fifo")), 0);
+    uintptr_t addresses[] = {0x0000, 0x0200, 0x0000, 0x0400, 0x0000};
+    for (size_t i = 0; i < 5; i++) {
+        cache_read(lru, addresses[i], rand);
+        cache_read(first_in, addresses[i], rand);
+    }
+    ASSERT_EQUAL(cache_miss_count(lru), 3);
+    ASSERT_EQUAL(cache_miss_count(first_in), 4);
+    cache_read(first_in, 0x0600, rand);
+    ASSERT_EQUAL(*(size_t *)cache_replacement_state(first_in, first_in->sets), 1);
+    ASSERT_EQUAL(*(size_t *)cache_replacement_state(first_in, first_in->sets + 1), 0);
+
+    // Checkpoints keep the policy and its state.
+    ASSERT_EQUAL(cache_checkpoint(first_in, "test_checkpoint.bin"), 0);
+    cache_t *restored = cache_restore("test_checkpoint.bin");
+    REQUIRE(restored != NULL);
+    REQUIRE(restored->replacement == &fifo);
+    ASSERT_EQUAL(*(size_t *)cache_replacement_state(restored, restored->sets), 1);
+    for (uintptr_t address = 0; address < 0x1000; address += 0x140) {
+        ASSERT_EQUAL(cache_read(restored, address, rand), cache_read(first_in, address, rand));
+    }
+    ASSERT_EQUAL(cache_miss_count(restored), cache_miss_count(first_in));
+    cache_free(restored);
+    remove("test_checkpoint.bin");
+
+    // The helpers of cache.h go through the installed policy as well.
+    size_t *next = (size_t *)cache_replacement_state(first_in, first_in->sets);
+    size_t way = *next;
+    REQUIRE(find_available_cache_line(first_in, first_in->sets, rand) == first_in->sets[0].lines + way);
+    ASSERT_EQUAL(*next, (way + 1) % 2);
+
+    cache_free(lru);
+    cache_free(first_in);
+}
+
+TEST_CASE("cache_config", "[weight=1][part=test]")
+{
+    // A configuration file gives the same simulation as code.
+    FILE *out = fopen("test_config.cfg", "w");
+    fprintf(out, "# Column walk of main.c.\n[simulation]\nkernel = sumB\nrows = 64\ncols = 64\n\n"
+                 "[l1]\nsize = 16384\nline = 64\nassociativity = 4   # ways\n"
+                 "[l2]\nsize = 65536\nline = 64\nassociativity = 8\npolicy = lip\nlatency = 10\n");
+    fclose(out);
+    cache_config_t config;
+    ASSERT_EQUAL(cache_config_load(&config, "test_config.cfg"), 0);
+    ASSERT_EQUAL(config.num_levels, 2);
+    REQUIRE(!config.split);
+    ASSERT_EQUAL(config.levels[1].latency, 10);
+
+    cache_hierarchy_t *hierarchy = cache_config_build(&config);
+    REQUIRE(hierarchy != NULL);
+    ASSERT_EQUAL(cache_config_run(&config, hierarchy), 0);
+
+    cache_t *l1 = cache_new(16384, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_NODATAPOLICY);
+    for (size_t j = 0; j < 64; j++) {
+        for (size_t i = 0; i < 64; i++) {
+            cache_read(l1, (i * 64 + j) * sizeof(int64_t), rand);
+        }
+    }
+    ASSERT_EQUAL(cache_access_count(hierarchy->levels[0]), cache_access_count(l1));
+    ASSERT_EQUAL(cache_miss_count(hierarchy->levels[0]), cache_miss_count(l1));
+    ASSERT_EQUAL(cache_access_count(hierarchy->levels[1]), cache_miss_count(l1));
+    REQUIRE((hierarchy->levels[1]->policies & CACHE_REPLACEMENTPOLICY_MASK) == CACHE_REPLACEMENTPOLICY_LIP);
+    cache_free(l1);
+    cache_hierarchy_free(hierarchy);
+
+    // Mistakes are reported with their line.
+    out = fopen("test_config.cfg", "w");
+    fprintf(out, "[simulation]\nkernel = sumA\nrows = 8\ncols = 8\n[l1]\nsize = 16384\nline = 64\nways = 4\n");
+    fclose(out);
+    ASSERT_EQUAL(cache_config_load(&config, "test_config.cfg"), -1);
+    ASSERT_EQUAL(std::string(config.error), "test_config.cfg:8: invalid ways = 4");
+
+    out = fopen("test_config.cfg", "w");
+    fprintf(out, "[simulation]\nkernel = sumA\nrows = 8\ncols = 8\n[l1d]\nsize = 16384\nline = 64\n"
+                 "associativity = 4\n[l3]\nsize = 65536\nline = 64\nassociativity = 8\n");
+    fclose(out);
+    ASSERT_EQUAL(cache_config_load(&config, "test_config.cfg"), -1);
+
+    // Negative numbers, and latencies below the one of the first level,
+    // which stall cycles are counted from, are refused.
+    out = fopen("test_config.cfg", "w");
+    fprintf(out, "[simulation]\nkernel = sumA\nrows = 8\ncols = -1\n[l1]\nsize = 16384\nline = 64\n"
+                 "associativity = 4\n");
+    fclose(out);
+    ASSERT_EQUAL(cache_config_load(&config, "test_config.cfg"), -1);
+    ASSERT_EQUAL(std::string(config.error), "test_config.cfg:4: invalid cols = -1");
+
+    out = fopen("test_config.cfg", "w");
+    fprintf(out, "[simulation]\nkernel = sumA\nrows = 8\ncols = 8\n[l1]\nsize = 16384\nline = 64\n"
+                 "associativity = 4\nlatency = 12\n[l2]\nsize = 65536\nline = 64\nassociativity = 8\n"
+                 "latency = 10\n");
+    fclose(out);
+    ASSERT_EQUAL(cache_config_load(&config, "test_config.cfg"), -1);
+    ASSERT_EQUAL(std::string(config.error), "test_config.cfg:14: [l2] latency 10 is below the 12 of the first level");
+
+    out = fopen("test_config.cfg", "w");
+    fprintf(out, "[simulation]\nkernel = sumA\nrows = 8\ncols = 8\nmemory_latency = 2\n[l1]\nsize = 16384\n"
+                 "line = 64\nassociativity = 4\n");
+    fclose(out);
+    ASSERT_EQUAL(cache_config_load(&config, "test_config.cfg"), -1);
+    ASSERT_EQUAL(std::string(config.error), "test_config.cfg:5: memory_latency 2 is below the 4 of the first level");
+    remove("test_config.cfg");
+}
+
+TEST_CASE("sweep_run", "[weight=1][part=test]")
+{
+    // A mix of loops over arrays of several sizes and random accesses.
+    trace_writer_t *writer = trace_writer_open("test_sweep.trace", TRACE_FLAG_PC);
+    uint64_t seed = 11;
+    for (size_t i = 0; i < 60000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t address = (seed >> 62) == 0 ? (seed >> 20) % (1 << 20) : (i % (4096 << (seed >> 62))) * 8;
+        trace_write_pc(writer, address & ~(uint64_t) 7, 0x400000 + (i % 16) * 4);
+    }
+    ASSERT_EQUAL(trace_writer_close(writer), 0);
+
+    sweep_trace_t *trace = sweep_trace_load("test_sweep.trace");
+    REQUIRE(trace != NULL);
+    ASSERT_EQUAL(trace->count, 60000);
+    REQUIRE(trace->pcs != NULL);
+
+    sweep_config_t configs[18];
+    uint8_t policies[] = {CACHE_REPLACEMENTPOLICY_LRU, CACHE_REPLACEMENTPOLICY_LIP, CACHE_REPLACEMENTPOLICY_DIP};
+    size_t count = 0;
+    for (size_t size = 4096; size <= 16384; size *= 2)
+        for (size_t associativity = 2; associativity <= 4; associativity *= 2)
+            for (size_t p = 0; p < 3; p++) {
+                sweep_config_t config = {size, 64, associativity, policies[p]};
+                configs[count++] = config;
+            }
+
+    // Results do not depend on the number of threads, and match replaying
+    // the trace when no random numbers are drawn.
+    sweep_result_t parallel[18], serial[18];
+    ASSERT_EQUAL(sweep_run(trace, configs, count, parallel, 4), 0);
+    ASSERT_EQUAL(sweep_run(trace, configs, count, serial, 1), 0);
+    sweep_config_t short_lines = {4096, 4, 2, CACHE_REPLACEMENTPOLICY_LRU};
+    ASSERT_EQUAL(sweep_run(trace, &short_lines, 1, serial, 1), -1);
+    ASSERT_EQUAL(sweep_run_lockstep(trace, &short_lines, 1, serial), -1);
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_EQUAL(parallel[i].access_count, 60000);
+        ASSERT_EQUAL(parallel[i].miss_count, serial[i].miss_count);
+        if (configs[i].policies != CACHE_REPLACEMENTPOLICY_DIP) {
+            cache_t *cache = cache_new(configs[i].size, 64, configs[i].associativity,
+                                       configs[i].policies | CACHE_NODATAPOLICY);
+            ASSERT_EQUAL(trace_replay(cache, "test_sweep.trace"), 0);
+            ASSERT_EQUAL(parallel[i].miss_count, cache_miss_count(cache));
+            cache_free(cache);
+        }
+    }
+
+    sweep_trace_free(trace);
+    remove("test_sweep.trace");
+
+    // Typed traces lose their types, so caches that allocate on writes give
+    // the misses of a replay, and the others are refused.
+    writer = trace_writer_open("test_sweep_typed.trace", TRACE_FLAG_TYPE);
+    for (size_t i = 0; i < 20000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t type = (seed >> 40) % 3 == 0 ? CACHE_ACCESS_STORE : CACHE_ACCESS_LOAD;
+        trace_write(writer, ((seed >> 20) % (1 << 16)) * 8 | type);
+    }
+    ASSERT_EQUAL(trace_writer_close(writer), 0);
+    trace = sweep_trace_load("test_sweep_typed.trace");
+    REQUIRE(trace != NULL);
+    REQUIRE(trace->typed);
+    sweep_config_t allocating = {4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITEBACK};
+    ASSERT_EQUAL(sweep_run(trace, &allocating, 1, serial, 1), 0);
+    cache_t *cache = cache_new(4096, 64, 4, allocating.policies | CACHE_NODATAPOLICY);
+    ASSERT_EQUAL(trace_replay(cache, "test_sweep_typed.trace"), 0);
+    ASSERT_EQUAL(serial[0].miss_count, cache_miss_count(cache));
+    cache_free(cache);
+    sweep_config_t no_allocate = {4096, 64, 4, CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITENOALLOCATE};
+    ASSERT_EQUAL(sweep_run(trace, &no_allocate, 1, serial, 1), -1);
+    ASSERT_EQUAL(sweep_run_lockstep(trace, &no_allocate, 1, serial), -1);
+    sweep_trace_free(trace);
+    remove("test_sweep_typed.trace");
+}
+
+TEST_CASE("sweep_run_lockstep", "[weight=1][part=test]")
+{
+    trace_writer_t *writer = trace_writer_open("test_lockstep.trace", 0);
+    uint64_t seed = 13;
+    for (size_t i = 0; i < 40000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t address = (seed >> 62) == 0 ? (seed >> 20) % (1 << 18) : (i % 3000) * 8;
+        trace_write(writer, address & ~(uint64_t) 7);
+    }
+    ASSERT_EQUAL(trace_writer_close(writer), 0);
+    sweep_trace_t *trace = sweep_trace_load("test_lockstep.trace");
+    REQUIRE(trace != NULL);
+
+    // Geometries shared by several policies, including ones that draw
+    // random numbers, give the same results in lock step.
+    sweep_config_t configs[16];
+    uint8_t policies[] = {CACHE_REPLACEMENTPOLICY_LRU, CACHE_REPLACEMENTPOLICY_BIP, CACHE_REPLACEMENTPOLICY_DIP,
+                          CACHE_REPLACEMENTPOLICY_RANDOMIZED_MARKING};
+    size_t count = 0;
+    for (size_t size = 1024; size <= 8192; size *= 8)
+        for (size_t line_size = 32; line_size <= 64; line_size *= 2)
+            for (size_t p = 0; p < 4; p++) {
+                sweep_config_t config = {size, line_size, size == 1024 ? (size_t) 2 : (size_t) 4, policies[p]};
+                configs[count++] = config;
+            }
+
+    sweep_result_t independent[16], lockstep[16];
+    ASSERT_EQUAL(sweep_run(trace, configs, count, independent, 2), 0);
+    ASSERT_EQUAL(sweep_run_lockstep(trace, configs, count, lockstep), 0);
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_EQUAL(lockstep[i].access_count, 40000);
+        ASSERT_EQUAL(lockstep[i].miss_count, independent[i].miss_count);
+        ASSERT_EQUAL(lockstep[i].cycle_count, independent[i].cycle_count);
+    }
+    REQUIRE(lockstep[0].miss_count > lockstep[count - 1].miss_count);
+
+    sweep_trace_free(trace);
+    remove("test_lockstep.trace");
+}
+
+TEST_CASE("cache_hierarchy::write_policy", "[weight=1][part=test]")
+{
+    // Write-through first levels pass every store on, hit or miss, and a
+    // write-no-allocate one does not fill a line when a store misses,
+    // serially and pipelined.
+    uint8_t policies[2] = {CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITETHROUGH | CACHE_NODATAPOLICY,
+                           CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITETHROUGH
+                           | CACHE_WRITEPOLICY_WRITENOALLOCATE | CACHE_NODATAPOLICY};
+    for (size_t p = 0; p < 2; p++) {
+        for (int pipelined = 0; pipelined < 2; pipelined++) {
+            cache_t *levels[2] = {
+                cache_new(4096, 64, 2, policies[p]),
+                cache_new(65536, 64, 8, CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITEBACK | CACHE_NODATAPOLICY),
+            };
+            cache_hierarchy_t *hierarchy = cache_hierarchy_new(2, levels);
+            if (pipelined) {
+                ASSERT_EQUAL(cache_hierarchy_start_pipeline(hierarchy, 64), 0);
+            }
+            for (size_t i = 0; i < 3; i++) {
+                if (pipelined) {
+                    cache_hierarchy_access_pipelined(hierarchy, 0x1000, CACHE_ACCESS_STORE, rand);
+                } else {
+                    cache_hierarchy_access(hierarchy, 0x1000, CACHE_ACCESS_STORE, rand);
+                }
+            }
+            if (pipelined) {
+                cache_hierarchy_access_pipelined(hierarchy, 0x1008, CACHE_ACCESS_LOAD, rand);
+                cache_hierarchy_stop_pipeline(hierarchy);
+            } else {
+                cache_hierarchy_access(hierarchy, 0x1008, CACHE_ACCESS_LOAD, rand);
+            }
+
+            cache_t *l1 = hierarchy->levels[0], *l2 = hierarchy->levels[1];
+            ASSERT_EQUAL(l2->type_access_count[CACHE_ACCESS_STORE], 3);
+            ASSERT_EQUAL(l2->type_miss_count[CACHE_ACCESS_STORE], 1);
+            ASSERT_EQUAL(l2->writeback_count, 0);
+            if (p == 0) {
+                ASSERT_EQUAL(l1->type_miss_count[CACHE_ACCESS_STORE], 1);
+                ASSERT_EQUAL(l1->type_miss_count[CACHE_ACCESS_LOAD], 0);
+                ASSERT_EQUAL(l2->type_access_count[CACHE_ACCESS_LOAD], 0);
+            } else {
+                ASSERT_EQUAL(l1->type_miss_count[CACHE_ACCESS_STORE], 3);
+                ASSERT_EQUAL(l1->type_miss_count[CACHE_ACCESS_LOAD], 1);
+                ASSERT_EQUAL(l2->type_access_count[CACHE_ACCESS_LOAD], 1);
+            }
+            // Accesses of an unknown type are ignored.
+            cache_hierarchy_access(hierarchy, 0x2000, CACHE_ACCESS_TYPES, rand);
+            cache_access(l1, 0x2000, -1, rand);
+            ASSERT_EQUAL(l1->access_count, 4);
+            ASSERT_EQUAL(std::string(cache_access_type_name(CACHE_ACCESS_TYPES)), "unknown");
+            ASSERT_EQUAL(cache_hierarchy_stall_cycles(hierarchy, CACHE_ACCESS_STORE), 0);
+            cache_hierarchy_free(hierarchy);
+        }
+    }
+}
+
+TEST_CASE("cache_hierarchy::filter", "[weight=1][part=test]")
+{
+    // The same loads and stores through [L1, L2, L3], serially and
+    // pipelined, and through [L1, L2] with the accesses leaving L2 written
+    // to a filter trace.
+    uint8_t policies = CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITEBACK | CACHE_NODATAPOLICY;
+    cache_hierarchy_t *hierarchies[3];
+    for (size_t h = 0; h < 3; h++) {
+        cache_t *levels[3] = {
+            cache_new(2048, 64, 2, policies),
+            cache_new(131072, 64, 8, policies),
+            cache_new(1048576, 64, 16, policies),
+        };
+        hierarchies[h] = cache_hierarchy_new(h == 2 ? 2 : 3, levels);
+        if (h == 2) {
+            cache_free(levels[2]);
+        }
+    }
+    hierarchies[2]->filter = trace_writer_open("test_filter.trace", TRACE_FLAG_TYPE);
+    REQUIRE(hierarchies[2]->filter != NULL);
+    ASSERT_EQUAL(cache_hierarchy_start_pipeline(hierarchies[1], 64), 0);
+
+    uint64_t seed = 5;
+    for (size_t i = 0; i < 100000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uintptr_t address = (seed >> 59) == 0 ? (seed >> 20) % (1 << 20) : (i % 8192) * 8;
+        int type = (seed >> 40) % 4 == 0 ? CACHE_ACCESS_STORE : CACHE_ACCESS_LOAD;
+        cache_hierarchy_access(hierarchies[0], address, type, rand);
+        cache_hierarchy_access_pipelined(hierarchies[1], address, type, rand);
+        cache_hierarchy_access(hierarchies[2], address, type, rand);
+    }
+    cache_hierarchy_stop_pipeline(hierarchies[1]);
+    uint64_t filtered = hierarchies[2]->filter->record_count;
+    ASSERT_EQUAL(trace_writer_close(hierarchies[2]->filter), 0);
+
+    // Dirty lines evicted from a level are written back to the one below.
+    cache_t *l2 = hierarchies[0]->levels[1], *l3 = hierarchies[0]->levels[2];
+    REQUIRE(hierarchies[0]->levels[0]->writeback_count > 0);
+    ASSERT_EQUAL(l2->type_access_count[CACHE_ACCESS_WRITEBACK], hierarchies[0]->levels[0]->writeback_count);
+    ASSERT_EQUAL(l3->type_access_count[CACHE_ACCESS_WRITEBACK], l2->writeback_count);
+    ASSERT_EQUAL(filtered, l3->access_count);
+    REQUIRE(filtered < 100000 / 4);
+
+    // Replaying the filter trace through L3 alone gives the statistics of
+    // the full hierarchy, and so does the pipeline.
+    cache_t *llc = cache_new(1048576, 64, 16, policies);
+    ASSERT_EQUAL(trace_replay(llc, "test_filter.trace"), 0);
+    for (size_t h = 0; h < 2; h++) {
+        cache_t *cache = h == 0 ? llc : hierarchies[1]->levels[2];
+        ASSERT_EQUAL(cache->access_count, l3->access_count);
+        ASSERT_EQUAL(cache->miss_count, l3->miss_count);
+        ASSERT_EQUAL(cache->writeback_count, l3->writeback_count);
+        for (int type = 0; type < CACHE_ACCESS_TYPES; type++) {
+            ASSERT_EQUAL(cache->type_access_count[type], l3->type_access_count[type]);
+            ASSERT_EQUAL(cache->type_miss_count[type], l3->type_miss_count[type]);
+        }
+    }
+    ASSERT_EQUAL(cache_hierarchy_stall_cycles(hierarchies[0], CACHE_ACCESS_WRITEBACK), 0);
+
+    cache_free(llc);
+    for (size_t h = 0; h < 3; h++) {
+        cache_hierarchy_free(hierarchies[h]);
+    }
+    remove("test_filter.trace");
+}
+
+TEST_CASE("cache_fully_associative", "[weight=1][part=test]")
+{
+    // A large fully associative LRU cache is indexed, and gives the same
+    // results as the same cache scanning its lru_list.
+    uint8_t policies = CACHE_REPLACEMENTPOLICY_LRU | CACHE_WRITEPOLICY_WRITEBACK | CACHE_NODATAPOLICY;
+    cache_t *indexed = cache_new(4096 * 64, 64, 4096, policies);
+    cache_t *scanned = cache_new(4096 * 64, 64, 4096, policies);
+    REQUIRE(indexed->fully_associative != NULL);
+    cache_fully_associative_disable(scanned);
+    REQUIRE(scanned->fully_associative == NULL);
+
+    cache_t *small = cache_new(64 * 64, 64, 64, policies);
+    REQUIRE(small->fully_associative == NULL);
+    cache_free(small);
+
+    // Fill part of the cache, then mix hits, misses and evictions.
+    uint64_t seed = 11;
+    for (size_t i = 0; i < 200000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uintptr_t address = i < 1000 ? i * 64 : ((seed >> 20) % (6000 + i / 100)) * 64 + (seed >> 58);
+        int type = (seed >> 40) % 3 == 0 ? CACHE_ACCESS_STORE : CACHE_ACCESS_LOAD;
+        cache_access(indexed, address, type, rand);
+        cache_access(scanned, address, type, rand);
+        if (i == 500) {
+            cache_fully_associative_sync(indexed);
+            for (size_t j = 0; j < 4096; j++) {
+                ASSERT_EQUAL(indexed->sets[0].lru_list[j], scanned->sets[0].lru_list[j]);
+            }
+        }
+    }
+    ASSERT_EQUAL(indexed->miss_count, scanned->miss_count);
+    ASSERT_EQUAL(indexed->writeback_count, scanned->writeback_count);
+    REQUIRE(indexed->miss_count > 10000);
+    REQUIRE(indexed->miss_count < 190000);
+    cache_fully_associative_sync(indexed);
+    for (size_t j = 0; j < 4096; j++) {
+        ASSERT_EQUAL(indexed->sets[0].lru_list[j], scanned->sets[0].lru_list[j]);
+        ASSERT_EQUAL(indexed->lines[j].tag, scanned->lines[j].tag);
+        ASSERT_EQUAL(indexed->lines[j].is_dirty, scanned->lines[j].is_dirty);
+    }
+
+    // The helpers of cache.h go through the index.
+    cache_line_t *line = cache_set_find_matching_line(indexed, indexed->sets, indexed->lines[100].tag);
+    REQUIRE(line == indexed->lines + 100);
+    REQUIRE(cache_fully_associative_is_mru(indexed, line));
+    REQUIRE(cache_set_find_matching_line(scanned, scanned->sets, scanned->lines[100].tag) == scanned->lines + 100);
+
+    // Invalidating a line drops the index, and the lru_list takes over.
+    cache_line_invalidate(indexed, indexed->sets, 7);
+    cache_line_invalidate(scanned, scanned->sets, 7);
+    REQUIRE(indexed->fully_associative == NULL);
+    for (size_t i = 0; i < 10000; i++) {
+        cache_read(indexed, i * 192, rand);
+        cache_read(scanned, i * 192, rand);
+    }
+    ASSERT_EQUAL(indexed->miss_count, scanned->miss_count);
+
+    cache_free(indexed);
+    cache_free(scanned);
+}
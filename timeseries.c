@@ -0,0 +1,130 @@
+#include "timeseries.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * Start taking snapshots of the cache.
+ */
+int cache_timeseries_init(cache_t *cache, uint64_t interval, size_t capacity) {
+
+    if (interval == 0 || capacity < 2) {
+        return -1;
+    }
+    if (cache->timeseries != NULL) {
+        cache_timeseries_free(cache);
+    }
+
+    cache_timeseries_t *timeseries = (cache_timeseries_t *)calloc(1, sizeof(cache_timeseries_t));
+    timeseries->snapshots = (cache_snapshot_t *)malloc(capacity * sizeof(cache_snapshot_t));
+    if (timeseries->snapshots == NULL) {
+        free(timeseries);
+        return -1;
+    }
+    timeseries->capacity = capacity;
+    timeseries->interval = interval;
+    timeseries->next_snapshot = cache->access_count + interval;
+
+    // The first window starts with the counters as they are now.
+    timeseries->snapshots[0].access_count = cache->access_count;
+    timeseries->snapshots[0].miss_count = cache->miss_count;
+    timeseries->snapshots[0].cycle_count = cache->cycle_count;
+    timeseries->snapshots[0].label = 0;
+    timeseries->count = 1;
+
+    cache->timeseries = timeseries;
+    return 0;
+}
+
+/*
+ * Frees the time series of a cache.
+ */
+void cache_timeseries_free(cache_t *cache) {
+    free(cache->timeseries->snapshots);
+    free(cache->timeseries);
+    cache->timeseries = NULL;
+}
+
+/*
+ * Set the label of the current window.
+ */
+void cache_timeseries_label(cache_t *cache, uint32_t label) {
+    // A window that just ended keeps the label it had.
+    if (cache->access_count == cache->timeseries->next_snapshot) {
+        cache_timeseries_snapshot(cache);
+    }
+    cache->timeseries->label = label;
+}
+
+/*
+ * Record the counters at the end of a window. When the array is full, keep
+ * every other snapshot and double the interval.
+ */
+void cache_timeseries_snapshot(cache_t *cache) {
+
+    cache_timeseries_t *timeseries = cache->timeseries;
+    if (timeseries->count == timeseries->capacity) {
+        // Snapshots hold running totals, so dropping one merges two windows.
+        size_t kept = 1;
+        for (size_t i = 2; i < timeseries->count; i += 2) {
+            timeseries->snapshots[kept++] = timeseries->snapshots[i];
+        }
+        timeseries->count = kept;
+        timeseries->interval *= 2;
+
+        // The window in progress started at the last snapshot kept.
+        timeseries->next_snapshot = timeseries->snapshots[kept - 1].access_count + timeseries->interval;
+        if (timeseries->next_snapshot > cache->access_count) {
+            return;
+        }
+    }
+
+    cache_snapshot_t *snapshot = timeseries->snapshots + timeseries->count++;
+    snapshot->access_count = cache->access_count;
+    snapshot->miss_count = cache->miss_count;
+    snapshot->cycle_count = cache->cycle_count;
+    snapshot->label = timeseries->label;
+    timeseries->next_snapshot = cache->access_count + timeseries->interval;
+}
+
+/*
+ * Print one window as CSV.
+ */
+static void cache_timeseries_print_window(FILE *out, size_t window, const cache_snapshot_t *start,
+                                          const cache_snapshot_t *end) {
+    uint64_t accesses = end->access_count - start->access_count;
+    uint64_t misses = end->miss_count - start->miss_count;
+    fprintf(out, "%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.6f,%" PRIu64 ",%" PRIu32 "\n", window,
+            start->access_count, accesses, misses, accesses == 0 ? 0.0 : (double) misses / accesses,
+            end->cycle_count - start->cycle_count, end->label);
+}
+
+/*
+ * Print the time series as CSV.
+ */
+void cache_timeseries_print_csv(FILE *out, cache_t *cache) {
+
+    cache_timeseries_t *timeseries = cache->timeseries;
+    fprintf(out, "window,first_access,accesses,misses,miss_rate,cycles,label\n");
+    for (size_t i = 1; i < timeseries->count; i++) {
+        cache_timeseries_print_window(out, i - 1, timeseries->snapshots + i - 1, timeseries->snapshots + i);
+    }
+
+    cache_snapshot_t now = {cache->access_count, cache->miss_count, cache->cycle_count, timeseries->label};
+    const cache_snapshot_t *last = timeseries->snapshots + timeseries->count - 1;
+    if (now.access_count > last->access_count) {
+        cache_timeseries_print_window(out, timeseries->count - 1, last, &now);
+    }
+}
+
+/*
+ * Write the time series as CSV to a file.
+ */
+int cache_timeseries_write_csv(cache_t *cache, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        return -1;
+    }
+    cache_timeseries_print_csv(out, cache);
+    return fclose(out) == 0 ? 0 : -1;
+}
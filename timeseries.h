@@ -0,0 +1,80 @@
+/*
+ * timeseries.h
+ *
+ * Time series of the statistics of a cache, to see how its miss rate
+ * changes across the phases of a run.
+ *
+ * Every interval accesses, the counters of the cache are copied into a
+ * preallocated array of snapshots. Between snapshots, an access only costs
+ * a comparison. When the array is full, every other snapshot is dropped
+ * and the interval doubles, so a run of any length fits, at a coarser
+ * resolution.
+ *
+ * Each window can carry a label set by the caller, for instance the type
+ * of request being served, to match phases with what the program did.
+ */
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include "cache.h"
+
+/*
+ * Structure used to store the counters of the cache at the end of a
+ * window, and the label in effect then.
+ */
+typedef struct cache_snapshot_s {
+    uint64_t access_count;
+    uint64_t miss_count;
+    uint64_t cycle_count;
+    uint32_t label;
+} cache_snapshot_t;
+
+/*
+ * Structure used to store the time series of a cache.
+ */
+typedef struct cache_timeseries_s {
+    cache_snapshot_t *snapshots;
+    size_t count, capacity;
+
+    /* Accesses per window, and access count of the next snapshot. */
+    uint64_t interval;
+    uint64_t next_snapshot;
+
+    /* Label of the current window. */
+    uint32_t label;
+} cache_timeseries_t;
+
+/*
+ * Start taking a snapshot of the cache every interval accesses, keeping
+ * at most capacity snapshots. Returns 0 on success and -1 on failure.
+ */
+int cache_timeseries_init(cache_t *cache, uint64_t interval, size_t capacity);
+
+/*
+ * Frees the time series of a cache.
+ */
+void cache_timeseries_free(cache_t *cache);
+
+/*
+ * Set the label of the current window, and of the next ones.
+ */
+void cache_timeseries_label(cache_t *cache, uint32_t label);
+
+/*
+ * Print the time series as CSV, one line per window, including the
+ * window in progress.
+ */
+void cache_timeseries_print_csv(FILE *out, cache_t *cache);
+
+/*
+ * Write the time series as CSV to a file at path. Returns 0 on success and
+ * -1 on failure.
+ */
+int cache_timeseries_write_csv(cache_t *cache, const char *path);
+
+/*
+ *  Helpers used by cache_read
+ */
+void cache_timeseries_snapshot(cache_t *cache);
+
+#endif
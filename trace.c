@@ -0,0 +1,346 @@
+#include "trace.h"
+#include "batch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * Longest encoding of a 64-bit varint.
+ */
+#define TRACE_MAX_VARINT 10
+
+static uint64_t zigzag_encode(uint64_t delta) {
+    return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+static uint64_t zigzag_decode(uint64_t value) {
+    return (value >> 1) ^ -(value & 1);
+}
+
+/*
+ * Write the buffer of a trace to its file, and remember if it failed.
+ */
+static void trace_writer_flush(trace_writer_t *writer) {
+    if (fwrite(writer->buffer, 1, writer->used, writer->file) != writer->used) {
+        writer->error = true;
+    }
+    writer->used = 0;
+}
+
+static void trace_write_varint(trace_writer_t *writer, uint64_t value) {
+    if (writer->used + TRACE_MAX_VARINT > TRACE_BUFFER_SIZE) {
+        trace_writer_flush(writer);
+    }
+    while (value >= 0x80) {
+        writer->buffer[writer->used++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    writer->buffer[writer->used++] = (uint8_t)value;
+}
+
+/*
+ * Write the pending run of repeated differences, if any.
+ */
+static void trace_write_run(trace_writer_t *writer) {
+    if (writer->run_length > 0) {
+        trace_write_varint(writer, writer->run_length << 1 | 1);
+        writer->run_length = 0;
+    }
+}
+
+/*
+ * Create a new trace file at path.
+ */
+trace_writer_t *trace_writer_open(const char *path, uint64_t flags) {
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    trace_header_t header = {TRACE_MAGIC, TRACE_VERSION, flags};
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        return NULL;
+    }
+
+    trace_writer_t *writer = (trace_writer_t *)calloc(1, sizeof(trace_writer_t));
+    writer->file = file;
+    writer->buffer = (uint8_t *)malloc(TRACE_BUFFER_SIZE);
+    writer->flags = flags;
+    return writer;
+}
+
+/*
+ * Append an access to a trace.
+ */
+void trace_write(trace_writer_t *writer, uint64_t address) {
+    trace_write_pc(writer, address, 0);
+}
+
+void trace_write_pc(trace_writer_t *writer, uint64_t address, uint64_t pc) {
+
+    if (!(writer->flags & TRACE_FLAG_PC)) {
+        pc = 0;
+    }
+
+    uint64_t delta = address - writer->address;
+    uint64_t pc_delta = pc - writer->pc;
+    if (writer->record_count > 0 && delta == writer->stride && pc_delta == writer->pc_stride) {
+        writer->run_length++;
+    } else {
+        trace_write_run(writer);
+        trace_write_varint(writer, zigzag_encode(delta) << 1);
+        if (writer->flags & TRACE_FLAG_PC) {
+            trace_write_varint(writer, zigzag_encode(pc_delta));
+        }
+        writer->stride = delta;
+        writer->pc_stride = pc_delta;
+    }
+    writer->address = address;
+    writer->pc = pc;
+    writer->record_count++;
+}
+
+/*
+ * Flush and close a trace.
+ */
+int trace_writer_close(trace_writer_t *writer) {
+    trace_write_run(writer);
+    trace_writer_flush(writer);
+    int result = writer->error ? -1 : 0;
+    if (fclose(writer->file) != 0) {
+        result = -1;
+    }
+    free(writer->buffer);
+    free(writer);
+    return result;
+}
+
+/*
+ * Make sure the buffer holds a full varint, unless the file ends first.
+ */
+static void trace_reader_fill(trace_reader_t *reader) {
+    size_t left = reader->length - reader->position;
+    memmove(reader->buffer, reader->buffer + reader->position, left);
+    reader->length = left + fread(reader->buffer + left, 1, TRACE_BUFFER_SIZE - left, reader->file);
+    reader->position = 0;
+}
+
+/*
+ * Open the trace file at path.
+ */
+trace_reader_t *trace_reader_open(const char *path) {
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    trace_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != TRACE_MAGIC
+        || header.version != TRACE_VERSION) {
+        fclose(file);
+        return NULL;
+    }
+
+    trace_reader_t *reader = (trace_reader_t *)calloc(1, sizeof(trace_reader_t));
+    reader->file = file;
+    reader->buffer = (uint8_t *)malloc(TRACE_BUFFER_SIZE);
+    reader->flags = header.flags;
+    return reader;
+}
+
+/*
+ * Decode the next varint, returning false at the end of the trace. The
+ * trace may only end before the first varint of a record.
+ */
+static bool trace_read_varint(trace_reader_t *reader, uint64_t *value, bool first) {
+
+    if (reader->error) {
+        return false;
+    }
+    if (reader->position + TRACE_MAX_VARINT > reader->length) {
+        trace_reader_fill(reader);
+        if (ferror(reader->file)) {
+            reader->error = true;
+            return false;
+        }
+        if (reader->position == reader->length) {
+            reader->error = !first;
+            return false;
+        }
+    }
+
+    uint64_t result = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        if (reader->position == reader->length || shift >= 7 * TRACE_MAX_VARINT) {
+            reader->error = true;
+            return false;
+        }
+        byte = reader->buffer[reader->position++];
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    *value = result;
+    return true;
+}
+
+/*
+ * Read the next access of a trace.
+ */
+bool trace_read(trace_reader_t *reader, uint64_t *address) {
+    uint64_t pc;
+    return trace_read_pc(reader, address, &pc);
+}
+
+bool trace_read_pc(trace_reader_t *reader, uint64_t *address, uint64_t *pc) {
+
+    if (reader->run_remaining == 0) {
+        uint64_t record;
+        if (!trace_read_varint(reader, &record, true)) {
+            return false;
+        }
+        if (record == 1) {
+            reader->error = true;
+            return false;
+        }
+        if (record & 1) {
+            reader->run_remaining = record >> 1;
+        } else {
+            reader->stride = zigzag_decode(record >> 1);
+            if (reader->flags & TRACE_FLAG_PC) {
+                uint64_t pc_record;
+                if (!trace_read_varint(reader, &pc_record, false)) {
+                    return false;
+                }
+                reader->pc_stride = zigzag_decode(pc_record);
+            }
+            reader->address += reader->stride;
+            reader->pc += reader->pc_stride;
+            *address = reader->address;
+            *pc = reader->pc;
+            return true;
+        }
+    }
+
+    reader->run_remaining--;
+    reader->address += reader->stride;
+    reader->pc += reader->pc_stride;
+    *address = reader->address;
+    *pc = reader->pc;
+    return true;
+}
+
+/*
+ * Read up to count accesses.
+ */
+size_t trace_read_block(trace_reader_t *reader, uint64_t *addresses, uint64_t *pcs, size_t count) {
+
+    size_t read = 0;
+    while (read < count) {
+        // Expand runs without going through trace_read for every access.
+        if (reader->run_remaining > 0) {
+            size_t n = count - read < reader->run_remaining ? count - read : reader->run_remaining;
+            uint64_t address = reader->address;
+            for (size_t i = 0; i < n; i++) {
+                address += reader->stride;
+                addresses[read + i] = address;
+            }
+            if (pcs != NULL) {
+                uint64_t pc = reader->pc;
+                for (size_t i = 0; i < n; i++) {
+                    pc += reader->pc_stride;
+                    pcs[read + i] = pc;
+                }
+            }
+            reader->address = address;
+            reader->pc += n * reader->pc_stride;
+            reader->run_remaining -= n;
+            read += n;
+        } else {
+            uint64_t pc;
+            if (!trace_read_pc(reader, addresses + read, &pc)) {
+                break;
+            }
+            if (pcs != NULL) {
+                pcs[read] = pc;
+            }
+            read++;
+        }
+    }
+    return read;
+}
+
+/*
+ * Close a trace.
+ */
+void trace_reader_close(trace_reader_t *reader) {
+    fclose(reader->file);
+    free(reader->buffer);
+    free(reader);
+}
+
+/*
+ * Encode a raw trace into a compact trace.
+ */
+int trace_encode_raw(const char *raw_path, const char *trace_path) {
+
+    FILE *raw = fopen(raw_path, "rb");
+    if (raw == NULL) {
+        return -1;
+    }
+    trace_writer_t *writer = trace_writer_open(trace_path, 0);
+    if (writer == NULL) {
+        fclose(raw);
+        return -1;
+    }
+
+    uint64_t addresses[TRACE_BUFFER_SIZE / sizeof(uint64_t)];
+    size_t count;
+    while ((count = fread(addresses, sizeof(uint64_t), TRACE_BUFFER_SIZE / sizeof(uint64_t), raw)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            trace_write(writer, addresses[i]);
+        }
+    }
+
+    fclose(raw);
+    return trace_writer_close(writer);
+}
+
+/*
+ * Read every access of a trace through the cache.
+ */
+int trace_replay(cache_t *cache, const char *path) {
+
+    trace_reader_t *reader = trace_reader_open(path);
+    if (reader == NULL) {
+        return -1;
+    }
+
+    uint64_t addresses[TRACE_BUFFER_SIZE / sizeof(uint64_t)];
+    uint64_t pcs[TRACE_BUFFER_SIZE / sizeof(uint64_t)];
+    bool has_pc = (reader->flags & TRACE_FLAG_PC) != 0;
+    size_t count;
+    bool typed = (reader->flags & TRACE_FLAG_TYPE) != 0;
+    while ((count = trace_read_block(reader, addresses, has_pc ? pcs : NULL, TRACE_BUFFER_SIZE / sizeof(uint64_t))) > 0) {
+        if (!typed) {
+            cache_read_batch(cache, addresses, has_pc ? pcs : NULL, count, NULL, rand);
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (has_pc) {
+                cache->access_pc = pcs[i];
+            }
+            cache_access(cache, addresses[i] & ~TRACE_TYPE_MASK, (int)(addresses[i] & TRACE_TYPE_MASK), rand);
+            cache->access_pc = 0;
+        }
+    }
+
+    int result = reader->error ? -1 : 0;
+    trace_reader_close(reader);
+    return result;
+}
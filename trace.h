@@ -0,0 +1,153 @@
+/*
+ * trace.h
+ *
+ * Compact trace format for memory accesses, with a streaming encoder and
+ * decoder.
+ *
+ * After a small header, a trace is a sequence of varint records. Each
+ * record either holds the zigzag-encoded difference between an address and
+ * the previous one (low bit 0), or a number of accesses that each repeat
+ * the last difference (low bit 1). Loops walking an array with a constant
+ * stride thus take a couple of bytes per loop instead of 8 bytes per access.
+ *
+ * Traces with TRACE_FLAG_PC also record the program counter of each access:
+ * a difference record is followed by the zigzag-encoded difference between
+ * its program counter and the previous one, and runs repeat both differences.
+ *
+ * Traces with TRACE_FLAG_TYPE hold accesses of any type, such as the misses
+ * and writebacks leaving a hierarchy (see hierarchy.h): the low bits of each
+ * address hold its type, which leaves the line intact since lines are
+ * larger than 4 bytes.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "cache.h"
+
+#define TRACE_MAGIC   0x43525443 /* "CTRC" */
+#define TRACE_VERSION 1
+
+/*
+ * Flags of a trace.
+ */
+#define TRACE_FLAG_PC   0b00000001
+#define TRACE_FLAG_TYPE 0b00000010
+
+/*
+ * Bits of an address of a TRACE_FLAG_TYPE trace holding the type of access.
+ */
+#define TRACE_TYPE_MASK ((uint64_t) 3)
+
+/*
+ * Size of the buffers used to read and write traces.
+ */
+#define TRACE_BUFFER_SIZE 65536
+
+/*
+ * Header at the start of a trace file.
+ */
+typedef struct trace_header_s {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t flags;
+} trace_header_t;
+
+/*
+ * Structure used to write a trace.
+ */
+typedef struct trace_writer_s {
+    FILE *file;
+    uint8_t *buffer;
+    size_t used;
+
+    /* Last address and program counter written, differences to the ones
+     * before, and number of accesses since then that repeated them. */
+    uint64_t address, pc;
+    uint64_t stride, pc_stride;
+    uint64_t run_length;
+
+    uint64_t flags;
+    uint64_t record_count;
+
+    /* Whether writing to the file failed, in which case the trace is lost. */
+    bool error;
+} trace_writer_t;
+
+/*
+ * Structure used to read a trace.
+ */
+typedef struct trace_reader_s {
+    FILE *file;
+    uint8_t *buffer;
+    size_t position, length;
+
+    /* Last address and program counter read, last differences, and accesses
+     * left in the current run. */
+    uint64_t address, pc;
+    uint64_t stride, pc_stride;
+    uint64_t run_remaining;
+
+    uint64_t flags;
+
+    /* Whether the trace ended in the middle of a record, held a malformed
+     * one, or could not be read. Reading stops as at the end of the trace. */
+    bool error;
+} trace_reader_t;
+
+/*
+ * Create a new trace file at path, with the given flags. Returns NULL on failure.
+ */
+trace_writer_t *trace_writer_open(const char *path, uint64_t flags);
+
+/*
+ * Append an access to a trace. Traces without TRACE_FLAG_PC ignore pc.
+ */
+void trace_write(trace_writer_t *writer, uint64_t address);
+void trace_write_pc(trace_writer_t *writer, uint64_t address, uint64_t pc);
+
+/*
+ * Flush and close a trace. Returns 0 on success and -1 if any write to the
+ * file failed.
+ */
+int trace_writer_close(trace_writer_t *writer);
+
+/*
+ * Open the trace file at path. Returns NULL on failure.
+ */
+trace_reader_t *trace_reader_open(const char *path);
+
+/*
+ * Read the next access of a trace. Returns false at the end of the trace,
+ * or on an error, which sets reader->error. Traces without TRACE_FLAG_PC
+ * read a program counter of 0.
+ */
+bool trace_read(trace_reader_t *reader, uint64_t *address);
+bool trace_read_pc(trace_reader_t *reader, uint64_t *address, uint64_t *pc);
+
+/*
+ * Read up to count accesses, and return how many were read. The program
+ * counters are stored in pcs unless it is NULL.
+ */
+size_t trace_read_block(trace_reader_t *reader, uint64_t *addresses, uint64_t *pcs, size_t count);
+
+/*
+ * Close a trace.
+ */
+void trace_reader_close(trace_reader_t *reader);
+
+/*
+ * Encode a raw trace (a file of uint64_t addresses) into a compact trace.
+ * Returns 0 on success and -1 on failure.
+ */
+int trace_encode_raw(const char *raw_path, const char *trace_path);
+
+/*
+ * Read every access of the trace at path through the cache, which should
+ * use CACHE_NODATAPOLICY. Program counters of the trace, if any, are passed
+ * to the cache, and so are the types of a TRACE_FLAG_TYPE trace. Returns 0
+ * on success and -1 on failure, including a truncated or corrupt trace,
+ * whose accesses up to the error have been replayed.
+ */
+int trace_replay(cache_t *cache, const char *path);
+
+#endif
@@ -0,0 +1,62 @@
+#include "cache.h"
+#include "hierarchy.h"
+#include "config.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Run the accesses of a configuration file (see config.h) through the
+ * levels it describes, and write the misses and writebacks leaving the last
+ * level to a trace, with their types (see hierarchy.h). Replaying that
+ * trace through a cache simulates it below those levels.
+ *
+ * Usage: tracefilter CONFIG OUTPUT
+ */
+
+int main(int argc, char **argv) {
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s CONFIG OUTPUT\n", argv[0]);
+        return 1;
+    }
+
+    cache_config_t config;
+    if (cache_config_load(&config, argv[1]) != 0) {
+        fprintf(stderr, "%s\n", config.error);
+        return 1;
+    }
+    cache_hierarchy_t *hierarchy = cache_config_build(&config);
+    if (hierarchy == NULL) {
+        fprintf(stderr, "%s\n", config.error);
+        return 1;
+    }
+    hierarchy->filter = trace_writer_open(argv[2], TRACE_FLAG_TYPE);
+    if (hierarchy->filter == NULL) {
+        fprintf(stderr, "%s: cannot create trace\n", argv[2]);
+        cache_hierarchy_free(hierarchy);
+        return 1;
+    }
+
+    int result = cache_config_run(&config, hierarchy);
+    uint64_t output_count = hierarchy->filter->record_count;
+    if (trace_writer_close(hierarchy->filter) != 0 && result == 0) {
+        snprintf(config.error, sizeof(config.error), "%s: cannot write trace", argv[2]);
+        result = -1;
+    }
+    if (result != 0) {
+        fprintf(stderr, "%s\n", config.error);
+        cache_hierarchy_free(hierarchy);
+        return 1;
+    }
+
+    uint64_t input_count = hierarchy->levels[0]->access_count;
+    if (hierarchy->instruction_cache != NULL) {
+        input_count += hierarchy->instruction_cache->access_count;
+    }
+    printf("accesses = %" PRIu64 ", filtered = %" PRIu64 ", ratio = %.4f\n", input_count, output_count,
+           input_count == 0 ? 0.0 : (double) output_count / input_count);
+
+    cache_hierarchy_free(hierarchy);
+    return 0;
+}